@@ -0,0 +1,93 @@
+// Weighs the CPU time deflating entity frames costs against the bytes it
+// saves, at several compression levels and numbers of entities. Frames are
+// written the way TransitSimulation writes them and compressed one by one
+// with the server's MessageDeflater, as a session asking for compression
+// gets them. AddEntity frames are measured as the server sends them, those
+// shorter than its threshold left as they are. UpdateEntity frames are all
+// below it and never deflated, they are measured anyway to show what
+// lowering the threshold would buy.
+
+#include <chrono>  // NOLINT [build/c++11]
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "WebServer.h"
+#include "util/JsonWriter.h"
+#include "util/MessageDeflater.h"
+
+namespace {
+
+// One AddEntity with details, or UpdateEntity without, per entity
+std::vector<std::string> entityFrames(int entities, bool add) {
+  std::vector<std::string> frames;
+  JsonWriter writer;
+  for (int i = 0; i < entities; i++) {
+    writer.clear();
+    writer.beginObject().key("event").value(add ? "AddEntity" : "UpdateEntity");
+    writer.key("details").beginObject();
+    if (add) {
+      writer.key("details").beginObject();
+      writer.key("type").value("drone").key("name").value(
+          "drone-" + std::to_string(i));
+      writer.key("mesh").value("assets/model/drone.glb");
+      writer.key("position").value(Vector3(498.292 + i, 270, -228.623));
+      writer.key("scale").value(Vector3(0.1, 0.1, 0.1));
+      writer.key("direction").value(Vector3(1, 0, 0));
+      writer.key("speed").value(30.0).key("radius").value(1.0);
+      writer.key("offset").value(Vector3(0, 0.6, 0));
+      writer.endObject();
+      writer.key("name").value("drone-" + std::to_string(i));
+    }
+    writer.key("detailsId").value(i % 7).key("id").value(i);
+    writer.key("pos").value(
+        Vector3(498.292 + i * 0.37, 270.0001 + i * 1e-3, -228.623 + i * 0.11));
+    writer.key("dir").value(Vector3(0.6, 0, 0.8));
+    writer.key("vel").value(Vector3(17.912, 0, 23.99 - i * 1e-4));
+    writer.key("time").value(12.345678 + i * 1e-6).key("color").value("red");
+    writer.endObject().endObject();
+    frames.push_back(writer.str());
+  }
+  return frames;
+}
+
+void measure(const char* kind, int level, const std::vector<std::string>& all,
+             size_t threshold) {
+  MessageDeflater deflater(level);
+  std::vector<unsigned char> out;
+  size_t raw = 0, wire = 0, sent = 0;
+  double cpuStart = MessageDeflater::threadSeconds();
+  auto wallStart = std::chrono::steady_clock::now();
+  for (const std::string& frame : all) {
+    if (frame.size() < threshold) continue;
+    deflater.compress(frame, out);
+    raw += frame.size();
+    wire += out.empty() ? frame.size() : out.size();
+    sent++;
+  }
+  double cpu = MessageDeflater::threadSeconds() - cpuStart;
+  double wall = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - wallStart)
+                    .count();
+  std::printf(
+      "%-6s level %d %6zu frames: %9zu -> %9zu bytes (%5.1f%%), "
+      "%7.3f ms CPU, %7.3f ms wall, %6.1f ns CPU per byte saved\n",
+      kind, level, sent, raw, wire, sent ? 100.0 * wire / raw : 0, cpu * 1e3,
+      wall * 1e3, raw > wire ? cpu * 1e9 / (raw - wire) : 0);
+}
+
+}  // namespace
+
+int main() {
+  size_t threshold = WebServerBase::DeflateOptions().threshold;
+  for (int entities : {1000, 10000}) {
+    std::vector<std::string> adds = entityFrames(entities, true);
+    std::vector<std::string> updates = entityFrames(entities, false);
+    std::printf("%d entities, threshold %zu bytes:\n", entities, threshold);
+    for (int level : {1, 3, 6, 9}) {
+      measure("add", level, adds, threshold);
+      measure("update", level, updates, 0);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,97 @@
+// Times one UpdateEntity message for a drone with its scene details, written
+// the way entity events used to be, as a JsonObject serialized with
+// toString(), and the way they are now, with JsonWriter. Both include the
+// shared_ptr<string> the message is queued as.
+
+#include <chrono>  // NOLINT [build/c++11]
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "util/JsonWriter.h"
+#include "util/json.h"
+
+namespace {
+
+const int iterations = 100000;
+
+const char droneDetails[] =
+    R"({"type":"drone","name":"Drone","mesh":"assets/model/drone.glb",)"
+    R"("position":[498.292,270,-228.623],"scale":[0.1,0.1,0.1],)"
+    R"("rotation":[0,0,0,0],"direction":[1,0,0],"speed":30.0,"radius":1.0,)"
+    R"("start":2.0,"duration":2.0,"offset":[0,0.6,0]})";
+
+const Vector3 pos(498.29213412, 270.0001, -228.6231234);
+const Vector3 dir(0.6, 0, 0.8);
+const Vector3 vel(17.9, 0, 23.99);
+const double time = 12.345678;
+
+std::shared_ptr<const std::string> withJsonObject(const JsonObject& details,
+                                                  int id) {
+  JsonObject event;
+  event["details"] = details;
+  event["id"] = id;
+  event["pos"] = JsonArray{pos.x, pos.y, pos.z};
+  event["dir"] = JsonArray{dir.x, dir.y, dir.z};
+  event["vel"] = JsonArray{vel.x, vel.y, vel.z};
+  event["time"] = time;
+  event["color"] = "#ff00ff";
+  JsonObject message;
+  message["event"] = "UpdateEntity";
+  message["details"] = event;
+  return std::make_shared<const std::string>(message.toString());
+}
+
+std::shared_ptr<const std::string> withJsonWriter(JsonWriter& writer,
+                                                  const JsonObject& details,
+                                                  int id) {
+  writer.clear();
+  writer.beginObject().key("event").value("UpdateEntity").key("details");
+  writer.beginObject().key("details").value(details).key("id").value(id);
+  writer.key("pos").value(pos).key("dir").value(dir).key("vel").value(vel);
+  writer.key("time").value(time).key("color").value("#ff00ff");
+  writer.endObject().endObject();
+  return std::make_shared<const std::string>(writer.str());
+}
+
+// Nanoseconds per message of make(i)
+template <class F>
+double timePerMessage(F make, size_t& bytes) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) bytes += make(i)->size();
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         iterations;
+}
+
+}  // namespace
+
+int main() {
+  JsonObject details;
+  if (!JsonObject::parse(droneDetails, details)) return 1;
+  JsonWriter writer;
+
+  // both have to say the same thing
+  JsonObject a, b;
+  std::string before = *withJsonObject(details, 7);
+  std::string after = *withJsonWriter(writer, details, 7);
+  if (!JsonObject::parse(before, a) || !JsonObject::parse(after, b) ||
+      a.toString() != b.toString()) {
+    std::fprintf(stderr, "the messages differ:\n%s\n%s\n", before.c_str(),
+                 after.c_str());
+    return 1;
+  }
+
+  size_t bytes = 0;
+  double object = timePerMessage(
+      [&](int i) { return withJsonObject(details, i); }, bytes);
+  double streamed = timePerMessage(
+      [&](int i) { return withJsonWriter(writer, details, i); }, bytes);
+  std::printf(
+      "UpdateEntity, %d messages: JsonObject %.0f ns (%zu bytes), "
+      "JsonWriter %.0f ns (%zu bytes), %.1fx\n",
+      iterations, object, before.size(), streamed, after.size(),
+      object / streamed);
+  return bytes == 0;
+}
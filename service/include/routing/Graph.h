@@ -1,11 +1,14 @@
 #ifndef GRAPH_H_
 #define GRAPH_H_
 
+#include <atomic>
+#include <cstdint>
 #include <optional>
 #include <vector>
 
 #include "RoutingStrategy.h"
 #include "vector3.h"
+#include "vector_kernels.h"
 
 namespace routing {
 
@@ -22,14 +25,55 @@ class GraphNode {
 
 class Graph {
  public:
+  /**
+   * @brief Routes asked of getPath by every graph in the process, counted
+   * without locks so they can be read while routes are planned.
+   */
+  struct QueryStats {
+    std::atomic<uint64_t> queries{0};
+    std::atomic<uint64_t> failures{0};     // no route between the nodes
+    std::atomic<uint64_t> nanoseconds{0};  // spent planning
+  };
+  static QueryStats queryStats;
+
+  /**
+   * @brief Whether graphs made from now on keep a single precision copy of
+   * their node positions, see setSinglePrecision
+   * @param enabled Whether they keep one
+   */
+  static void setSinglePrecisionByDefault(bool enabled) {
+    singlePrecisionByDefault = enabled;
+  }
+
   std::vector<std::vector<int>> adjacencyList;
   std::vector<GraphNode> nodes;
-  Graph() {}
+  // node positions again in single precision, one array per coordinate, for
+  // scans over many nodes such as nearestNode and A* heuristics, if the
+  // graph keeps them. 12 more bytes a node, read with AVX2.
+  Float3Array coordinates;
+  // how far a straight line distance over coordinates can be off from the
+  // one between the double positions, at most
+  float coordinateError = 0;
+  Graph() : singlePrecision(singlePrecisionByDefault) {}
+  /**
+   * @brief Keeps a single precision copy of the node positions for
+   * nearestNode and A* to scan, or drops it so they read the double ones.
+   * The copy is built right away from the nodes there are.
+   * @param enabled Whether the copy is kept
+   */
+  void setSinglePrecision(bool enabled);
+  bool isSinglePrecision() const { return singlePrecision; }
   void addNode(const Vector3&);
   void addEdge(int, int);
   int nearestNode(const Vector3&) const;
   std::optional<std::vector<Vector3>> getPath(const Vector3&, const Vector3&,
                                               const RoutingStrategy&) const;
+
+ private:
+  static bool singlePrecisionByDefault;
+  bool singlePrecision;
+  // Adds a node position to coordinates and widens coordinateError to match
+  void addCoordinates(const Vector3&);
 };
 }  // namespace routing
 
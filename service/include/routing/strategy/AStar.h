@@ -10,12 +10,18 @@ namespace routing {
 class AStar : public RoutingStrategy {
  protected:
   std::function<double(const GraphNode&, const GraphNode&)> heuristic;
+  // set when the heuristic is the straight line distance, which is then
+  // computed for all neighbours of a node at once from Graph::coordinates
+  // on graphs that keep them
+  bool euclidean = false;
 
  public:
-  AStar(std::function<double(const GraphNode&, const GraphNode&)> h =
-            [](const GraphNode& n1, const GraphNode& n2) {
-              return n1.getPosition().dist(n2.getPosition());
-            })
+  AStar()
+      : heuristic([](const GraphNode& n1, const GraphNode& n2) {
+          return n1.getPosition().dist(n2.getPosition());
+        }),
+        euclidean(true) {}
+  AStar(std::function<double(const GraphNode&, const GraphNode&)> h)
       : heuristic(h) {}
   std::optional<std::vector<int>> getPath(const Graph&, int, int) const;
 };
@@ -1,14 +1,21 @@
 #ifndef DATACOLLECTOR_H_
 #define DATACOLLECTOR_H_
 
+#include <atomic>
 #include <ctime>
 #include <fstream>
 #include <iomanip>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "util/Checkpoint.h"
+#include "util/Histogram.h"
+#include "util/TelemetryExporter.h"
 #include "vector3.h"
 
 class Drone;
@@ -22,6 +29,20 @@ class Drone;
  * data such as speed, mileage, delivery times, and locations for drones. It
  * ensures that only one instance of the class exists throughout the simulation
  * run.
+ *
+ * Drones record every tick, so recording takes no locks. Counters live in one
+ * slot per entity, found by ID in blocks that are never moved; a slot is only
+ * written by the thread updating its entity, so simulations and update
+ * threads can record side by side. Pickups and drop-offs are appended to a
+ * buffer of the recording thread's own and merged, in the order they
+ * happened, when the data is read. Reading (the CSV files, checkpoints) must
+ * not overlap with recording. Exporting hands the buffered events over every
+ * flush; without it at most maxKeptEvents are kept, and later ones are only
+ * counted.
+ *
+ * Alongside, histograms of simulated durations — how long packages wait in
+ * the queue, until pickup and until drop-off — and the fleet's utilization
+ * are kept up to date, so getStats() costs the same however long the run.
  */
 class DataCollector {
  public:
@@ -33,6 +54,23 @@ class DataCollector {
    */
   static DataCollector& getInstance();
 
+  /**
+   * @brief Gives the thread that creates it a collector of its own, which
+   * getInstance() returns on that thread until the scope ends. Used by forks
+   * of the simulation running on other threads, so their data neither races
+   * with nor ends up in the main simulation's.
+   */
+  class ThreadScope {
+   public:
+    ThreadScope();
+    ~ThreadScope();
+    ThreadScope(const ThreadScope&) = delete;
+    ThreadScope& operator=(const ThreadScope&) = delete;
+
+   private:
+    DataCollector* previous;
+  };
+
   /**
    * @brief Removing the copy constructor operator to prevent copying of the
    * singleton instance.
@@ -59,12 +97,56 @@ class DataCollector {
    */
   void recordDroneMileage(int droneId, double mileage);
 
+  /**
+   * @brief What the collector's histograms and fleet counters hold.
+   */
+  struct Stats {
+    Histogram::Summary queued;    // scheduled until a drone set out for it
+    Histogram::Summary pickup;    // scheduled until picked up
+    Histogram::Summary delivery;  // scheduled until dropped off
+    int drones = 0;               // drones in the simulation
+    int busy = 0;                 // drones on a delivery
+    uint64_t dispatched = 0;      // deliveries drones set out on
+    uint64_t pickups = 0;         // packages picked up
+    uint64_t deliveries = 0;      // packages dropped off
+    double utilization = 0;  // busy drone-seconds over drone-seconds so far
+    uint64_t unkeptEvents = 0;  // pickups and drop-offs past maxKeptEvents
+    uint64_t unexported = 0;    // rows the exporter dropped
+  };
+
+  /**
+   * @brief When a simulation's next fleet row is due. Every simulation keeps
+   * its own, since their clocks run apart.
+   */
+  struct FleetSchedule {
+    double next = 0;  // simulated time the next fleet row is due
+    double last = 0;  // simulated time of the last one
+  };
+
+  /**
+   * @brief Responsible for recording that a package was scheduled for
+   * delivery.
+   * @param packageId The ID of the package.
+   * @param time The simulated time, in seconds.
+   */
+  void recordScheduled(int packageId, double time);
+
+  /**
+   * @brief Responsible for retrieving when a package was scheduled for
+   * delivery, e.g. to hand it on to a fork's collector.
+   * @param packageId The ID of the package.
+   * @return The simulated time, negative if not known or delivered.
+   */
+  double getScheduledTime(int packageId) const;
+
   /**
    * @brief Responsible for marking the start of the delivery process for a
    * drone.
    * @param droneId The ID of the drone.
+   * @param packageId The ID of the package it is delivering.
+   * @param time The simulated time, in seconds.
    */
-  void startDelivery(int droneId);
+  void startDelivery(int droneId, int packageId, double time);
 
   /**
    * @brief Responsible for starting the timer in order to track the delivery
@@ -89,18 +171,24 @@ class DataCollector {
   std::time_t getDeliveryStartTime(int droneId);
 
   /**
-   * @brief Responsible for recording the pickup time for a drone.
+   * @brief Responsible for recording that a drone picked up its package.
    * @param droneId The ID of the drone.
-   * @param time The time to record the pickup process.
+   * @param time The time of the pickup.
+   * @param location Where the package was picked up.
+   * @param simTime The simulated time, in seconds.
    */
-  void recordPickupTime(int droneId, const std::time_t& time);
+  void recordPickup(int droneId, std::time_t time, const Vector3& location,
+                    double simTime);
 
   /**
-   * @brief Responsible for recording the dropoff time for a drone.
+   * @brief Responsible for recording that a drone dropped off its package.
    * @param droneId The ID of the drone.
-   * @param time The time to record the dropoff process.
+   * @param time The time of the drop-off.
+   * @param location Where the package was dropped off.
+   * @param simTime The simulated time, in seconds.
    */
-  void recordDropoffTime(int droneId, const std::time_t& time);
+  void recordDropoff(int droneId, std::time_t time, const Vector3& location,
+                     double simTime);
 
   /**
    * @brief Responsible for formatting the recorded time value in a readable
@@ -111,24 +199,16 @@ class DataCollector {
   std::string formatTime(const std::time_t& time);
 
   /**
-   * @brief Responsible for recording the pickup location for a drone.
-   * @param droneId The ID of the drone.
-   * @param location The location to be recorded.
-   */
-  void recordPickupLocation(int droneId, const Vector3& location);
-
-  /**
-   * @brief Responsible for recording the dropoff location for a drone.
+   * @brief Responsible for recording a new drone in the simulation system.
    * @param droneId The ID of the drone.
-   * @param location The location to be recorded.
    */
-  void recordDropoffLocation(int droneId, const Vector3& location);
+  void recordDrone(int droneId);
 
   /**
-   * @brief Responsible for recording a new drone in the simulation system.
-   * @param droneId The ID of the drone.
+   * @brief Responsible for recording that an entity left the simulation.
+   * @param id The ID of the entity.
    */
-  void recordDrone(int droneId);
+  void recordRemoved(int id);
 
   /**
    * @brief Responsible for recording the spawn location of a robot.
@@ -147,6 +227,55 @@ class DataCollector {
    */
   void outputMoreDataToCSV();
 
+  /**
+   * @brief Starts streaming pickups, drop-offs and fleet metrics to a file
+   * as they are flushed. Exported events are dropped from memory, so the
+   * drone CSV and checkpoints only hold those since the last flush.
+   * @param options Where and how to export
+   * @param error Receives what went wrong
+   * @return Whether the export file could be created
+   */
+  bool startExport(const TelemetryExporter::Options& options,
+                   std::string& error);
+
+  /**
+   * @brief Writes what is still waiting to be exported and closes the file.
+   */
+  void stopExport();
+
+  /**
+   * @brief Adds the tick to the fleet's utilization and, when exporting,
+   * hands everything recorded since the last flush to the exporter, along
+   * with fleet metrics when they are due. Call between ticks, when nothing
+   * is being recorded.
+   * @param time Simulated time of the tick just finished, in seconds.
+   * @param dt Simulated seconds the tick took
+   * @param fleet When the simulation's next fleet row is due, moved on when
+   * one is written
+   */
+  void flush(double time, double dt, FleetSchedule& fleet);
+
+  /**
+   * @return The histograms and fleet counters, read in time independent of
+   * the number of drones and deliveries
+   */
+  Stats getStats() const;
+
+  /**
+   * @brief Writes everything collected so far into a checkpoint.
+   * @param writer The checkpoint, with its section for the collector begun.
+   */
+  void save(CheckpointWriter& writer) const;
+
+  /**
+   * @brief Replaces everything collected with what a checkpoint holds. The
+   * histograms start over and no drone counts as in the simulation until
+   * recorded again with recordDrone().
+   * @param reader The collector's section of the checkpoint.
+   * @return false if the section is cut short.
+   */
+  bool load(CheckpointReader& reader);
+
  private:
   DataCollector();
 
@@ -154,42 +283,148 @@ class DataCollector {
 
   static DataCollector*
       instance;  // Static instance pointer for the singleton pattern
+  static thread_local DataCollector*
+      threadInstance;  // Set on threads inside a ThreadScope
+
+  /**
+   * @struct Slot
+   * @brief What has been recorded about one entity. Drones use the counters,
+   * robots the spawn location, packages the time they were scheduled.
+   */
+  struct Slot {
+    double totalSpeed = 0;
+    double totalMileage = 0;
+    double totalDistance = 0;
+    double totalTimeTaken = 0;
+    int numDeliveries = 0;
+    int completed = 0;  // deliveries dropped off
+    bool drone = false;
+    bool robot = false;
+    bool timed = false;  // whether deliveryStart was set
+    bool live = false;   // a drone in the simulation now
+    std::time_t deliveryStart = 0;
+    Vector3 spawnLocation;
+    int package = -1;         // package of the delivery under way
+    double scheduledAt = -1;  // simulated time, negative if not known
+  };
+
+  /**
+   * @struct Event
+   * @brief A pickup or drop-off
+   */
+  struct Event {
+    uint64_t sequence;  // order of the event across threads
+    int droneId;
+    bool dropoff;
+    std::time_t time;
+    double simTime;  // negative if not known
+    Vector3 location;
+  };
+
+  /**
+   * @struct EventBuffer
+   * @brief Events recorded by one thread, oldest first
+   */
+  struct EventBuffer {
+    std::thread::id thread;
+    std::vector<Event> events;
+  };
 
   /**
-   * @struct DroneData
-   * @brief A structure responsible for storing various metric data related to a
-   * single drone.
+   * @struct History
+   * @brief The pickups and drop-offs of one drone, oldest first
    */
-  struct DroneData {
-    double totalSpeed;
-    double totalMileage;
-    int numDeliveries;
-    double totalDistance;
-    double totalTimeTaken;
+  struct History {
     std::vector<std::time_t> pickupTimes;
     std::vector<std::time_t> dropoffTimes;
     std::vector<Vector3> pickupLocations;
     std::vector<Vector3> dropoffLocations;
   };
 
+  // Pickups and drop-offs held for the CSV and checkpoints at most, some
+  // 56 MiB of them
+  static constexpr size_t maxKeptEvents = 1 << 20;
+
+  static constexpr int blockBits = 10;
+  static constexpr unsigned blockSize = 1u << blockBits;  // slots per block
+  static constexpr unsigned maxBlocks = 1u << 14;  // IDs past these are dropped
+
   /**
-   * @struct RobotData
-   * @brief  A structure responsible for storing various metric data related to
-   * a single robot.
+   * @brief Finds the slot of an entity, adding its block if it has none.
+   * @param id The ID of the entity.
+   * @return The slot.
    */
-  struct RobotData {
-    Vector3 spawnLocation;
-  };
+  Slot& slot(int id);
+
+  /**
+   * @return The slot of an entity, or nullptr if its block was never added.
+   */
+  const Slot* findSlot(int id) const;
+
+  /**
+   * @return When the package a drone is delivering was scheduled, or a
+   * negative time if not known.
+   */
+  double scheduledAt(const Slot& drone) const;
+
+  /**
+   * @return The calling thread's event buffer, added on its first event.
+   */
+  EventBuffer& localBuffer();
+
+  /**
+   * @brief Adds an event to the calling thread's buffer, or only counts it
+   * once maxKeptEvents are buffered.
+   */
+  void keepEvent(const Event& event);
+
+  /**
+   * @return Every drone's pickups and drop-offs, merged from all buffers.
+   */
+  std::map<int, History> histories() const;
+
+  /**
+   * @brief Forgets everything recorded.
+   */
+  void clear();
 
-  std::map<int, DroneData>
-      droneDataMap;  // Used for mapping the drone ID to its data value
+  /**
+   * @return The state of the fleet, for the exporter
+   */
+  TelemetryExporter::FleetRow fleetRow(double time) const;
+
+  std::unique_ptr<std::atomic<Slot*>[]> blocks;  // blockSize slots each
+  Slot discarded;  // recorded into for IDs out of range
+
+  mutable std::mutex buffersMutex;  // only taken to add a thread's buffer
+  std::vector<std::unique_ptr<EventBuffer>> buffers;
+  std::atomic<uint64_t> nextEvent{0};
+  std::atomic<size_t> keptEvents{0};  // in all buffers together
+  std::atomic<uint64_t> unkeptEvents{0};
+
+  // Tells collectors apart in the per-thread cache of buffers, even one
+  // allocated where a destroyed one used to be
+  const uint64_t serial;
+  static std::atomic<uint64_t> nextSerial;
+  struct BufferCache {
+    uint64_t collector = 0;
+    EventBuffer* buffer = nullptr;
+  };
+  static thread_local BufferCache bufferCache;
 
-  std::map<int, std::time_t>
-      deliveryStartTimes;  // Used for mapping the drone ID to the start time of
-                           // its respective deliveries.
+  std::unique_ptr<TelemetryExporter> exporter;  // set while exporting
+  std::vector<TelemetryExporter::EventRow> exportRows;  // reused every flush
 
-  std::map<int, RobotData>
-      robotDataMap;  // Used for mapping the robot ID to its data value
+  Histogram queued;    // simulated seconds from scheduling to setting out
+  Histogram pickup;    // from scheduling to pickup
+  Histogram delivery;  // from scheduling to drop-off
+  std::atomic<int> liveDrones{0};  // drones with live set
+  std::atomic<int> busyDrones{0};  // of those, the ones on a delivery
+  std::atomic<uint64_t> dispatches{0};
+  std::atomic<uint64_t> pickups{0};
+  std::atomic<uint64_t> dropoffs{0};
+  double droneSeconds = 0;  // live drones integrated over simulated time
+  double busySeconds = 0;   // busy drones likewise
 
   /**
    * @brief Responsible for writing a line into a CSV file.
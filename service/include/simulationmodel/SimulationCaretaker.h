@@ -2,19 +2,34 @@
 #ifndef SIMULATION_CARETAKER_H_
 #define SIMULATION_CARETAKER_H_
 
-#include <stack>
+#include <deque>
 
 #include "SimulationMemento.h"
 
 /**
  * @brief The SimulationCaretaker class manages the mementos of a simulation.
+ *
+ * The mementos together are kept under a memory limit. Once a new memento
+ * goes over it, the oldest ones are dropped; the newest is always kept.
  */
 class SimulationCaretaker {
  private:
   /**
-   * @brief Stack to store the mementos.
+   * @brief Saved mementos, the newest at the back.
    */
-  std::stack<SimulationMemento*> mementos;
+  std::deque<SimulationMemento*> mementos;
+
+  /**
+   * @brief Memory held by the saved mementos, in bytes.
+   */
+  size_t memoryUsed = 0;
+
+  /**
+   * @brief Limit on memoryUsed, in bytes.
+   */
+  size_t memoryLimit = defaultMemoryLimit;
+
+  static size_t defaultMemoryLimit;
 
  public:
   /**
@@ -34,10 +49,37 @@ class SimulationCaretaker {
    */
   void clear();
 
+  /**
+   * @brief Sets how much memory saved states may use, dropping the oldest
+   * ones if they already use more.
+   * @param bytes The limit in bytes.
+   */
+  void setMemoryLimit(size_t bytes);
+
+  /**
+   * @brief Sets the memory limit caretakers are created with.
+   * @param bytes The limit in bytes.
+   */
+  static void setDefaultMemoryLimit(size_t bytes) {
+    defaultMemoryLimit = bytes;
+  }
+
+  /**
+   * @brief Gets the memory held by saved states.
+   * @return Size in bytes.
+   */
+  size_t getMemoryUsed() const { return memoryUsed; }
+
   /**
    * @brief Destructor to free memory.
    */
   ~SimulationCaretaker();
+
+ private:
+  /**
+   * @brief Drops the oldest mementos until the rest fit the limit.
+   */
+  void trim();
 };
 
 #endif  // SIMULATION_CARETAKER_H_
@@ -0,0 +1,107 @@
+#ifndef SIMULATION_FORK_H_
+#define SIMULATION_FORK_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "IController.h"
+#include "SimulationModel.h"
+#include "util/Histogram.h"
+
+/**
+ * @brief Runs a fork of a simulation for a number of simulated seconds on a
+ * thread of its own, e.g. to see how the deliveries would go with another
+ * strategy. The fork acts as its own controller, so nothing is sent to any
+ * view, and records into a DataCollector of its own, which its metrics are
+ * read from.
+ *
+ * Change the forked model through getModel() before start(); once started,
+ * the model belongs to the fork's thread until join() returns.
+ */
+class SimulationFork : public IController {
+ public:
+  /**
+   * @brief What happened in the fork while it ran
+   */
+  struct Metrics {
+    int ticks = 0;
+    double simulatedTime = 0;  // seconds
+    double wallTime = 0;       // seconds the run took
+    int dispatched = 0;        // deliveries drones set out on
+    int pickups = 0;           // packages picked up
+    int deliveries = 0;        // packages dropped off
+    // simulated seconds from scheduling to dropping off, of the deliveries
+    // drones set out on in the fork
+    Histogram::Summary latency;
+    int pending = 0;  // deliveries still waiting for a drone at the end
+  };
+
+  /**
+   * @brief Simulated seconds per tick unless start() is given another step
+   */
+  static constexpr double defaultStep = 1.0 / 60;
+
+  /**
+   * @brief Forks a simulation
+   * @param model The simulation, which is not changed
+   */
+  explicit SimulationFork(const SimulationModel& model);
+
+  /**
+   * @brief Waits for the fork to finish, if it was started
+   */
+  ~SimulationFork();
+
+  SimulationFork(const SimulationFork&) = delete;
+  SimulationFork& operator=(const SimulationFork&) = delete;
+
+  /**
+   * @return The forked model, to change before start()
+   */
+  SimulationModel& getModel() { return *model; }
+
+  /**
+   * @brief Starts running the fork on a new thread
+   * @param seconds Simulated seconds to run for
+   * @param step Simulated seconds per tick
+   * @param finished Called on the fork's thread once it is done, e.g. to
+   * hand the metrics over; join() still has to be called
+   */
+  void start(double seconds, double step = defaultStep,
+             std::function<void()> finished = nullptr);
+
+  /**
+   * @brief Makes a running fork stop after its current tick
+   */
+  void cancel() { cancelled = true; }
+
+  /**
+   * @brief Waits for the fork to finish
+   * @return What happened in it
+   */
+  const Metrics& join();
+
+  void addEntity(const IEntity& entity) {}
+
+  void updateEntity(const IEntity& entity) {}
+
+  void removeEntity(const IEntity& entity) {}
+
+  void sendEventToView(const std::string& event, const JsonObject& details) {}
+
+ private:
+  Metrics metrics;
+  // when the deliveries waiting at the fork were scheduled, by package ID,
+  // for the fork's collector
+  std::vector<std::pair<int, double>> scheduled;
+  std::unique_ptr<SimulationModel> model;
+  std::thread thread;
+  std::atomic<bool> cancelled = false;
+};
+
+#endif  // SIMULATION_FORK_H_
@@ -1,50 +1,39 @@
 #ifndef SIMULATION_MEMENTO_H_
 #define SIMULATION_MEMENTO_H_
 
-#include <vector>
-
-#include "IEntity.h"
+#include "util/Snapshot.h"
 
 /**
  * @brief A class representing a memento for simulation state.
  *
- * This class holds a collection of JSON objects representing the state of
- * entities in the simulation.
+ * This class holds a binary snapshot with one record per entity in the
+ * simulation.
  */
 class SimulationMemento {
  private:
-  std::vector<const JsonObject*> objects;
+  Snapshot snapshot;
 
  public:
   /**
    * @brief Constructs a SimulationMemento object.
    *
-   * Constructs a SimulationMemento object with the given vector of JSON
-   * objects.
-   *
-   * @param obj A vector containing pointers to JSON objects representing the
-   * state of entities.
+   * @param snapshot The state of the entities, taken over by the memento.
    */
-  SimulationMemento(std::vector<const JsonObject*>& obj);
+  SimulationMemento(Snapshot&& snapshot);
 
   /**
-   * @brief Destroys the SimulationMemento object.
+   * @brief Gets the saved state.
    *
-   * Destroys the SimulationMemento object and releases any resources associated
-   * with it.
+   * @return The snapshot of the entities in the simulation.
    */
-  ~SimulationMemento();
+  const Snapshot& getSnapshot() const { return snapshot; }
 
   /**
-   * @brief Gets the collection of JSON objects.
-   *
-   * Returns the collection of JSON objects representing the state of entities
-   * in the simulation.
+   * @brief Gets the memory held by the memento.
    *
-   * @return A constant reference to a vector containing pointers to JSON
-   * objects representing the state of entities.
+   * @return Size of the memento in bytes.
    */
-  const std::vector<const JsonObject*>& getObjects() const { return objects; }
+  size_t memoryUsage() const { return snapshot.memoryUsage(); }
 };
 
 #endif  // SIMULATION_MEMENTO_H_
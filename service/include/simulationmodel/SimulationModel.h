@@ -3,9 +3,12 @@
 
 #include <deque>
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <set>
 
 #include "CompositeFactory.h"
+#include "DataCollector.h"
 #include "Drone.h"
 #include "Graph.h"
 #include "IController.h"
@@ -14,6 +17,7 @@
 #include "Robot.h"
 #include "SimulationCaretaker.h"
 #include "SimulationMemento.h"
+#include "SimulationTimeline.h"
 
 //--------------------  Model ----------------------------
 
@@ -38,8 +42,10 @@ class SimulationModel : public IObserver {
   /**
    * @brief Set the Graph for the SimulationModel
    * @param graph Type Graph* contain the new graph for SimulationModel
+   * @param source The file the graph was loaded from, so a checkpoint can
+   * load it again
    **/
-  void setGraph(const routing::Graph* graph);
+  void setGraph(const routing::Graph* graph, const std::string& source = "");
 
   /**
    * @brief Creates a new simulation entity
@@ -81,6 +87,14 @@ class SimulationModel : public IObserver {
    */
   const routing::Graph* getGraph() const;
 
+  /**
+   * @brief Returns the memory entities and their paths are allocated from.
+   * It belongs to this simulation alone, so it needs no locking.
+   *
+   * @returns The simulation's memory resource
+   */
+  std::pmr::memory_resource* getMemoryResource() { return &arena; }
+
   /**
    * @brief Notifies about a message.
    *
@@ -94,18 +108,36 @@ class SimulationModel : public IObserver {
   /**
    * @brief Gets the entities.
    *
-   * This method returns a map containing integer keys and pointers to IEntity
-   * objects as values.
+   * This method returns the model's map from IDs to entities, without
+   * copying it.
    *
    * @return A map containing integer keys and pointers to IEntity objects as
    * values.
    */
-  std::map<int, IEntity*> getEntities();
+  const std::map<int, IEntity*>& getEntities() const;
+
+  /**
+   * @return How many entities there are of each type, kept up to date as
+   * they are created and removed
+   */
+  const std::map<std::string, int>& getEntityCounts() const {
+    return entityCounts;
+  }
+
+  /**
+   * @brief Gets an entity by its ID.
+   *
+   * @param id ID of the entity.
+   * @return The entity, or nullptr if there is none with that ID.
+   */
+  IEntity* getEntity(int id) const;
 
   /**
    * @brief Saves the simulation state.
    *
-   * This method saves the current state of the simulation.
+   * This method saves the current state of the simulation as a binary
+   * snapshot. The oldest saves are dropped once they take up more memory
+   * than the caretaker allows.
    */
   void saveSimulationState();
 
@@ -113,14 +145,83 @@ class SimulationModel : public IObserver {
    * @brief Restores the simulation state.
    *
    * This method restores the simulation state to a previously saved state.
+   * Every entity's own state is loaded first, then references between
+   * entities are resolved in one pass; trips resume on their saved paths.
    */
   void restoreSimulationState();
 
+  /**
+   * @brief Writes the whole simulation to a checkpoint file: every entity
+   * and what it was created from, trips and the paths they are on,
+   * scheduled deliveries, the data collected so far and the graph file.
+   *
+   * @param path The file, replaced once the new checkpoint is complete
+   * @param error Receives what went wrong
+   * @return Whether the checkpoint was written
+   */
+  bool saveCheckpoint(const std::string& path, std::string& error) const;
+
+  /**
+   * @brief Replaces the simulation with the one in a checkpoint file. The
+   * file is checked in full before anything is changed, so a simulation is
+   * left as it was if the file can't be used.
+   *
+   * @param path The file
+   * @param error Receives what is wrong with the file
+   * @return Whether the checkpoint was loaded
+   */
+  bool loadCheckpoint(const std::string& path, std::string& error);
+
+  /**
+   * @brief Makes a copy of the simulation that runs on independently, e.g.
+   * to try out a change for a few simulated seconds on another thread.
+   *
+   * Entity templates and the graph are immutable and shared with the fork,
+   * and so is the list of trips until either side schedules another. Each
+   * entity is copied into the fork's own memory along with the path it is
+   * on, so neither simulation ever sees the other's changes. The fork records
+   * no timeline, and its controller is not told about the entities it
+   * starts with.
+   *
+   * @param controller Receives the fork's updates and events
+   * @return The fork
+   */
+  std::unique_ptr<SimulationModel> fork(IController& controller) const;
+
+  /**
+   * @brief Records the state of every entity as the next tick of the
+   * timeline, if the timeline is enabled.
+   */
+  void recordTick();
+
+  /**
+   * @brief Sets the simulation back, or forward, to a recorded tick.
+   *
+   * Entities created since the tick are removed and entities removed since
+   * then are created again. The ticks after it can still be sought until the
+   * next tick is recorded, which carries on from the sought one instead.
+   *
+   * @param tick The tick
+   * @param error Receives what went wrong
+   * @return false if the tick has not been recorded or can't be read back
+   */
+  bool seekSimulation(uint64_t tick, std::string& error);
+
+  /**
+   * @return The timeline of recorded ticks
+   */
+  const SimulationTimeline& getTimeline() const { return timeline; }
+
+  /**
+   * @return Simulated seconds since the simulation started
+   */
+  double getTime() const { return time; }
+
   /**
    * @brief Resets the simulation.
    *
    * This method resets the simulation by clearing scheduled deliveries and
-   * removing all entities.
+   * removing all entities. The memory they used is then released in one go.
    */
   void resetSimulation();
 
@@ -139,13 +240,40 @@ class SimulationModel : public IObserver {
    * @param id ID of the entity to be removed
    */
   void removeFromSim(int id);
+
+  /**
+   * @brief Gets what an entity would be created from to look as it did
+   * when it was first created
+   * @param entity The entity
+   * @return Its template, name, position and direction, and its colors if
+   * it is a package
+   */
+  JsonObject creationDetails(const IEntity& entity) const;
+
+  /**
+   * @brief Loads every entity in a snapshot, removing those not in it
+   * @param snapshot The snapshot
+   * @param recreate Whether entities in the snapshot that no longer exist
+   * are created again
+   */
+  void restoreSnapshot(const Snapshot& snapshot, bool recreate);
   IController& controller;
+  // Entities, their paths and anything else that lives as long as them
+  std::pmr::unsynchronized_pool_resource arena;
   std::map<int, IEntity*> entities;
-  std::vector<const JsonObject*> trips;
+  std::map<std::string, int> entityCounts;  // by "type" of the details
+  // every trip scheduled, shared copy-on-write with forks
+  std::shared_ptr<std::vector<JsonObject>> trips =
+      std::make_shared<std::vector<JsonObject>>();
   std::set<int> removed;
-  const routing::Graph* graph = nullptr;
+  std::shared_ptr<const routing::Graph> graph;  // shared with forks
+  std::string graphSource;  // file the graph was loaded from, if known
   CompositeFactory entityFactory;
   SimulationCaretaker caretaker;
+  SimulationTimeline timeline;
+  Snapshot sought;  // reused by every seek
+  double time = 0;
+  DataCollector::FleetSchedule fleetSchedule;  // of rows exported
 };
 
 #endif  // SIMULATION_MODEL_H_
@@ -0,0 +1,215 @@
+#ifndef SIMULATION_TIMELINE_H_
+#define SIMULATION_TIMELINE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "util/Snapshot.h"
+#include "util/json.h"
+
+/**
+ * @brief Records the state of a simulation every tick so any recorded tick
+ * can be brought back later.
+ *
+ * Ticks are grouped into chunks of keyframeInterval ticks. A chunk starts
+ * with a keyframe, the full state of every entity, followed by one delta per
+ * tick holding only the bytes of entity records that changed since the tick
+ * before. A finished chunk is compressed with zlib and kept in memory; once
+ * the chunks in memory take up more than the memory limit, the oldest are
+ * appended to a spill file and read back from there when needed. The file
+ * is unlinked as soon as it is opened, so nothing is left behind. A chunk
+ * that can't be compressed, or read back, e.g. from a damaged spill file, is
+ * dropped along with its ticks. With a limit on the ticks kept, chunks that fall wholly
+ * behind it are dropped, and their space in the spill file is given back.
+ * Chunks are compressed, dropped and spilled on a thread of the timeline's
+ * own, so recording a tick neither allocates for them nor waits on the disk.
+ *
+ * The timeline also keeps what every removed entity was created from, so an
+ * entity that has been removed since a tick can be created again. Entities
+ * removed before the oldest tick kept are forgotten.
+ */
+class SimulationTimeline {
+ public:
+  /**
+   * @brief Settings shared by every timeline
+   */
+  struct Options {
+    bool enabled = true;
+    int keyframeInterval = 300;    // ticks per chunk
+    size_t memoryLimit = 64 << 20;  // bytes of compressed chunks in memory
+    uint64_t maxTicks = 0;          // ticks kept at least, 0 for all
+    size_t chunkReserve = 8 << 20;  // bytes reserved for an open chunk
+    std::string spillDirectory;     // empty for the system's temp directory
+  };
+
+  /**
+   * @brief Sets the options timelines are created with
+   * @param options The options
+   */
+  static void setDefaultOptions(const Options& options) {
+    defaultOptions = options;
+  }
+
+  SimulationTimeline() : options(defaultOptions) {}
+  ~SimulationTimeline();
+  SimulationTimeline(const SimulationTimeline&) = delete;
+  SimulationTimeline& operator=(const SimulationTimeline&) = delete;
+
+  /**
+   * @return Whether ticks are recorded at all
+   */
+  bool isEnabled() const { return options.enabled; }
+
+  /**
+   * @brief Turns recording on or off for this timeline alone
+   * @param enabled Whether ticks are recorded
+   */
+  void setEnabled(bool enabled) { options.enabled = enabled; }
+
+  /**
+   * @brief Remembers what a removed entity can be created again from.
+   * Entities that are still there don't need it, which keeps creating many
+   * entities at once cheap.
+   * @param id ID of the entity
+   * @param details The details to create it from
+   */
+  void entityRemoved(int id, const JsonObject& details);
+
+  /**
+   * @brief Gets what a removed entity can be created again from
+   * @param id ID of the entity
+   * @return The details, or nullptr if the entity is unknown
+   */
+  const JsonObject* getCreationDetails(int id) const;
+
+  /**
+   * @brief Gives access to the snapshot the next tick is written into. Fill
+   * it, then call recordTick(). If a tick was sought since the last
+   * recording, everything after it is dropped first, so the recording
+   * carries on from there.
+   * @return The writer for the next tick
+   */
+  SnapshotWriter& beginTick();
+
+  /**
+   * @brief Records the snapshot written since beginTick() as the next tick.
+   * @param time Simulated time of the tick, in seconds
+   */
+  void recordTick(double time);
+
+  /**
+   * @brief Rebuilds the state of a recorded tick
+   * @param tick The tick
+   * @param out Receives the state of every entity at that tick
+   * @param time Receives the simulated time of the tick
+   * @param error Receives what went wrong
+   * @return false if the tick has not been recorded or can't be read back
+   */
+  bool reconstruct(uint64_t tick, Snapshot& out, double& time,
+                   std::string& error);
+
+  /**
+   * @brief Marks a tick as the one the simulation was set back to. The
+   * ticks after it stay available until the next tick is recorded.
+   * @param tick The tick
+   */
+  void seek(uint64_t tick) { soughtTick = tick; }
+
+  /**
+   * @return The number of ticks recorded so far, i.e. one past the last one
+   */
+  uint64_t getEndTick() const { return endTick; }
+
+  /**
+   * @brief Forgets every tick and entity, e.g. when the simulation is reset
+   */
+  void clear();
+
+ private:
+  /**
+   * @brief keyframeInterval ticks, starting at a keyframe
+   */
+  struct Chunk {
+    uint64_t firstTick = 0;
+    std::vector<uint32_t> tickEnds;  // end of every tick in the raw bytes
+    std::vector<char> compressed;    // empty once spilled
+    uint64_t fileOffset = 0;         // where it was spilled to
+    uint32_t compressedSize = 0;
+    uint32_t rawSize = 0;
+    bool spilled = false;
+  };
+
+  // Writes the current snapshot into the open chunk as a keyframe or delta
+  void writeKeyframe(double time);
+  void writeDelta(double time);
+  // Hands the open chunk to the sealer and starts a new one
+  void sealChunk();
+  // Runs on the sealer thread, sealing every chunk handed to it
+  void sealLoop();
+  // Compresses the chunk handed to the sealer and stores it
+  void seal();
+  // Waits until the sealer is done with the chunk handed to it, after which
+  // the finished chunks can be used
+  void waitForSealer();
+  // Spills the oldest chunks in memory until the rest fit the limit
+  void spill();
+  // Gets the uncompressed bytes of a chunk, false if they can't be read
+  bool readChunk(const Chunk& chunk, std::vector<char>& raw,
+                 std::string& error);
+  // Drops every tick after the given one
+  void truncate(uint64_t tick);
+  // Drops the chunks older than the last maxTicks ticks before end
+  void dropOldChunks(uint64_t end);
+  // Forgets the entities removed before the oldest chunk left
+  void forgetRemoved();
+
+  static Options defaultOptions;
+  Options options;
+
+  // state of every entity this tick and the one before, sharing one string
+  // table that every keyframe holds in full
+  Snapshot current;
+  Snapshot previous;
+  SnapshotWriter writer{current};
+  size_t previousStrings = 0;  // strings already written to the chunk
+  size_t builtStrings = 0;     // strings when the table was last built up
+  bool rebuildingStrings = false;
+
+  std::vector<Chunk> chunks;  // finished chunks
+  std::vector<char> open;     // the chunk being recorded, uncompressed
+  std::vector<uint32_t> openTickEnds;
+  uint64_t openFirstTick = 0;
+
+  // While a chunk is handed over, only the sealer touches the finished
+  // chunks, memoryUsed, the spill file and the limits in options
+  std::thread sealer;
+  std::mutex sealerMutex;
+  std::condition_variable sealerChanged;
+  bool handedOver = false;
+  bool stopping = false;
+  std::vector<char> sealing;  // the chunk handed over, swapped with open
+  std::vector<uint32_t> sealingTickEnds;
+  uint64_t sealingFirstTick = 0;
+
+  uint64_t endTick = 0;
+  std::optional<uint64_t> soughtTick;
+  size_t memoryUsed = 0;  // compressed chunks held in memory
+
+  int spillFile = -1;
+  uint64_t spillSize = 0;  // bytes of the file in use
+
+  struct Removal {
+    JsonObject details;
+    uint64_t tick;  // first tick without the entity
+  };
+  std::unordered_map<int, Removal> removed;
+  uint64_t forgottenBefore = 0;  // oldest tick when removals were last pruned
+};
+
+#endif  // SIMULATION_TIMELINE_H_
@@ -0,0 +1,293 @@
+#ifndef TRANSIT_SIMULATION_H_
+#define TRANSIT_SIMULATION_H_
+
+#include <chrono>  // NOLINT [build/c++11]
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "IController.h"
+#include "SimulationModel.h"
+#include "WebServer.h"
+#include "util/AllocationStats.h"
+#include "util/Histogram.h"
+#include "util/JsonWriter.h"
+#include "util/SpatialGrid.h"
+
+/**
+ * @brief Hosts one SimulationModel and streams it to every subscribed web
+ * session. It acts as the model's controller: each event is serialized once
+ * and the same buffer is queued on all subscribers.
+ *
+ * Sessions are either controllers, which may change the simulation, or
+ * viewers, which only watch it. With no control token every session that
+ * subscribes while nobody is in control becomes a controller.
+ *
+ * A session may limit itself to a region of the map. It then only hears about
+ * entities inside the region, and gets AddEntity / RemoveEntity as they come
+ * and go. Regions are matched against a spatial grid rebuilt once per frame.
+ *
+ * Entities are sent with their velocity and the server time, and clients
+ * extrapolate their positions in between. For every view the simulation keeps
+ * what it last sent, and only sends a correction when the extrapolated
+ * position drifts too far, the entity turns or changes color, or nothing was
+ * sent for a while.
+ */
+class TransitSimulation : public IController {
+ public:
+  /**
+   * @brief Creates a simulation
+   * @param controlToken Sessions must connect with ?control=<token> to be
+   * allowed to change the simulation. If empty, control goes to the oldest
+   * connected session.
+   */
+  TransitSimulation(const std::string& controlToken = "");
+
+  /**
+   * @brief Destructor
+   */
+  ~TransitSimulation();
+
+  /**
+   * @brief Starts streaming the simulation to a session. The session is sent
+   * every entity that already exists.
+   * @param session The session to add
+   * @param control Whether the session may change the simulation
+   */
+  void subscribe(WebServerBase::Session* session, bool control);
+
+  /**
+   * @brief Stops streaming to a session
+   * @param session The session to remove
+   */
+  void unsubscribe(WebServerBase::Session* session);
+
+  /**
+   * @brief Limits what a session is sent to a rectangle on the ground plane.
+   * Without "min" and "max" the session goes back to the whole world.
+   * @param session The session
+   * @param region JSON with "min": [x, z], "max": [x, z] and optionally
+   * "margin", the distance around the rectangle that still counts as inside
+   */
+  void setViewport(WebServerBase::Session* session, const JsonObject& region);
+
+  /**
+   * @return Whether the session may send commands that change the simulation
+   */
+  bool canControl(const WebServerBase::Session* session) const;
+
+  /**
+   * @return The token sessions present to gain control, may be empty
+   */
+  const std::string& getControlToken() const { return controlToken; }
+
+  /**
+   * @return The number of subscribed sessions
+   */
+  int getSubscriberCount() const { return subscribers.size(); }
+
+  /**
+   * @return The hosted model
+   */
+  SimulationModel& getModel() { return model; }
+
+  /**
+   * @brief Advances the model by the wall clock time since the last update
+   * and sends the entities that changed.
+   * @param simSpeed Multiplier applied to the elapsed time
+   */
+  void update(double simSpeed);
+
+  /**
+   * @brief Hands updates over to a server timer. Update commands then only
+   * set the speed the timer runs the simulation at.
+   * @param ticking Whether a timer calls update()
+   */
+  void setTicking(bool ticking) { this->ticking = ticking; }
+
+  /**
+   * @return Whether a server timer calls update()
+   */
+  bool isTicking() const { return ticking; }
+
+  /**
+   * @brief Sets the speed a ticking simulation runs at
+   * @param simSpeed Multiplier applied to the elapsed time
+   */
+  void setSimSpeed(double simSpeed) { this->simSpeed = simSpeed; }
+
+  /**
+   * @return The speed a ticking simulation runs at
+   */
+  double getSimSpeed() const { return simSpeed; }
+
+  /**
+   * @return Ticks that should not have allocated: those after settleTicks
+   * quiet ones. Only counted in profiling builds.
+   */
+  int getSteadyTicks() const { return steadyTicks; }
+
+  /**
+   * @return What the steady ticks allocated all together
+   */
+  const AllocationStats::Counts& getSteadyAllocations() const {
+    return steadyAllocations;
+  }
+
+  /**
+   * @return Message buffers kept for reuse, at most maxEnvelopes
+   */
+  size_t getBufferCount() const { return envelopes.size(); }
+
+  void addEntity(const IEntity& entity);
+
+  void updateEntity(const IEntity& entity);
+
+  void removeEntity(const IEntity& entity);
+
+  /// Allows messages to be passed back to every view
+  void sendEventToView(const std::string& event, const JsonObject& details);
+
+  /**
+   * @return Every simulation that exists, oldest first
+   */
+  static const std::vector<TransitSimulation*>& getInstances() {
+    return instances;
+  }
+
+  /**
+   * @return The wall time update() took, over every simulation
+   */
+  static const Histogram& getTickDurations() { return tickDurations; }
+
+ private:
+  static std::vector<TransitSimulation*> instances;
+  static Histogram tickDurations;  // counted in microseconds
+  // Where an entity is and how fast it moves, per wall clock second
+  struct Motion {
+    Vector3 pos;
+    Vector3 vel;
+  };
+
+  // What a view was last sent about an entity
+  struct Reckoning {
+    Vector3 pos;
+    Vector3 vel;
+    Vector3 dir;
+    std::string color;
+    double time;
+  };
+
+  struct Subscriber {
+    WebServerBase::Session* session;
+    bool control;
+    bool limited = false;  // only entities inside the region are sent
+    double minX = 0, minZ = 0, maxX = 0, maxZ = 0;  // region, margin included
+    std::vector<int> visible;  // entities a limited view has been sent, sorted
+    std::unordered_map<int, Reckoning> reckoned;  // last sent, by entity id
+    std::unordered_set<int> knownDetails;  // templates the view has been sent
+  };
+
+  // Sends a limited view what changed inside its region this frame
+  void updateInterest(Subscriber& s);
+  // Sends the update frame if the view's extrapolation is off
+  void sendCorrection(Subscriber& s, int id);
+  // Sends AddEntity, with the entity's details unless the view already has
+  // its template
+  void introduce(Subscriber& s, const IEntity& entity);
+  // Records that the view was just sent the entity's current state
+  void remember(Subscriber& s, const IEntity& entity);
+  // Update frame for an entity, serialized the first time a view needs it
+  const std::shared_ptr<const std::string>& updateFrame(int id);
+  // The entity updated this frame, or nullptr
+  const IEntity* updated(int id) const {
+    return id < updateEntites.size() ? updateEntites[id] : nullptr;
+  }
+  // A message holding text, in a buffer no session is still sending
+  std::shared_ptr<const std::string> envelope(const std::string& text);
+  // Grows the ring of message buffers ahead of the entities sending them
+  void reserveEnvelopes();
+  // Reports the tick's allocations if it should not have made any
+  void checkAllocations();
+  Subscriber* findSubscriber(const WebServerBase::Session* session);
+
+  // Serializes an event once so it can be queued on many sessions
+  static std::shared_ptr<const std::string> serializeEvent(
+      const std::string& event, const JsonObject& details);
+  // AddEntity / UpdateEntity and RemoveEntity events, written without
+  // building a JsonObject first. Details are sent at most once per template
+  // and view, messages otherwise refer to them by detailsId.
+  std::shared_ptr<const std::string> addEvent(const IEntity& entity,
+                                              bool withDetails);
+  std::shared_ptr<const std::string> updateEvent(const IEntity& entity);
+  void writeState(const IEntity& entity);
+  std::shared_ptr<const std::string> removeEvent(int id);
+  void broadcast(const std::shared_ptr<const std::string>& msg);
+  void sendEvent(WebServerBase::Session* session, const std::string& event,
+                 const JsonObject& details);
+
+  std::vector<Subscriber> subscribers;
+  std::string controlToken;
+  // Simulation Model
+  SimulationModel model;
+  // Used for tracking time since last update
+  std::chrono::time_point<std::chrono::system_clock> start;
+  // The total time the server has been running.
+  double time = 0.0;
+  // Set when a server timer drives the simulation, which then runs at simSpeed
+  bool ticking = false;
+  double simSpeed = 1.0;
+  // Entities updated this frame, by id, and their ids in update order. The
+  // storage is kept from frame to frame.
+  std::vector<const IEntity*> updateEntites;
+  std::vector<int> updatedIds;
+  // Position and velocity of every entity as of the last frame
+  std::unordered_map<int, Motion> motion;
+  // Entity positions of the current frame, for region queries
+  SpatialGrid grid;
+  // Update frames serialized during this frame's fan-out, by entity id
+  std::vector<std::shared_ptr<const std::string>> frames;
+  // Message buffers, reused once every session has sent them, in the order
+  // they were handed out from nextEnvelope on
+  std::vector<std::shared_ptr<std::string>> envelopes;
+  size_t nextEnvelope = 0;
+  // Buffers kept at most, however far behind sessions are
+  static constexpr size_t maxEnvelopes = 4096;
+  // Buffers looked at for a free one before another is made
+  static constexpr size_t envelopeTries = 8;
+  // Bytes every buffer is made with, enough for any update or removal
+  static constexpr size_t envelopeReserve = 512;
+  // Scratch list for region queries
+  std::vector<int> inRegion;
+  // Buffer outbound entity events are written into
+  JsonWriter writer;
+  // Heap allocations of the current tick, by phase. Only counted in
+  // profiling builds.
+  struct TickAllocations {
+    AllocationStats::Counts entities;  // SimulationModel::update
+    AllocationStats::Counts motion;    // velocities
+    AllocationStats::Counts views;     // interest, corrections and sending
+    AllocationStats::Counts timeline;  // SimulationModel::recordTick
+  } tickAllocations;
+  // Set by anything that may allocate: entities or views coming and going,
+  // trips starting, notifications
+  bool eventful = false;
+  // Ticks since the last eventful one
+  int quietTicks = 0;
+  // Steady ticks so far and what they allocated
+  int steadyTicks = 0;
+  AllocationStats::Counts steadyAllocations;
+  // Quiet ticks before a tick counts as steady, giving buffers time to grow
+  static constexpr int settleTicks = 10;
+  // Default distance around a region that still counts as inside
+  static constexpr double defaultMargin = 100;
+  // Extrapolation error, in simulation units, that triggers a correction
+  static constexpr double correctionThreshold = 2;
+  // Longest time, in seconds, a moving view goes without a correction
+  static constexpr double maxSilence = 1;
+};
+
+#endif  // TRANSIT_SIMULATION_H_
@@ -5,16 +5,49 @@ Copyright (c) 2019 Dan Orban
 #ifndef WEBSERVER_H_
 #define WEBSERVER_H_
 
+#include <functional>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "libwebsockets.h"
 #include "libwebsockets/lws-service.h"
 
+class MessageDeflater;
+struct WebServerSessionState;
+
 class WebServerBase {
+  friend struct WebServerSessionState;
+
  public:
+  /**
+   * @brief Settings for compressing outbound websocket frames. A session only
+   * gets compressed frames if its client asked for them when connecting.
+   */
+  struct DeflateOptions {
+    bool enabled = true;     // whether clients may negotiate compression
+    size_t threshold = 256;  // frames shorter than this are sent as is
+    int level = 1;           // zlib compression level (1 = fastest)
+  };
+
+  /**
+   * @brief Per session counters used to weigh compression cost against the
+   * bytes it saves.
+   */
+  struct TransferStats {
+    size_t messages = 0;        // frames written
+    size_t compressed = 0;      // frames that went out deflated
+    size_t rawBytes = 0;        // payload bytes before compression
+    size_t wireBytes = 0;       // payload bytes actually written
+    double deflateSeconds = 0;  // CPU time spent in deflate
+  };
+
   WebServerBase(int port = 8081, const std::string& webDir = ".");
+  WebServerBase(int port, const std::string& webDir,
+                const DeflateOptions& deflate);
   virtual ~WebServerBase();
 
   class Session {
@@ -26,26 +59,142 @@ class WebServerBase {
     virtual int getId() const { return id; }
     virtual void receiveMessage(const std::string& msg) {}
     virtual void sendMessage(const std::string& msg);
+    /**
+     * @brief Queues a message that may also be queued on other sessions. The
+     * buffer is never copied, so serialize once and hand it to every session.
+     */
+    virtual void sendMessage(const std::shared_ptr<const std::string>& msg);
     virtual void update() {}
     virtual void onWrite();
+    /**
+     * @brief Called once the connection is established and connect arguments
+     * are available.
+     */
+    virtual void onConnect() {}
+    bool isCompressed() const;
+    const TransferStats& getTransferStats() const;
+    /**
+     * @brief Value of a query argument from the url the client connected to
+     * (ws://host/?name=value), or "" if it was not given.
+     */
+    std::string getConnectArg(const std::string& name) const;
+    /**
+     * @return The server the session is connected to
+     */
+    WebServerBase* getServer() const;
 
    private:
     void* state;
     int id;
   };
 
+  /**
+   * @brief Runs one turn of the event loop. Sleeps until a socket is ready, a
+   * timer fires or wake() is called, so there is no polling interval: each
+   * message is handled from the receive callback the moment it is complete.
+   * @param time Unused, kept for existing callers
+   */
   void service(int time = 10);
 
+  /**
+   * @brief Calls a function on the service thread every interval seconds. The
+   * timer is a timerfd watched by the event loop.
+   * @param interval Seconds between calls
+   * @param callback The function to call
+   * @return false if the timer could not be created
+   */
+  bool addTimer(double interval, std::function<void()> callback);
+
+  /**
+   * @brief Runs a function on the service thread as soon as possible. May be
+   * called from any thread, e.g. to hand over a frame that is ready.
+   * @param task The function to run
+   */
+  void post(std::function<void()> task);
+
+  /**
+   * @brief Interrupts the event loop wait. May be called from any thread.
+   */
+  void wake();
+
+  /**
+   * @brief Adds to the metrics served at /metrics, which otherwise only
+   * cover the server's sessions. Called on the service thread per request.
+   * @param writer Appends metrics in the Prometheus text format
+   */
+  void setMetrics(std::function<void(std::string&)> writer);
+
+  /**
+   * @return The metrics served at /metrics, in the Prometheus text format
+   */
+  std::string getMetrics() const;
+
+  /**
+   * @return Frames kept deflated because a session still has them queued
+   */
+  size_t getDeflatedFrameCount() const { return deflatedFrames.size(); }
+
   virtual void createSession(void* info);
 
  protected:
   virtual Session* createSession() { return new Session(); }
 
+  /**
+   * @brief Enables compressed frames for a new session if its client asked
+   * for them and libwebsockets did not already negotiate permessage-deflate.
+   */
+  void negotiateDeflate(WebServerSessionState* state);
+
+  /**
+   * @brief Counts a session that will send a frame deflated, so the frame is
+   * only compressed once however many sessions queue it.
+   */
+  void holdFrame(const std::shared_ptr<const std::string>& msg);
+
+  /**
+   * @brief Returns the deflated form of a held frame, compressing it the
+   * first time any session writes it. Empty if the frame is not worth
+   * compressing.
+   */
+  const std::vector<unsigned char>& deflateFrame(
+      const std::shared_ptr<const std::string>& msg, TransferStats& stats);
+
+  /**
+   * @brief Uncounts a session that held a frame and has written or dropped
+   * it. The deflated form is forgotten once no session still has it queued.
+   */
+  void releaseFrame(const std::shared_ptr<const std::string>& msg);
+
+ private:
+  struct DeflatedFrame {
+    std::vector<unsigned char> data;
+    size_t queued = 0;        // sessions that still have the frame queued
+    bool compressed = false;  // data was computed, empty or not
+  };
+  // map nodes come from a pool, so a steady stream of frames reuses them
+  std::pmr::unsynchronized_pool_resource frameNodes;
+  std::pmr::map<const std::string*, DeflatedFrame> deflatedFrames{&frameNodes};
+  std::unique_ptr<MessageDeflater> deflater;
+
+  // callbacks of the timers, the event loop owns their timerfds
+  std::vector<std::unique_ptr<std::function<void()>>> timers;
+
+  // functions handed over by post(), run after each turn of the loop
+  std::mutex postedMutex;
+  std::vector<std::function<void()>> posted;
+  std::vector<std::function<void()>> running;
+  // appends the application's metrics, if set
+  std::function<void(std::string&)> metricsWriter;
+
  public:
   lws_context* context = nullptr;
   std::vector<Session*> sessions;
   std::map<int, Session*> sessionMap;
   std::string webDir;
+  DeflateOptions deflate;
+  // messages a session may have queued; a client that falls this far behind
+  // is disconnected rather than buffered for without bound
+  size_t maxQueued = 1 << 14;
 };
 
 template <typename T>
@@ -53,6 +202,8 @@ class WebServer : public WebServerBase {
  public:
   WebServer(int port = 8081, const std::string& webDir = ".")
       : WebServerBase(port, webDir) {}
+  WebServer(int port, const std::string& webDir, const DeflateOptions& deflate)
+      : WebServerBase(port, webDir, deflate) {}
 
  protected:
   Session* createSession() { return new T(); }
@@ -81,22 +232,22 @@ class JSONSession : public WebServerBase::Session {
 
   virtual void sendJSON(picojson::value& val) { sendMessage(val.serialize()); }
 
+  /**
+   * @brief Parses a message and hands it to receiveJSON. Messages arrive
+   * reassembled from their fragments, so each is parsed exactly once, into a
+   * document reused from message to message.
+   * @param msg A complete message
+   */
   void receiveMessage(const std::string& msg) {
-    static std::string buf = "";
-    picojson::value val;
-    std::string err = picojson::parse(val, msg);
-    if (err.empty() && val.is<picojson::object>()) {
-      buf = "";
-      receiveJSON(val);
-    } else {
-      buf += msg;
-      err = picojson::parse(val, buf);
-      if (err.empty() && val.is<picojson::object>()) {
-        buf = "";
-        receiveJSON(val);
-      }
+    std::string err;
+    picojson::parse(document, msg.begin(), msg.end(), &err);
+    if (err.empty() && document.is<picojson::object>()) {
+      receiveJSON(document);
     }
   }
+
+ private:
+  picojson::value document;
 };
 
 #include "util/json.h"
@@ -104,11 +255,13 @@ class JSONSession : public WebServerBase::Session {
 class JsonSession : public JSONSession {
  public:
   /**
-   * @brief Receive a command from the web server
-   * @param val: the command (in JSON format)
+   * @brief Parses a command and hands it to receiveCommand. Goes through
+   * JsonObject directly, so it works with either JSON backend.
+   * @param msg: the command (in JSON format)
    */
-  void receiveJSON(picojson::value& val) {
-    JsonObject data = JsonValue(val);
+  void receiveMessage(const std::string& msg) {
+    JsonObject data;
+    if (!JsonObject::parse(msg, data)) return;
 
     std::string cmd = data["command"];
 
@@ -116,8 +269,7 @@ class JsonSession : public JSONSession {
     returnValue["id"] = data["id"];
 
     receiveCommand(cmd, data, returnValue);
-    JsonValue retVal(returnValue);
-    sendJSON(retVal.getValue());
+    sendMessage(returnValue.toString());
   }
 
   /**
@@ -4,7 +4,7 @@
 #include <vector>
 
 #include "IEntity.h"
-#include "IStrategy.h"
+#include "Movement.h"
 #include "math/vector3.h"
 
 class Package;
@@ -40,8 +40,8 @@ class Drone : public IEntity {
    */
   void update(double dt);
 
-  // Deleting copy constructor and assignment operator to prevent copying.
-  Drone(const Drone& drone) = delete;
+  // Deleting the assignment operator to prevent copying; copies are only
+  // made by clone().
   Drone& operator=(const Drone& drone) = delete;
 
   /**
@@ -58,13 +58,45 @@ class Drone : public IEntity {
    */
   void fromJson(const JsonObject& obj) override;
 
+  /**
+   * @brief Writes the drone's state into a snapshot record.
+   *
+   * @param writer The snapshot being written.
+   */
+  void save(SnapshotWriter& writer) const override;
+
+  /**
+   * @brief Restores the drone's state from a snapshot record.
+   *
+   * @param reader The drone's record.
+   */
+  void load(SnapshotReader& reader) override;
+
+  /**
+   * @brief Copies the drone for a fork of its simulation.
+   *
+   * @param resource The fork's memory resource.
+   * @return The copy.
+   */
+  IEntity* clone(std::pmr::memory_resource* resource) const override;
+
+  /**
+   * @brief Points the drone at the copy of its package in the fork.
+   *
+   * @param byId The fork's entities, by ID.
+   */
+  void relink(const std::vector<IEntity*>& byId) override;
+
 
  private:
+  // Copies a drone for clone(), its paths allocated from resource
+  Drone(const Drone& drone, std::pmr::memory_resource* resource);
+
   bool available = false;
   bool pickedUp = false;
   Package* package = nullptr;
-  IStrategy* toPackage = nullptr;
-  IStrategy* toFinalDestination = nullptr;
+  Movement toPackage;
+  Movement toFinalDestination;
   double totalMileage = 0;  // To store the total mileage of the drone
 };
 
@@ -2,7 +2,7 @@
 #define HELICOPTER_H_
 
 #include "IEntity.h"
-#include "IStrategy.h"
+#include "Movement.h"
 
 /**
  * @class Helicopter
@@ -43,9 +43,35 @@ class Helicopter : public IEntity {
    */
   void fromJson(const JsonObject& obj) override;
 
+  /**
+   * @brief Writes the helicopter's state into a snapshot record.
+   *
+   * @param writer The snapshot being written.
+   */
+  void save(SnapshotWriter& writer) const override;
+
+  /**
+   * @brief Restores the helicopter's state from a snapshot record.
+   *
+   * @param reader The helicopter's record.
+   */
+  void load(SnapshotReader& reader) override;
+
+  /**
+   * @brief Copies the helicopter for a fork of its simulation.
+   *
+   * @param resource The fork's memory resource.
+   * @return The copy.
+   */
+  IEntity* clone(std::pmr::memory_resource* resource) const override;
+
 
  private:
-  IStrategy* movement = nullptr;
+  // Copies a helicopter for clone(), its path allocated from resource
+  Helicopter(const Helicopter& helicopter,
+             std::pmr::memory_resource* resource);
+
+  Movement movement;
   double distanceTraveled = 0;
   unsigned int mileCounter = 0;
   Vector3 lastPosition;
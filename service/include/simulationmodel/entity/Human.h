@@ -2,7 +2,7 @@
 #define HUMAN_H_
 
 #include "IEntity.h"
-#include "IStrategy.h"
+#include "Movement.h"
 
 /**
  * @class Human
@@ -43,9 +43,34 @@ class Human : public IEntity {
    */
   void fromJson(const JsonObject& obj) override;
 
+  /**
+   * @brief Writes the human's state into a snapshot record.
+   *
+   * @param writer The snapshot being written.
+   */
+  void save(SnapshotWriter& writer) const override;
+
+  /**
+   * @brief Restores the human's state from a snapshot record.
+   *
+   * @param reader The human's record.
+   */
+  void load(SnapshotReader& reader) override;
+
+  /**
+   * @brief Copies the human for a fork of its simulation.
+   *
+   * @param resource The fork's memory resource.
+   * @return The copy.
+   */
+  IEntity* clone(std::pmr::memory_resource* resource) const override;
+
  private:
+  // Copies a human for clone(), its path allocated from resource
+  Human(const Human& human, std::pmr::memory_resource* resource);
+
   static Vector3 kellerPosition;
-  IStrategy* movement = nullptr;
+  Movement movement;
   bool atKeller = false;
   Vector3 dest;
 };
@@ -1,12 +1,15 @@
 #ifndef ENTITY_H_
 #define ENTITY_H_
 
+#include <memory_resource>
 #include <vector>
 
 #include "Graph.h"
 #include "IPublisher.h"
 #include "json.h"
 #include "math/vector3.h"
+#include "util/SharedDetails.h"
+#include "util/Snapshot.h"
 #include "util/json.h"
 
 class SimulationModel;
@@ -38,9 +41,52 @@ class IEntity : public IPublisher {
   virtual ~IEntity();
 
   /**
-   * @brief Resets the static currentId counter to 0.
+   * @brief Allocates an entity from a simulation's memory, e.g.
+   * new (resource) Drone(details). Plain new is not available, so every
+   * entity comes from the simulation that owns it; delete gives the memory
+   * back to the same place.
+   * @param size Size of the entity.
+   * @param resource The simulation's memory resource.
    */
-  static void resetCurrentId();
+  static void* operator new(std::size_t size,
+                            std::pmr::memory_resource* resource);
+
+  /**
+   * @brief Returns an entity's memory to the resource it came from.
+   */
+  static void operator delete(void* p);
+
+  /**
+   * @brief Used if a constructor throws.
+   */
+  static void operator delete(void* p, std::pmr::memory_resource* resource);
+
+  /**
+   * @brief Gets the memory resource of the entity's simulation, for the
+   * entity's own allocations such as paths.
+   * @return The resource, or the default one if the entity has no model.
+   */
+  std::pmr::memory_resource* getMemoryResource() const;
+
+  /**
+   * @brief Resets the static currentId counter.
+   * @param id The ID the next entity gets, 0 unless an earlier simulation is
+   * being resumed.
+   */
+  static void resetCurrentId(int id = 0);
+
+  /**
+   * @return The ID the next entity gets.
+   */
+  static int getCurrentId();
+
+  /**
+   * @brief Makes the next entity created take an ID that is no longer in
+   * use, e.g. to bring back an entity that was removed. Entities after it
+   * get new IDs as usual.
+   * @param id The ID to hand out.
+   */
+  static void reuseId(int id);
 
   /**
    * @brief Links this entity to a simulation model,
@@ -50,6 +96,23 @@ class IEntity : public IPublisher {
    */
   virtual void linkModel(SimulationModel* model);
 
+  /**
+   * @brief Copies the entity for a fork of its simulation. The copy keeps
+   * the ID, shares the template and has its own trips. Its references to
+   * other entities still point into this simulation until relink() is
+   * called.
+   * @param resource The fork's memory resource.
+   * @return The copy.
+   */
+  virtual IEntity* clone(std::pmr::memory_resource* resource) const = 0;
+
+  /**
+   * @brief Points the entity's references to other entities at their
+   * copies in a fork, once every entity has been cloned.
+   * @param byId The fork's entities, by ID.
+   */
+  virtual void relink(const std::vector<IEntity*>& byId) {}
+
   /**
    * @brief Gets the ID of the entity.
    * @return The ID of the entity.
@@ -74,11 +137,24 @@ class IEntity : public IPublisher {
    */
   virtual const JsonObject& getDetails() const;
 
+  /**
+   * @brief Gets the shared template the entity's details come from.
+   * @return ID of the template.
+   */
+  virtual int getDetailsId() const;
+
+  /**
+   * @brief Gets the entity's details as JSON text, serialized once per
+   * template.
+   * @return The details as JSON text.
+   */
+  virtual const std::string& getDetailsText() const;
+
   /**
    * @brief Gets the color of the entity
    * @return The color of the entity
    */
-  virtual std::string getColor() const;
+  virtual const std::string& getColor() const;
 
   /**
    * @brief Gets the name of the entity
@@ -134,17 +210,43 @@ class IEntity : public IPublisher {
    */
   virtual void fromJson(const JsonObject& obj) = 0;
 
+  /**
+   * @brief Writes the entity's state into a snapshot record. Subclasses
+   * call this first, then write their own fields.
+   * @param writer The snapshot being written.
+   */
+  virtual void save(SnapshotWriter& writer) const;
+
+  /**
+   * @brief Restores the state save() wrote, reading it in the same order.
+   * @param reader The entity's record.
+   */
+  virtual void load(SnapshotReader& reader);
 
  protected:
+  /**
+   * @brief Finds the copy of an entity in a fork, for relink()
+   * @param entity The entity in the simulation that was forked, or nullptr
+   * @param byId The fork's entities, by ID
+   * @return The copy, or nullptr
+   */
+  template <class T>
+  static T* relinked(T* entity, const std::vector<IEntity*>& byId) {
+    if (!entity) return nullptr;
+    int id = entity->getId();
+    return id < byId.size() ? static_cast<T*>(byId[id]) : nullptr;
+  }
+
   SimulationModel* model = nullptr; /**< Pointer to the simulation model */
   int id = -1;                      /**< Unique ID of the entity */
-  JsonObject details;               /**< Details of the entity */
+  std::shared_ptr<const SharedDetails> details; /**< Shared template */
   Vector3 position;                 /**< Position of the entity */
   Vector3 direction;                /**< Direction of the entity */
   std::string color;                /**< Color of the entity */
   std::string name;                 /**< Name of the entity */
   double speed = 0;                 /**< Speed of the entity */
   static int currentId; /**< Static counter for generating unique IDs */
+  static int reusedId;  /**< ID for the next entity, or -1 */
 };
 
 #endif  // ENTITY_H_
@@ -57,6 +57,21 @@ class Package : public IEntity {
    */
   virtual void setStrategyName(std::string strategyName_);
 
+  /**
+   * @brief Returns the colors the package was decorated with when it was
+   * created, so it can be created again looking the same.
+   *
+   * @return One letter per decorator, r, g or b, innermost first.
+   */
+  virtual const std::string& getColorChain() const;
+
+  /**
+   * @brief Sets the colors returned by getColorChain.
+   *
+   * @param colors One letter per decorator, innermost first.
+   */
+  void setColorChain(const std::string& colors);
+
   /**
    * @brief Updates the package.
    *
@@ -90,11 +105,40 @@ class Package : public IEntity {
    */
   void fromJson(const JsonObject& obj) override;
 
+  /**
+   * @brief Writes the package's state into a snapshot record.
+   *
+   * @param writer The snapshot being written.
+   */
+  void save(SnapshotWriter& writer) const override;
+
+  /**
+   * @brief Restores the package's state from a snapshot record.
+   *
+   * @param reader The package's record.
+   */
+  void load(SnapshotReader& reader) override;
+
+  /**
+   * @brief Copies the package for a fork of its simulation.
+   *
+   * @param resource The fork's memory resource.
+   * @return The copy.
+   */
+  IEntity* clone(std::pmr::memory_resource* resource) const override;
+
+  /**
+   * @brief Points the package at the copy of its owner in the fork.
+   *
+   * @param byId The fork's entities, by ID.
+   */
+  void relink(const std::vector<IEntity*>& byId) override;
 
  protected:
   bool requiresDelivery_ = true;
   Vector3 destination;
   std::string strategyName;
+  std::string colorChain;
   Robot* owner = nullptr;
 };
 
@@ -54,6 +54,35 @@ class Robot : public IEntity {
    */
   void fromJson(const JsonObject& obj) override;
 
+  /**
+   * @brief Writes the robot's state into a snapshot record.
+   *
+   * @param writer The snapshot being written.
+   */
+  void save(SnapshotWriter& writer) const override;
+
+  /**
+   * @brief Restores the robot's state from a snapshot record.
+   *
+   * @param reader The robot's record.
+   */
+  void load(SnapshotReader& reader) override;
+
+  /**
+   * @brief Copies the robot for a fork of its simulation.
+   *
+   * @param resource The fork's memory resource.
+   * @return The copy.
+   */
+  IEntity* clone(std::pmr::memory_resource* resource) const override;
+
+  /**
+   * @brief Points the robot at the copy of its package in the fork.
+   *
+   * @param byId The fork's entities, by ID.
+   */
+  void relink(const std::vector<IEntity*>& byId) override;
+
 
  protected:
   Package* package = nullptr;
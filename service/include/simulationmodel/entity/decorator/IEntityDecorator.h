@@ -15,11 +15,16 @@ class IEntityDecorator : public T {
   virtual void linkModel(SimulationModel* model) {
     return sub->linkModel(model);
   }
+  virtual void relink(const std::vector<IEntity*>& byId) { sub->relink(byId); }
   virtual int getId() const { return sub->getId(); }
   virtual Vector3 getPosition() const { return sub->getPosition(); }
   virtual Vector3 getDirection() const { return sub->getDirection(); }
   virtual const JsonObject& getDetails() const { return sub->getDetails(); }
-  virtual std::string getColor() const { return sub->getColor(); }
+  virtual int getDetailsId() const { return sub->getDetailsId(); }
+  virtual const std::string& getDetailsText() const {
+    return sub->getDetailsText();
+  }
+  virtual const std::string& getColor() const { return sub->getColor(); }
   virtual std::string getName() const { return sub->getName(); }
   virtual double getSpeed() const { return sub->getSpeed(); }
   virtual void setPosition(Vector3 pos_) { return sub->setPosition(pos_); }
@@ -27,6 +32,8 @@ class IEntityDecorator : public T {
   virtual void setColor(std::string col_) { return sub->setColor(col_); }
   virtual void rotate(double angle) { return sub->rotate(angle); }
   virtual void update(double dt) { return sub->update(dt); }
+  virtual void save(SnapshotWriter& writer) const { sub->save(writer); }
+  virtual void load(SnapshotReader& reader) { sub->load(reader); }
 
  protected:
   T* sub = nullptr;
@@ -8,10 +8,18 @@ class PackageColorDecorator : public PackageDecorator {
   double hue = 0;
   double saturation = 0;
   double light = 0;
+  // this color blended with the wrapped package's, kept up to date by
+  // setColor so getColor doesn't walk the chain
+  std::string blended;
+
+  void blend();
 
  public:
   PackageColorDecorator(Package*, double = 0, double = 0, double = 0);
-  std::string getColor() const;
+  IEntity* clone(std::pmr::memory_resource* resource) const;
+  const std::string& getColor() const;
+  void setColor(std::string col_);
+  void load(SnapshotReader& reader);
 };
 
 #endif  // PACKAGE_COLOR_DECORATOR_H_
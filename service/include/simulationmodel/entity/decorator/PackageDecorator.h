@@ -8,10 +8,18 @@
 class PackageDecorator : public IEntityDecorator<Package> {
  public:
   PackageDecorator(Package* p) : IEntityDecorator(p) {}
+  virtual IEntity* clone(std::pmr::memory_resource* resource) const {
+    auto copy = new (resource) PackageDecorator(*this);
+    copy->sub = static_cast<Package*>(sub->clone(resource));
+    return copy;
+  }
   virtual Vector3 getDestination() const { return sub->getDestination(); }
   virtual std::string getStrategyName() const { return sub->getStrategyName(); }
   virtual Robot* getOwner() const { return sub->getOwner(); }
   virtual bool requiresDelivery() const { return sub->requiresDelivery(); }
+  virtual const std::string& getColorChain() const {
+    return sub->getColorChain();
+  }
   virtual void setStrategyName(std::string strategyName_) {
     return sub->setStrategyName(strategyName_);
   }
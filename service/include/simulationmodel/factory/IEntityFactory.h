@@ -1,6 +1,8 @@
 #ifndef I_ENTITY_FACTORY_H_
 #define I_ENTITY_FACTORY_H_
 
+#include <memory_resource>
+
 #include "IEntity.h"
 #include "util/json.h"
 
@@ -17,10 +19,12 @@ class IEntityFactory {
   /**
    * @brief Creates entity using the given JSON object, if possible.
    * @param entity - JsonObject to be used to create the new entity.
+   * @param resource - Memory the entity is allocated from.
    * @return Entity that was created if it was created successfully, or a
    *nullpointer if creation failed.
    **/
-  virtual IEntity* createEntity(const JsonObject& entity) = 0;
+  virtual IEntity* createEntity(const JsonObject& entity,
+                                std::pmr::memory_resource* resource) = 0;
 };
 
 #endif
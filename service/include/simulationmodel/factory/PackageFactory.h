@@ -19,10 +19,12 @@ class PackageFactory : public IEntityFactory {
   /**
    * @brief Creates entity using the given JSON object, if possible.
    * @param entity - JsonObject to be used to create the new entity.
+   * @param resource - Memory the entity is allocated from.
    * @return Entity that was created if it was created successfully, or a
    *nullpointer if creation failed.
    **/
-  IEntity* createEntity(const JsonObject& entity);
+  IEntity* createEntity(const JsonObject& entity,
+                        std::pmr::memory_resource* resource);
 };
 
 #endif
@@ -1,34 +1,49 @@
 #ifndef STRATEGY_FACTORY_H_
 #define STRATEGY_FACTORY_H_
 
-#include <string>
+#include <string_view>
 
-#include "AstarStrategy.h"
-#include "BeelineStrategy.h"
-#include "BfsStrategy.h"
-#include "DfsStrategy.h"
-#include "DijkstraStrategy.h"
 #include "Graph.h"
-#include "IStrategy.h"
+#include "Movement.h"
 
 /**
  * @class StrategyFactory
- * @brief Factory class for creating path strategy objects.
+ * @brief Factory class for starting path strategies by name. Names are the
+ * ones the strategies report through getName().
  */
 class StrategyFactory {
  public:
   /**
-   * @brief Creates a path strategy object based on the specified strategy name.
+   * @brief Starts a trip along the path strategy with the given name.
    *
    * @param strategyName Name of the strategy to create.
    * @param start Starting position.
    * @param end Destination position.
    * @param graph Graph representing the map.
-   * @return IStrategy* Pointer to the created path strategy object.
+   * @param movement Receives the trip. Left empty if the name is unknown.
+   * @param resource Memory the path is allocated from.
    */
-  static IStrategy* createStrategy(const std::string& strategyName,
-                                   const Vector3& start, const Vector3& end,
-                                   const routing::Graph* graph);
+  static void createStrategy(std::string_view strategyName,
+                             const Vector3& start, const Vector3& end,
+                             const routing::Graph* graph, Movement& movement,
+                             std::pmr::memory_resource* resource);
+
+  /**
+   * @brief Starts a delivery trip: the path strategy with the given name,
+   * followed by the celebrations that go with it. Unknown names fly a
+   * beeline without celebrating.
+   *
+   * @param strategyName Name of the strategy to create.
+   * @param start Starting position.
+   * @param end Destination position.
+   * @param graph Graph representing the map.
+   * @param movement Receives the trip.
+   * @param resource Memory the path is allocated from.
+   */
+  static void createDelivery(std::string_view strategyName,
+                             const Vector3& start, const Vector3& end,
+                             const routing::Graph* graph, Movement& movement,
+                             std::pmr::memory_resource* resource);
 };
 
 #endif  // STRATEGY_FACTORY_H_
@@ -4,19 +4,25 @@
 #include <cmath>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 #include <vector>
 
-// a simple class used for vector math, most function are self explanatory
+// a simple class used for vector math, most function are self explanatory.
+// the arithmetic is defined here so it is inlined into the movement and
+// routing loops that call it every frame.
 class Vector3 {
  public:
+  // lengths below this are treated as zero
+  static constexpr double eps = 0.0000001;
+
   double x = 0;
   double y = 0;
   double z = 0;
   /**
    * @brief Default constructor.
    */
-  Vector3();
-  Vector3(double a);
+  constexpr Vector3() = default;
+  constexpr Vector3(double a) : x(a), y(a), z(a) {}
   /**
    * @brief Parameter constructor.
    *
@@ -24,26 +30,47 @@ class Vector3 {
    * @param[in] b y-coordinate
    * @param[in] c z-coordinate
    */
-  Vector3(double a, double b, double c);
+  constexpr Vector3(double a, double b, double c) : x(a), y(b), z(c) {}
   Vector3(const std::vector<double>& v);
   Vector3(const std::vector<float>& v);
-  bool operator==(const Vector3& v) const;
-  double& operator[](int i);
-  double operator[](int i) const;
+  /**
+   * @brief Vectors closer together than eps compare equal
+   */
+  constexpr bool operator==(const Vector3& v) const {
+    return ((*this) - v).squaredMagnitude() < eps * eps;
+  }
+  constexpr double& operator[](int i) {
+    switch (i) {
+      case 0:
+        return x;
+      case 1:
+        return y;
+      case 2:
+        return z;
+    }
+    throw std::out_of_range("i not in range for vector");
+  }
+  constexpr double operator[](int i) const {
+    return const_cast<Vector3&>(*this)[i];
+  }
   /**
    * @brief Overrides + operator.
    * @param[in] v The Vector3 object you would like to add to this Vector3
    * object
    * @return The Vector3 Object comprised of the sum of the two objects
    */
-  Vector3 operator+(const Vector3& v) const;
+  constexpr Vector3 operator+(const Vector3& v) const {
+    return Vector3(x + v.x, y + v.y, z + v.z);
+  }
   /**
    * @brief Overrides - operator.
    * @param[in] v The Vector3 object you would like to subtract to this Vector3
    * object
    * @return The Vector3 Object comprised of the subtraction of the two objects
    */
-  Vector3 operator-(const Vector3& v) const;
+  constexpr Vector3 operator-(const Vector3& v) const {
+    return Vector3(x - v.x, y - v.y, z - v.z);
+  }
   /**
    * @brief Overrides * operator.
    * @param[in] v The Vector3 object you would like to multiply to this Vector3
@@ -51,15 +78,19 @@ class Vector3 {
    * @return The Vector3 Object comprised of the multiplication of the two
    * objects
    */
-  Vector3 operator*(double s) const;
+  constexpr Vector3 operator*(double s) const {
+    return Vector3(x * s, y * s, z * s);
+  }
   /**
    * @brief Overrides / operator.
    * @param[in] v The Vector3 object you would like to divide to this Vector3
    * object
    * @return The Vector3 Object comprised of the division of the two objects
    */
-  Vector3 operator/(double s) const;
-  double operator*(const Vector3& v) const;  // dot product
+  constexpr Vector3 operator/(double s) const { return (*this) * (1 / s); }
+  constexpr double operator*(const Vector3& v) const {  // dot product
+    return x * v.x + y * v.y + z * v.z;
+  }
   // return std::vector version of this Vector3
   // template function should be defined in same file
   // with template keyword
@@ -67,11 +98,22 @@ class Vector3 {
   std::vector<T> vec() const {
     return {static_cast<T>(x), static_cast<T>(y), static_cast<T>(z)};
   }
-  Vector3 cross(const Vector3& v) const;
-  double magnitude() const;
-  Vector3& normalize();
-  Vector3 unit() const;  // normal vector in same direction
-  double dist(const Vector3& v) const;
+  constexpr Vector3 cross(const Vector3& v) const {
+    return Vector3(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x);
+  }
+  // magnitude without the square root, for comparing lengths
+  constexpr double squaredMagnitude() const { return (*this) * (*this); }
+  double magnitude() const { return std::sqrt(squaredMagnitude()); }
+  Vector3& normalize() {
+    (*this) = unit();
+    return *this;
+  }
+  Vector3 unit() const {  // normal vector in same direction
+    double m = magnitude();
+    if (m < eps) return (*this);
+    return (*this) / m;
+  }
+  double dist(const Vector3& v) const { return ((*this) - v).magnitude(); }
   friend std::ostream& operator<<(std::ostream& strm, const Vector3& v);
 
   std::string toString() const;
@@ -0,0 +1,85 @@
+#ifndef VECTOR_KERNELS_H_
+#define VECTOR_KERNELS_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "math/vector3.h"
+
+/**
+ * @brief Positions stored in single precision as one array per coordinate,
+ * so the kernels below can load eight of them at once. For large sets of
+ * positions where scanning half the memory matters more than the last
+ * digits, e.g. graph nodes.
+ */
+struct Float3Array {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+
+  size_t size() const { return x.size(); }
+
+  void push_back(const Vector3& v) {
+    x.push_back(v.x);
+    y.push_back(v.y);
+    z.push_back(v.z);
+  }
+
+  void reserve(size_t n) {
+    x.reserve(n);
+    y.reserve(n);
+    z.reserve(n);
+  }
+
+  void clear() {
+    x.clear();
+    y.clear();
+    z.clear();
+  }
+
+  Vector3 operator[](size_t i) const { return Vector3(x[i], y[i], z[i]); }
+};
+
+/**
+ * Loops over arrays of positions. They use AVX2 when the CPU has it, picked
+ * once at startup, and otherwise fall back to scalar code that does the same
+ * arithmetic in the same order, so both give identical results.
+ */
+namespace kernels {
+
+/**
+ * @brief Turns the AVX2 versions off or back on, e.g. to compare them with
+ * the scalar ones. They are never used on a CPU without AVX2.
+ * @param enabled Whether the AVX2 versions are used where the CPU has it
+ */
+void setAvx2(bool enabled);
+
+/**
+ * @return Whether the AVX2 versions are in use
+ */
+bool usesAvx2();
+
+/**
+ * @brief Finds the position closest to a target, in single precision
+ * @param pos The positions
+ * @param target The target
+ * @return The index of the first of the closest positions, or -1 if there
+ * are none
+ */
+int nearest(const Float3Array& pos, const Vector3& target);
+
+/**
+ * @brief Distance from some of the positions to a target, e.g. from every
+ * neighbour of a node
+ * @param pos The positions
+ * @param ids Indices into pos of the positions to measure
+ * @param n Number of ids
+ * @param target The target
+ * @param out Receives one distance per id
+ */
+void distances(const Float3Array& pos, const int* ids, size_t n,
+               const Vector3& target, float* out);
+
+}  // namespace kernels
+
+#endif  // VECTOR_KERNELS_H_
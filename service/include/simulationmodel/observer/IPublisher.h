@@ -8,6 +8,9 @@
 
 class IPublisher {
  public:
+  IPublisher() = default;
+  // a copy starts out without observers, they subscribed to the original
+  IPublisher(const IPublisher& other) {}
   void addObserver(const IObserver* o);
   void removeObserver(const IObserver* o);
   void notifyObservers(const std::string& message) const;
@@ -16,9 +16,17 @@ class AstarStrategy : public PathStrategy {
    * @param position Current position.
    * @param destination End destination.
    * @param graph Graph/Nodes of the map.
+   * @param resource Memory the path is allocated from.
    */
   AstarStrategy(Vector3 position, Vector3 destination,
-                const routing::Graph* graph);
+                const routing::Graph* graph,
+                std::pmr::memory_resource* resource =
+                    std::pmr::get_default_resource());
+
+  /**
+   * @brief Construct a strategy with an empty path, for PathStrategy::load.
+   */
+  using PathStrategy::PathStrategy;
 
   /**
    * @brief Get the name of the strategy.
@@ -14,8 +14,16 @@ class BeelineStrategy : public PathStrategy {
    *
    * @param position Starting position.
    * @param destination End destination.
+   * @param resource Memory the path is allocated from.
    */
-  BeelineStrategy(Vector3 pos, Vector3 des);
+  BeelineStrategy(Vector3 pos, Vector3 des,
+                  std::pmr::memory_resource* resource =
+                      std::pmr::get_default_resource());
+
+  /**
+   * @brief Construct a strategy with an empty path, for PathStrategy::load.
+   */
+  using PathStrategy::PathStrategy;
 
   /**
    * @brief Get the name of the strategy.
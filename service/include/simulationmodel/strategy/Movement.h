@@ -0,0 +1,201 @@
+#ifndef MOVEMENT_H_
+#define MOVEMENT_H_
+
+#include <string>
+#include <tuple>
+#include <utility>
+#include <variant>
+
+#include "AstarStrategy.h"
+#include "BeelineStrategy.h"
+#include "BfsStrategy.h"
+#include "DfsStrategy.h"
+#include "DijkstraStrategy.h"
+#include "Jump.h"
+#include "Spin.h"
+
+/**
+ * @brief A path strategy followed by a fixed sequence of celebration steps,
+ * e.g. Trip<DfsStrategy, Jump, Spin> follows a DFS path, then jumps, then
+ * spins. Each step lasts celebrationTime seconds.
+ *
+ * The path and the steps are held by value and their types are known at
+ * compile time, so moving along a trip makes no virtual calls and creating
+ * one allocates nothing beyond the path itself.
+ */
+template <class Path, class... Steps>
+class Trip {
+ public:
+  /**
+   * @brief How long each celebration step lasts, in seconds
+   */
+  static constexpr double celebrationTime = 4;
+
+  /**
+   * @brief Construct a new Trip, building its path in place
+   *
+   * @param args Arguments for the path strategy's constructor
+   */
+  template <class... Args>
+  explicit Trip(Args&&... args) : path(std::forward<Args>(args)...) {}
+
+  /**
+   * @brief Move along the path, then celebrate once it is done
+   *
+   * @param entity Entity to move
+   * @param dt Delta Time
+   */
+  void move(IEntity* entity, double dt) {
+    if (!path.isCompleted()) {
+      path.move(entity, dt);
+    } else {
+      celebrate<0>(entity, dt);
+    }
+  }
+
+  /**
+   * @return True once the path and every celebration step are done
+   */
+  bool isCompleted() { return path.isCompleted() && step == sizeof...(Steps); }
+
+  /**
+   * @return Name of the path strategy
+   */
+  std::string getName() const { return path.getName(); }
+
+  /**
+   * @brief Write the path and how far the celebration has got
+   *
+   * @param writer The snapshot being written
+   */
+  void save(SnapshotWriter& writer) const {
+    path.save(writer);
+    std::apply([&](const Steps&... s) { (writer.write(s), ...); }, steps);
+    writer.write(step);
+    writer.write(time);
+  }
+
+  /**
+   * @brief Restore what save() wrote
+   *
+   * @param reader The snapshot being read
+   */
+  void load(SnapshotReader& reader) {
+    path.load(reader);
+    std::apply([&](Steps&... s) { ((s = reader.read<Steps>()), ...); },
+               steps);
+    step = reader.read<size_t>();
+    time = reader.read<double>();
+  }
+
+ private:
+  template <size_t I>
+  void celebrate(IEntity* entity, double dt) {
+    if constexpr (I < sizeof...(Steps)) {
+      if (step != I) return celebrate<I + 1>(entity, dt);
+      std::get<I>(steps).celebrate(entity, dt);
+      time -= dt;
+      if (time <= 0) {
+        step++;
+        time = celebrationTime;
+      }
+    }
+  }
+
+  Path path;
+  std::tuple<Steps...> steps;
+  size_t step = 0;  // celebration step in progress
+  double time = celebrationTime;
+};
+
+/**
+ * @brief How an entity is currently moving: nothing, or one of the trips
+ * entities take. Held by value in the entity and dispatched with std::visit.
+ */
+class Movement {
+ public:
+  Movement() = default;
+
+  /**
+   * @brief Copy a movement, e.g. into a fork of its simulation. A plain copy
+   * would put the path on the memory the copied path came from.
+   *
+   * @param other The movement to copy
+   * @param resource Memory the copy's path is allocated from
+   */
+  Movement(const Movement& other, std::pmr::memory_resource* resource);
+
+  Movement(const Movement& other) = default;
+  Movement& operator=(const Movement& other) = default;
+  /**
+   * @brief Every kind of trip an entity can be on
+   */
+  using Trips = std::variant<
+      std::monostate, Trip<BeelineStrategy>, Trip<AstarStrategy>,
+      Trip<DfsStrategy>, Trip<BfsStrategy>, Trip<DijkstraStrategy>,
+      Trip<AstarStrategy, Jump>, Trip<DfsStrategy, Jump, Spin>,
+      Trip<BfsStrategy, Spin, Spin>, Trip<DijkstraStrategy, Spin, Jump>>;
+
+  /**
+   * @brief Start a trip, replacing the current one
+   *
+   * @tparam Path The path strategy
+   * @tparam Steps The celebration steps after the path, in order
+   * @param args Arguments for the path strategy's constructor
+   */
+  template <class Path, class... Steps, class... Args>
+  void start(Args&&... args) {
+    trip.template emplace<Trip<Path, Steps...>>(std::forward<Args>(args)...);
+  }
+
+  /**
+   * @brief Stop moving
+   */
+  void reset() { trip.emplace<std::monostate>(); }
+
+  /**
+   * @return Whether the entity is on a trip, finished or not
+   */
+  explicit operator bool() const {
+    return !std::holds_alternative<std::monostate>(trip);
+  }
+
+  /**
+   * @brief Move toward the next position of the trip, if there is one
+   *
+   * @param entity Entity to move
+   * @param dt Delta Time
+   */
+  void move(IEntity* entity, double dt);
+
+  /**
+   * @return True if the trip is done or there is none
+   */
+  bool isCompleted();
+
+  /**
+   * @return Name of the path strategy, empty if there is no trip
+   */
+  std::string getName() const;
+
+  /**
+   * @brief Write the kind of trip and its progress, so it can be resumed
+   * without planning its path again
+   *
+   * @param writer The snapshot being written
+   */
+  void save(SnapshotWriter& writer) const;
+
+  /**
+   * @brief Resume the trip save() wrote, replacing the current one
+   *
+   * @param reader The snapshot being read
+   * @param resource Memory the path is allocated from
+   */
+  void load(SnapshotReader& reader, std::pmr::memory_resource* resource);
+
+ private:
+  Trips trip;
+};
+
+#endif  // MOVEMENT_H_
@@ -1,7 +1,10 @@
 #ifndef PATH_STRATEGY_H_
 #define PATH_STRATEGY_H_
 
+#include <memory_resource>
+
 #include "IStrategy.h"
+#include "util/Snapshot.h"
 
 /**
  * @brief this class inhertis from the IStrategy class and is represents
@@ -9,16 +12,17 @@
  */
 class PathStrategy : public IStrategy {
  protected:
-  std::vector<Vector3> path;
+  std::pmr::vector<Vector3> path;
   int index;
 
  public:
   /**
    * @brief Construct a new PathStrategy Strategy object
    *
-   * @param path the path to follow
+   * @param resource Memory the path is allocated from
    */
-  PathStrategy(std::vector<Vector3> path = {});
+  PathStrategy(std::pmr::memory_resource* resource =
+                   std::pmr::get_default_resource());
 
   /**
    * @brief Move toward next position in the path
@@ -35,6 +39,20 @@ class PathStrategy : public IStrategy {
    * @return True if complete, false if not complete
    */
   virtual bool isCompleted();
+
+  /**
+   * @brief Write the path and how far along it the entity is
+   *
+   * @param writer The snapshot being written
+   */
+  void save(SnapshotWriter& writer) const;
+
+  /**
+   * @brief Restore what save() wrote, without planning the path again
+   *
+   * @param reader The snapshot being read
+   */
+  void load(SnapshotReader& reader);
 };
 
 #endif  // PATH_STRATEGY_H_
@@ -0,0 +1,33 @@
+#ifndef JUMP_H_
+#define JUMP_H_
+
+#include "IEntity.h"
+
+/**
+ * @brief A celebration step where the entity jumps up and down. Used as a
+ * step of a Trip, which decides how long it lasts.
+ */
+class Jump {
+ public:
+  /**
+   * @brief Construct a new Jump step
+   *
+   * @param[in] jumpHeight how far up to jump
+   */
+  explicit Jump(double jumpHeight = 10) : jumpHeight(jumpHeight) {}
+
+  /**
+   * @brief Make the entity celebrate with the jump behavior.
+   *
+   * @param entity Entity to celebrate
+   * @param dt Delta Time
+   */
+  void celebrate(IEntity* entity, double dt);
+
+ private:
+  double jumpHeight = 10;
+  bool up = true;
+  double h = 0;
+};
+
+#endif  // JUMP_H_
@@ -0,0 +1,31 @@
+#ifndef SPIN_H_
+#define SPIN_H_
+
+#include "IEntity.h"
+
+/**
+ * @brief A celebration step where the entity spins in place. Used as a step
+ * of a Trip, which decides how long it lasts.
+ */
+class Spin {
+ public:
+  /**
+   * @brief Construct a new Spin step
+   *
+   * @param[in] spinSpeed multiplier for how fast to spin
+   */
+  explicit Spin(double spinSpeed = 1) : spinSpeed(spinSpeed) {}
+
+  /**
+   * @brief Make the entity celebrate with the spin behavior.
+   *
+   * @param entity Entity to celebrate
+   * @param dt Delta Time
+   */
+  void celebrate(IEntity* entity, double dt);
+
+ private:
+  double spinSpeed = 1;
+};
+
+#endif  // SPIN_H_
@@ -0,0 +1,111 @@
+#ifndef ALLOCATION_STATS_H_
+#define ALLOCATION_STATS_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Counts the heap allocations each thread makes. Counting replaces
+ * the global operator new and is only compiled into profiling builds
+ * (make ALLOC_PROFILE=1). Otherwise every count stays zero and the scopes
+ * below compile to nothing.
+ */
+class AllocationStats {
+ public:
+#ifdef ALLOC_PROFILE
+  static constexpr bool enabled = true;
+#else
+  static constexpr bool enabled = false;
+#endif
+
+  /**
+   * @brief Allocations and the bytes they asked for
+   */
+  struct Counts {
+    std::uint64_t allocations = 0;
+    std::uint64_t bytes = 0;
+
+    Counts& operator+=(const Counts& other) {
+      allocations += other.allocations;
+      bytes += other.bytes;
+      return *this;
+    }
+  };
+
+  /**
+   * @return What the calling thread has allocated since it started
+   */
+  static Counts thread() { return counts; }
+
+  /**
+   * @brief Called by operator new for every allocation
+   * @param bytes Size of the allocation
+   */
+  static void record(std::size_t bytes) {
+    counts.allocations++;
+    counts.bytes += bytes;
+  }
+
+  /**
+   * @brief Marks the calling thread's current tick as one that may allocate,
+   * e.g. because a route is being planned
+   */
+  static void expect() {
+    if constexpr (enabled) expected = true;
+  }
+
+  /**
+   * @brief Clears the mark set by expect()
+   * @return Whether the tick was marked
+   */
+  static bool takeExpected() {
+    bool was = expected;
+    expected = false;
+    return was;
+  }
+
+  /**
+   * @brief Makes an allocation in a tick that should allocate nothing fatal,
+   * rather than just reported
+   * @param strict Whether to abort
+   */
+  static void setStrict(bool strict) { AllocationStats::strict = strict; }
+
+  /**
+   * @return Whether unexpected allocations abort the process
+   */
+  static bool isStrict() { return strict; }
+
+ private:
+  static thread_local Counts counts;
+  static thread_local bool expected;
+  static bool strict;
+};
+
+/**
+ * @brief Adds what the current thread allocates during the scope's lifetime
+ * to a Counts, e.g. to break a tick down by phase.
+ */
+class AllocationScope {
+ public:
+  explicit AllocationScope(AllocationStats::Counts& into) : into(into) {
+    if constexpr (AllocationStats::enabled) start = AllocationStats::thread();
+  }
+
+  ~AllocationScope() {
+    if constexpr (AllocationStats::enabled) {
+      AllocationStats::Counts now = AllocationStats::thread();
+      into.allocations += now.allocations - start.allocations;
+      into.bytes += now.bytes - start.bytes;
+    }
+  }
+
+  AllocationScope(const AllocationScope&) = delete;
+  AllocationScope& operator=(const AllocationScope&) = delete;
+
+ private:
+  AllocationStats::Counts& into;
+  AllocationStats::Counts start;
+};
+
+#endif  // ALLOCATION_STATS_H_
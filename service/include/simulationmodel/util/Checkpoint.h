@@ -0,0 +1,225 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief A checkpoint file holds everything needed to carry on with a
+ * simulation in another process. It is a header followed by tagged
+ * sections:
+ *
+ * header:  char magic[8] "TRANSCKP", u32 version, u32 section count,
+ *          u64 body size, u32 crc32 of the body, u32 unused
+ * table:   per section u32 tag, u32 unused, u64 offset in body, u64 size
+ * body:    the sections, one after the other
+ *
+ * All numbers are in native byte order. Readers skip sections they don't
+ * know, so a section can be added without a new version; the version only
+ * changes when the contents of an existing section do.
+ */
+namespace checkpoint {
+
+constexpr char magic[8] = {'T', 'R', 'A', 'N', 'S', 'C', 'K', 'P'};
+constexpr uint32_t version = 1;
+
+/**
+ * @brief Makes a section tag out of four characters, e.g. tag("ENTS")
+ */
+constexpr uint32_t tag(const char (&name)[5]) {
+  return uint32_t(uint8_t(name[0])) | uint32_t(uint8_t(name[1])) << 8 |
+         uint32_t(uint8_t(name[2])) << 16 | uint32_t(uint8_t(name[3])) << 24;
+}
+
+}  // namespace checkpoint
+
+/**
+ * @brief Builds a checkpoint in memory, then writes it out in one go
+ */
+class CheckpointWriter {
+ public:
+  /**
+   * @brief Starts a section; what is written next belongs to it
+   * @param tag The section's tag
+   */
+  void beginSection(uint32_t tag) { sections.push_back({tag, body.size()}); }
+
+  /**
+   * @brief Writes a plain value as its bytes
+   */
+  template <class T>
+  void write(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    body.insert(body.end(), bytes, bytes + sizeof(T));
+  }
+
+  /**
+   * @brief Writes a count followed by that many plain values
+   */
+  template <class T>
+  void writeArray(const T* items, size_t n) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    write(static_cast<uint64_t>(n));
+    const char* bytes = reinterpret_cast<const char*>(items);
+    body.insert(body.end(), bytes, bytes + n * sizeof(T));
+  }
+
+  /**
+   * @brief Writes a length followed by the characters
+   */
+  void writeString(std::string_view s) { writeArray(s.data(), s.size()); }
+
+  /**
+   * @brief Writes the checkpoint to a file. It is written next to the file
+   * and synced first, then renamed over it, so the file is either the old
+   * checkpoint or the new one, never a mix.
+   * @param path The file
+   * @param error Receives what went wrong
+   * @return Whether the file was written
+   */
+  bool save(const std::string& path, std::string& error) const;
+
+ private:
+  struct Section {
+    uint32_t tag;
+    uint64_t offset;
+  };
+
+  std::vector<char> body;
+  std::vector<Section> sections;
+};
+
+/**
+ * @brief Reads values from one section of a checkpoint, in the order they
+ * were written. Reading past the end of the section fails the reader
+ * instead of reading past the file.
+ */
+class CheckpointReader {
+ public:
+  CheckpointReader() = default;
+  CheckpointReader(const char* begin, const char* end)
+      : pos(begin), end(end) {}
+
+  template <class T>
+  T read() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value{};
+    if (const char* bytes = take(sizeof(T))) {
+      std::memcpy(&value, bytes, sizeof(T));
+    }
+    return value;
+  }
+
+  /**
+   * @brief Reads what writeArray wrote, without copying it
+   * @param n Receives the number of values
+   * @return The values, still in the file; they may be unaligned, so copy
+   * them out with memcpy
+   */
+  template <class T>
+  const char* readSpan(size_t& n) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    n = read<uint64_t>();
+    if (n > remaining() / sizeof(T)) {
+      failed = true;
+      n = 0;
+    }
+    return take(n * sizeof(T));
+  }
+
+  /**
+   * @brief Reads what writeArray wrote into a vector, replacing its contents
+   */
+  template <class Vector>
+  void readArray(Vector& items) {
+    using T = typename Vector::value_type;
+    size_t n;
+    const char* bytes = readSpan<T>(n);
+    items.resize(n);
+    if (n) std::memcpy(items.data(), bytes, n * sizeof(T));
+  }
+
+  /**
+   * @return The string, pointing into the file
+   */
+  std::string_view readString() {
+    size_t n;
+    const char* chars = readSpan<char>(n);
+    return std::string_view(chars ? chars : "", n);
+  }
+
+  /**
+   * @return false once anything was read past the end of the section
+   */
+  bool ok() const { return !failed; }
+
+ private:
+  size_t remaining() const { return end - pos; }
+
+  const char* take(size_t n) {
+    if (failed || n > remaining()) {
+      failed = true;
+      return nullptr;
+    }
+    const char* bytes = pos;
+    pos += n;
+    return bytes;
+  }
+
+  const char* pos = nullptr;
+  const char* end = nullptr;
+  bool failed = false;
+};
+
+/**
+ * @brief A checkpoint file mapped into memory. Sections are read straight
+ * from the mapping, which stays valid as long as the file object lives.
+ */
+class CheckpointFile {
+ public:
+  CheckpointFile() = default;
+  CheckpointFile(const CheckpointFile&) = delete;
+  CheckpointFile& operator=(const CheckpointFile&) = delete;
+  ~CheckpointFile();
+
+  /**
+   * @brief Maps a file and checks its header and checksum
+   * @param path The file
+   * @param error Receives what is wrong with the file
+   * @return Whether the file is a checkpoint this build can read
+   */
+  bool open(const std::string& path, std::string& error);
+
+  /**
+   * @return The version the file was written with
+   */
+  uint32_t getVersion() const { return version; }
+
+  /**
+   * @brief Finds a section
+   * @param tag The section's tag
+   * @param reader Receives a reader over the section
+   * @return false if the file has no such section
+   */
+  bool section(uint32_t tag, CheckpointReader& reader) const;
+
+ private:
+  struct Section {
+    uint32_t tag;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  const char* map = nullptr;
+  size_t mapSize = 0;
+  const char* body = nullptr;
+  uint32_t version = 0;
+  std::vector<Section> sections;
+};
+
+#endif  // CHECKPOINT_H_
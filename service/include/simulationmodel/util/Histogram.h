@@ -0,0 +1,79 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief A histogram of durations in the style of HdrHistogram: values are
+ * counted in whole units, milliseconds unless given another, exactly up to
+ * 256 units and beyond that in buckets 1/128 of their magnitude wide, so any
+ * percentile is within 1% of the true value from one unit up to 2^42.
+ *
+ * Recording is one relaxed atomic increment per counter, so any number of
+ * threads may record at once. Summaries read every bucket once.
+ */
+class Histogram {
+ public:
+  /**
+   * @brief What the histogram holds, in seconds
+   */
+  struct Summary {
+    uint64_t count = 0;
+    double min = 0;
+    double max = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p95 = 0;
+    double p99 = 0;
+  };
+
+  /**
+   * @param unit Seconds counted as one, the resolution of the histogram
+   */
+  explicit Histogram(double unit = 0.001) : unit(unit) { clear(); }
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  /**
+   * @brief Counts a duration
+   * @param seconds The duration, negative ones count as 0
+   */
+  void record(double seconds);
+
+  /**
+   * @return Count, extremes, mean and percentiles of what was recorded
+   */
+  Summary summarize() const;
+
+  /**
+   * @return How many recorded durations are at most a bound, give or take
+   * the width of the bucket the bound falls in
+   * @param seconds The bound
+   */
+  uint64_t countAtMost(double seconds) const;
+
+  /**
+   * @brief Forgets everything recorded
+   */
+  void clear();
+
+ private:
+  static constexpr int subBits = 7;  // 128 buckets per power of two
+  static constexpr int maxBits = 42;  // 140 years in milliseconds
+  static constexpr int bucketCount = (maxBits - subBits + 1) << subBits;
+
+  // Bucket a value in units falls in
+  static int bucketOf(uint64_t value);
+  // Largest value that falls in a bucket
+  static uint64_t highestIn(int bucket);
+
+  std::atomic<uint64_t> buckets[bucketCount];
+  std::atomic<uint64_t> count;
+  const double unit;
+  std::atomic<uint64_t> total;  // of every value, in units
+  std::atomic<uint64_t> min;
+  std::atomic<uint64_t> max;
+};
+
+#endif  // HISTOGRAM_H_
@@ -0,0 +1,105 @@
+#ifndef JSON_WRITER_H_
+#define JSON_WRITER_H_
+
+#include <string>
+#include <string_view>
+
+#include "math/vector3.h"
+#include "util/json.h"
+
+/**
+ * @brief Writes JSON text straight into a buffer, without building a
+ * JsonObject first. The buffer is kept between messages, so once it has
+ * grown to the size of the largest message writing does not allocate.
+ *
+ * Commas are inserted automatically:
+ * @code
+ * writer.clear();
+ * writer.beginObject().key("id").value(3).key("pos").value(pos).endObject();
+ * @endcode
+ */
+class JsonWriter {
+ public:
+  /**
+   * @brief Empties the buffer, keeping its storage
+   */
+  void clear() {
+    buf.clear();
+    needComma = false;
+  }
+
+  /**
+   * @return The JSON written since the last clear()
+   */
+  const std::string& str() const { return buf; }
+
+  JsonWriter& beginObject() { return open('{'); }
+  JsonWriter& endObject() { return close('}'); }
+  JsonWriter& beginArray() { return open('['); }
+  JsonWriter& endArray() { return close(']'); }
+
+  /**
+   * @brief Writes the key of the next member of an object
+   * @param k The key, written escaped
+   */
+  JsonWriter& key(std::string_view k);
+
+  /**
+   * @brief Writes a number in its shortest form that reads back exactly.
+   * NaN and infinities, which JSON can't hold, are written as null.
+   */
+  JsonWriter& value(double d);
+  JsonWriter& value(int i);
+  JsonWriter& value(bool b);
+  JsonWriter& value(std::string_view s);
+  JsonWriter& value(const char* s) { return value(std::string_view(s)); }
+  JsonWriter& value(const std::string& s) {
+    return value(std::string_view(s));
+  }
+
+  /**
+   * @brief Writes a vector as an array of three numbers
+   */
+  JsonWriter& value(const Vector3& v);
+
+  /**
+   * @brief Writes an existing JSON value, e.g. an entity's details
+   */
+  JsonWriter& value(const JsonValue& v);
+  JsonWriter& value(const JsonObject& o);
+
+  /**
+   * @brief Writes text that is already valid JSON as the next value
+   */
+  JsonWriter& raw(std::string_view json);
+
+ private:
+  JsonWriter& open(char c) {
+    separate();
+    buf.push_back(c);
+    needComma = false;
+    return *this;
+  }
+
+  JsonWriter& close(char c) {
+    buf.push_back(c);
+    needComma = true;
+    return *this;
+  }
+
+  void separate() {
+    if (needComma) buf.push_back(',');
+  }
+
+#ifndef JSON_FLAT
+  void writeValue(const picojson::value& v);
+  void writeObject(const picojson::object& o);
+#endif
+  void writeNumber(double d);
+  void writeString(std::string_view s);
+
+  std::string buf;
+  bool needComma = false;  // set after a value, cleared after a key
+};
+
+#endif  // JSON_WRITER_H_
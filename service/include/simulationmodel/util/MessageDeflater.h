@@ -0,0 +1,43 @@
+#ifndef MESSAGE_DEFLATER_H_
+#define MESSAGE_DEFLATER_H_
+
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Compresses whole messages into raw deflate blocks (RFC 1951). Every
+ * message is compressed on its own, so the client can inflate each frame
+ * without keeping a window around between frames.
+ */
+class MessageDeflater {
+ public:
+  /**
+   * @param level zlib compression level, 1 is the fastest
+   */
+  explicit MessageDeflater(int level);
+  ~MessageDeflater();
+  MessageDeflater(const MessageDeflater&) = delete;
+  MessageDeflater& operator=(const MessageDeflater&) = delete;
+
+  /**
+   * @brief Deflates a message
+   * @param msg The message
+   * @param out Receives the deflated message, or is left empty if
+   * compressing would not save anything
+   */
+  void compress(const std::string& msg, std::vector<unsigned char>& out);
+
+  /**
+   * @return CPU time the calling thread has used so far, in seconds, which
+   * is what compressing costs it regardless of what other threads do
+   */
+  static double threadSeconds();
+
+ private:
+  z_stream stream;
+  bool ok = false;
+};
+
+#endif  // MESSAGE_DEFLATER_H_
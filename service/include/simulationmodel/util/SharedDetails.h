@@ -0,0 +1,52 @@
+#ifndef SHARED_DETAILS_H_
+#define SHARED_DETAILS_H_
+
+#include <memory>
+#include <string>
+
+#include "util/json.h"
+
+/**
+ * @brief The details of an entity that are common to every entity created
+ * from the same template: mesh, scale, speed and so on. Where an entity
+ * starts and what it is called are kept by the entity itself.
+ *
+ * Details are interned: entities with the same template share one immutable
+ * copy, which is serialized once and given an ID views can refer to. A
+ * template is dropped when the last entity using it goes away.
+ */
+class SharedDetails {
+ public:
+  /**
+   * @brief Finds or creates the shared copy of an entity's template
+   * @param details The details the entity was created with. Its position,
+   * direction, name and package colors are left out.
+   * @return The shared template
+   */
+  static std::shared_ptr<const SharedDetails> intern(const JsonObject& details);
+
+  /**
+   * @return ID of the template, unique for the life of the process
+   */
+  int getId() const { return id; }
+
+  /**
+   * @return The template
+   */
+  const JsonObject& getJson() const { return json; }
+
+  /**
+   * @return The template as JSON text
+   */
+  const std::string& getText() const { return text; }
+
+ private:
+  SharedDetails(int id, JsonObject json, std::string text)
+      : id(id), json(std::move(json)), text(std::move(text)) {}
+
+  int id;
+  JsonObject json;
+  std::string text;
+};
+
+#endif  // SHARED_DETAILS_H_
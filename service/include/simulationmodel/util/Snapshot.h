@@ -0,0 +1,237 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief The state of a set of entities in binary form. Each entity writes
+ * one record into a single contiguous buffer; strings such as names and
+ * colors are stored once in a table and records refer to them by index.
+ */
+struct Snapshot {
+  /**
+   * @brief Where an entity's record starts in data
+   */
+  struct Record {
+    int id;
+    uint32_t offset;
+  };
+
+  std::vector<char> data;
+  std::vector<std::string> strings;
+  std::vector<Record> records;
+
+  /**
+   * @return Bytes of memory the snapshot holds on to
+   */
+  size_t memoryUsage() const;
+};
+
+class IEntity;
+
+/**
+ * @brief Appends entity records to a snapshot
+ */
+class SnapshotWriter {
+ public:
+  /**
+   * @param snapshot The snapshot to write to
+   */
+  SnapshotWriter(Snapshot& snapshot) : snapshot(snapshot) {}
+
+  /**
+   * @brief Empties the snapshot's records so it can be written again, e.g.
+   * every tick. The string table is kept, so its indices stay valid.
+   */
+  void clearRecords() {
+    snapshot.data.clear();
+    snapshot.records.clear();
+  }
+
+  /**
+   * @brief Empties the string table as well
+   */
+  void clearStrings() {
+    snapshot.strings.clear();
+    stringIds.clear();
+  }
+
+  /**
+   * @brief Starts the record of an entity; what follows belongs to it
+   * @param id The entity's ID
+   */
+  void beginRecord(int id);
+
+  /**
+   * @brief Writes a plain value, e.g. a number or a Vector3, as its bytes
+   */
+  template <class T>
+  void write(const T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    snapshot.data.insert(snapshot.data.end(), bytes, bytes + sizeof(T));
+  }
+
+  /**
+   * @brief Writes a count followed by that many plain values
+   */
+  template <class T>
+  void writeArray(const T* items, size_t n) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    write(static_cast<uint32_t>(n));
+    const char* bytes = reinterpret_cast<const char*>(items);
+    snapshot.data.insert(snapshot.data.end(), bytes, bytes + n * sizeof(T));
+  }
+
+  /**
+   * @brief Writes the index of a string in the string table, adding it if
+   * this snapshot doesn't have it yet
+   */
+  void writeString(const std::string& s);
+
+  /**
+   * @brief Writes a reference to another entity, as its ID
+   * @param entity The entity, or nullptr
+   */
+  void writeReference(const IEntity* entity);
+
+ private:
+  Snapshot& snapshot;
+  std::unordered_map<std::string, uint32_t> stringIds;
+};
+
+/**
+ * @brief References to other entities met while loading a snapshot. The
+ * entity referred to may not be loaded yet, so they are resolved in a second
+ * pass once every record has been read.
+ */
+class SnapshotLinks {
+ public:
+  /**
+   * @brief Adds a reference to resolve later
+   * @param id ID of the entity referred to
+   * @param link Called with that entity, or nullptr if it is gone
+   */
+  void add(int id, std::function<void(IEntity*)> link) {
+    pending.push_back({id, std::move(link)});
+  }
+
+  /**
+   * @brief Resolves every reference, in the order they were added
+   * @param byId The restored entities, indexed by ID
+   */
+  void resolve(const std::vector<IEntity*>& byId);
+
+ private:
+  std::vector<std::pair<int, std::function<void(IEntity*)>>> pending;
+};
+
+/**
+ * @brief Reads an entity's record back, in the order it was written. Reads
+ * never go past the end of the data; one that would, or a string index past
+ * the table, fails the reader and gives a zero value or an empty string.
+ */
+class SnapshotReader {
+ public:
+  /**
+   * @param snapshot The snapshot the record is in
+   * @param record The record to read
+   * @param links Collects the references to other entities
+   */
+  SnapshotReader(const Snapshot& snapshot, const Snapshot::Record& record,
+                 SnapshotLinks& links)
+      : SnapshotReader(
+            snapshot.data.data() +
+                std::min<size_t>(record.offset, snapshot.data.size()),
+            snapshot.data.data() + snapshot.data.size(), snapshot.strings,
+            links) {}
+
+  /**
+   * @brief Reads a record that isn't held in a Snapshot, e.g. one in a
+   * mapped file
+   * @param record Start of the record
+   * @param end End of the data the record is in
+   * @param strings The string table the record refers to
+   * @param links Collects the references to other entities
+   */
+  SnapshotReader(const char* record, const char* end,
+                 const std::vector<std::string>& strings, SnapshotLinks& links)
+      : strings(strings), pos(record), end(end), links(links) {}
+
+  template <class T>
+  T read() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value{};
+    if (const char* bytes = take(sizeof(T))) {
+      std::memcpy(&value, bytes, sizeof(T));
+    }
+    return value;
+  }
+
+  /**
+   * @brief Reads what writeArray wrote into a vector, replacing its contents
+   */
+  template <class Vector>
+  void readArray(Vector& items) {
+    using T = typename Vector::value_type;
+    static_assert(std::is_trivially_copyable_v<T>);
+    size_t n = read<uint32_t>();
+    if (n > remaining() / sizeof(T)) {
+      failed = true;
+      n = 0;
+    }
+    items.resize(n);
+    if (n) std::memcpy(items.data(), take(n * sizeof(T)), n * sizeof(T));
+  }
+
+  const std::string& readString() {
+    static const std::string none;
+    uint32_t index = read<uint32_t>();
+    if (index < strings.size()) return strings[index];
+    failed = true;
+    return none;
+  }
+
+  /**
+   * @brief Reads an entity ID written with SnapshotWriter::writeReference.
+   * link is called with the entity once all records are loaded; nothing
+   * happens for a null reference.
+   */
+  void readReference(std::function<void(IEntity*)> link) {
+    int id = read<int>();
+    if (id != -1 && !failed) links.add(id, std::move(link));
+  }
+
+  /**
+   * @return false once anything was read past the end of the data
+   */
+  bool ok() const { return !failed; }
+
+ private:
+  size_t remaining() const { return end - pos; }
+
+  const char* take(size_t n) {
+    if (failed || n > remaining()) {
+      failed = true;
+      return nullptr;
+    }
+    const char* bytes = pos;
+    pos += n;
+    return bytes;
+  }
+
+  const std::vector<std::string>& strings;
+  const char* pos;
+  const char* end;
+  bool failed = false;
+  SnapshotLinks& links;
+};
+
+#endif  // SNAPSHOT_H_
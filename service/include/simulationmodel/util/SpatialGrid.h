@@ -0,0 +1,65 @@
+#ifndef SPATIAL_GRID_H_
+#define SPATIAL_GRID_H_
+
+#include <vector>
+
+#include "math/vector3.h"
+
+/**
+ * @brief A uniform grid over the ground (x/z) plane used to find the entities
+ * inside a rectangle without looking at every entity.
+ *
+ * Entries are kept in one array sorted by cell rather than in a list per
+ * cell, so entities moving into cells nobody was in before cost no
+ * allocations once the array holds as many entities as there ever were.
+ */
+class SpatialGrid {
+ public:
+  /**
+   * @brief Creates an empty grid
+   * @param cellSize Width of a square cell in world units
+   */
+  SpatialGrid(double cellSize = 100);
+
+  /**
+   * @brief Removes every entry. Storage is kept for the next frame.
+   */
+  void clear();
+
+  /**
+   * @brief Adds an entity to the cell containing its position
+   * @param id ID of the entity
+   * @param pos Position of the entity
+   */
+  void insert(int id, const Vector3& pos);
+
+  /**
+   * @brief Finds the entities inside a rectangle on the ground plane
+   * @param minX Smallest x of the rectangle
+   * @param minZ Smallest z of the rectangle
+   * @param maxX Largest x of the rectangle
+   * @param maxZ Largest z of the rectangle
+   * @param out Receives the IDs of the entities inside, appended
+   */
+  void query(double minX, double minZ, double maxX, double maxZ,
+             std::vector<int>& out) const;
+
+ private:
+  struct Entry {
+    long long key;  // of the cell the entity is in
+    int id;
+    double x;
+    double z;
+  };
+
+  long long cellKey(long long cx, long long cz) const {
+    return (cx << 32) ^ (cz & 0xffffffffLL);
+  }
+
+  double cellSize;
+  // sorted by key by the first query after an insert
+  mutable std::vector<Entry> entries;
+  mutable bool sorted = true;
+};
+
+#endif  // SPATIAL_GRID_H_
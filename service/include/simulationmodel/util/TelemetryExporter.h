@@ -0,0 +1,137 @@
+#ifndef TELEMETRY_EXPORTER_H_
+#define TELEMETRY_EXPORTER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "math/vector3.h"
+
+/**
+ * @brief Streams telemetry to a file while the simulation runs, from a
+ * writer thread of its own. Rows are handed over in batches and written as
+ * they come. The simulation never waits for the writer: at most maxPending
+ * rows wait for it, and rows handed over past that are dropped and counted.
+ *
+ * The file is columnar: a schema header followed by blocks, each holding
+ * some rows of one table, column after column.
+ *
+ * header:  char magic[8] "TRANSTLM", u32 version, u32 table count
+ * table:   u32 name length, name, u32 column count, then per column
+ *          u32 name length, name, u8 type ('i' int32, 'l' int64,
+ *          'd' double, 'b' uint8), u8 width in bytes
+ * block:   u32 table index, u32 row count, then every column in schema
+ *          order, row count values of its width each
+ *
+ * All numbers are in native byte order. A file cut short, e.g. by a crash,
+ * can be read up to its last whole block.
+ *
+ * With CSV on, the same rows also go to <path>.events.csv and
+ * <path>.fleet.csv.
+ */
+class TelemetryExporter {
+ public:
+  /**
+   * @brief Where and how to export
+   */
+  struct Options {
+    std::string path;
+    bool csv = false;              // also write CSV files
+    double fleetInterval = 1;      // simulated seconds between fleet rows
+    size_t maxPending = 1 << 16;   // rows waiting for the writer at most
+  };
+
+  /**
+   * @brief A pickup or drop-off
+   */
+  struct EventRow {
+    uint64_t sequence;     // order of the event across threads
+    double time;           // simulated seconds
+    std::time_t wallTime;  // when it happened
+    int drone;             // ID of the drone
+    uint8_t dropoff;       // 0 for a pickup, 1 for a drop-off
+    Vector3 location;
+  };
+
+  /**
+   * @brief The state of the whole fleet at one time
+   */
+  struct FleetRow {
+    double time;         // simulated seconds
+    int drones;          // drones in the simulation
+    int busy;            // drones on a delivery
+    int64_t deliveries;  // deliveries completed so far
+    double distance;     // distance flown on deliveries so far
+  };
+
+  TelemetryExporter() = default;
+  TelemetryExporter(const TelemetryExporter&) = delete;
+  TelemetryExporter& operator=(const TelemetryExporter&) = delete;
+
+  /**
+   * @brief Finishes the files, as close() does
+   */
+  ~TelemetryExporter();
+
+  /**
+   * @brief Creates the files, writes the schema and starts the writer
+   * @param options Where and how to export
+   * @param error Receives what went wrong
+   * @return Whether the files could be created
+   */
+  bool open(const Options& options, std::string& error);
+
+  /**
+   * @return The options the exporter was opened with
+   */
+  const Options& getOptions() const { return options; }
+
+  /**
+   * @brief Hands rows to the writer without waiting for it. Rows that would
+   * leave more than maxPending waiting are dropped, the fleet row last.
+   * @param events Events to write, emptied
+   * @param fleet A fleet row to write, or nullptr
+   */
+  void push(std::vector<EventRow>& events, const FleetRow* fleet);
+
+  /**
+   * @return Rows dropped so far because the writer was too far behind
+   */
+  uint64_t getDropped() const {
+    return dropped.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Writes whatever is still waiting and closes the files
+   */
+  void close();
+
+ private:
+  // Writes rows on the writer thread until closed
+  void run();
+  void writeEvents(const std::vector<EventRow>& rows);
+  void writeFleet(const std::vector<FleetRow>& rows);
+
+  Options options;
+  std::FILE* file = nullptr;
+  std::FILE* eventsCsv = nullptr;
+  std::FILE* fleetCsv = nullptr;
+
+  std::mutex mutex;
+  std::condition_variable wake;  // rows are waiting, or closing
+  std::vector<EventRow> pendingEvents;
+  std::vector<FleetRow> pendingFleet;
+  bool closing = false;
+  std::atomic<uint64_t> dropped{0};
+  std::thread writer;
+
+  std::vector<char> block;  // block being written, reused
+};
+
+#endif  // TELEMETRY_EXPORTER_H_
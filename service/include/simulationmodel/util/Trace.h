@@ -0,0 +1,94 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Records where the time of a tick goes. Code marks what it does
+ * with TRACE_SCOPE("name"), and every scope is recorded with its start and
+ * duration into a ring buffer of the running thread's own, so recording
+ * takes no locks and keeps the last ringSize scopes of each thread.
+ * dump() writes them out in the Chrome trace format, for chrome://tracing
+ * or Perfetto.
+ *
+ * Tracing is only compiled into tracing builds (make TRACE=1). Otherwise
+ * TRACE_SCOPE compiles to nothing and there is nothing to dump.
+ */
+class Trace {
+ public:
+#ifdef TICK_TRACE
+  static constexpr bool enabled = true;
+#else
+  static constexpr bool enabled = false;
+#endif
+
+  /**
+   * @brief Scopes kept per thread; older ones are overwritten
+   */
+  static constexpr uint64_t ringSize = 1 << 15;
+
+  /**
+   * @brief Longest detail kept with a scope, in bytes
+   */
+  static constexpr size_t detailSize = 24;
+
+  /**
+   * @return Nanoseconds on the steady clock
+   */
+  static uint64_t now();
+
+  /**
+   * @brief Records a scope on the calling thread
+   * @param name What was done, a string that outlives the trace
+   * @param detail More about it, e.g. a command; cut to detailSize
+   * @param begin When it started, from now()
+   * @param end When it ended, from now()
+   */
+  static void record(const char* name, std::string_view detail,
+                     uint64_t begin, uint64_t end);
+
+  /**
+   * @brief Writes the scopes every thread recorded as Chrome trace JSON.
+   * Threads may go on recording meanwhile; scopes overwritten while they
+   * are read are left out.
+   * @param path File to write
+   * @param error Receives what went wrong
+   * @return Whether the file was written
+   */
+  static bool dump(const std::string& path, std::string& error);
+};
+
+/**
+ * @brief Records the time from its construction to its destruction as a
+ * scope. Use through TRACE_SCOPE, so it disappears from untraced builds.
+ */
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name, std::string_view detail = {})
+      : name(name), detail(detail), begin(Trace::now()) {}
+
+  ~TraceScope() { Trace::record(name, detail, begin, Trace::now()); }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  const char* name;
+  std::string_view detail;
+  uint64_t begin;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef TICK_TRACE
+/// Traces the rest of the enclosing block: TRACE_SCOPE(name[, detail])
+#define TRACE_SCOPE(...) \
+  TraceScope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
+#else
+#define TRACE_SCOPE(...) static_cast<void>(0)
+#endif
+
+#endif  // TRACE_H_
@@ -1,10 +1,15 @@
 #ifndef UTIL_JSON_H_
 #define UTIL_JSON_H_
 
+#ifdef JSON_FLAT
+#include "util/json_flat.h"
+#else
+
 #include <functional>
 #include <initializer_list>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <utility>
 
 #include "picojson.h"
@@ -334,11 +339,32 @@ class JsonObject {
     return obj.find(key) != obj.end();
   }
 
+  /**
+   * @brief Removes a key from this JSON object, if it is there.
+   * @param key: the key
+   */
+  void erase(const std::string& key) { obj.erase(key); }
+
   /**
    * @return A vector of all the keys in this JsonObject
    */
   std::vector<std::string> getKeys() const;
 
+  /**
+   * @brief Parses JSON text
+   * @param text The text
+   * @param out Receives the object
+   * @return false if the text is not a valid JSON object
+   */
+  static bool parse(std::string_view text, JsonObject& out) {
+    picojson::value val;
+    std::string err;
+    picojson::parse(val, text.begin(), text.end(), &err);
+    if (!err.empty() || !val.is<picojson::object>()) return false;
+    out.obj = std::move(val.get<picojson::object>());
+    return true;
+  }
+
  protected:
   picojson::object obj;
 };
@@ -568,4 +594,6 @@ inline std::ostream& operator<<(std::ostream& os, const JsonArray& array) {
   return os;
 }
 
+#endif  // JSON_FLAT
+
 #endif  // UTIL_JSON_H_
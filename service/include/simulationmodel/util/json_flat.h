@@ -0,0 +1,389 @@
+#ifndef UTIL_JSON_FLAT_H_
+#define UTIL_JSON_FLAT_H_
+
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Flat, arena-backed implementation of JsonValue / JsonObject / JsonArray,
+ * selected with -DJSON_FLAT (make JSON=flat). It has the same interface as
+ * the picojson wrapper in json.h, minus the accessors that hand out picojson
+ * types.
+ *
+ * - Every document owns an arena. Strings, arrays and object members are
+ *   allocated from it and freed together when the last handle goes away.
+ * - Objects are a flat array of (key, value) pairs searched linearly, which
+ *   beats a std::map for the handful of members entities have. Keys are
+ *   interned, so each distinct key is stored once for the whole process.
+ * - Copies share the document and only duplicate it when one of them is
+ *   changed (copy on write). Reading obj["position"] from a const object, or
+ *   converting it to a JsonArray, copies nothing.
+ *
+ * A value returned by the non-const operator[] refers into its container,
+ * like the picojson version. It writes into the document even if the
+ * container has been copied since, so take such references after copying.
+ */
+
+namespace flatjson {
+
+/**
+ * @brief Bump allocator. Nothing is freed until the arena is destroyed.
+ */
+class Arena {
+ public:
+  void* allocate(size_t size, size_t align);
+
+  template <class T>
+  T* allocate(size_t n) {
+    return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+  }
+
+ private:
+  std::vector<std::unique_ptr<char[]>> blocks;
+  char* cur = nullptr;
+  size_t left = 0;
+  size_t nextSize = 512;
+};
+
+struct Member;
+
+/**
+ * @brief A JSON value inside an arena. Strings, arrays and objects point to
+ * arena memory; an empty one needs none.
+ */
+struct Node {
+  enum Type : unsigned char { Null, Bool, Number, String, Array, Object };
+
+  Type type = Null;
+  unsigned size = 0;      // characters, items or members
+  unsigned capacity = 0;  // room for items or members
+  union {
+    bool b;
+    double number;
+    const char* str;
+    Node* items;
+    Member* members;
+  };
+
+  Node() : number(0) {}
+};
+
+/**
+ * @brief An object member. Values are allocated separately so references to
+ * them stay valid while the object grows.
+ */
+struct Member {
+  const std::string* key;  // interned
+  Node* value;
+};
+
+/**
+ * @brief An arena and the value that owns it
+ */
+struct Document {
+  Arena arena;
+  Node root;
+};
+
+/**
+ * @return The single shared copy of a key
+ */
+const std::string* intern(std::string_view key);
+
+/**
+ * @return The value of a member, or nullptr if obj has no such key
+ */
+const Node* findMember(const Node& obj, std::string_view key);
+
+/**
+ * @brief Makes dst a deep copy of src, allocating from arena
+ */
+void copyNode(Node& dst, const Node& src, Arena& arena);
+
+/**
+ * @brief Makes n a string, allocating from arena
+ */
+void setString(Node& n, std::string_view s, Arena& arena);
+
+/**
+ * @brief Appends n as JSON text to out
+ */
+void serialize(const Node& n, std::string& out);
+
+/**
+ * @brief Parses JSON text into doc's root
+ * @return false if the text is not valid JSON
+ */
+bool parse(std::string_view text, Document& doc);
+
+}  // namespace flatjson
+
+class JsonObject;
+class JsonArray;
+
+/**
+ * @class A JSON value with implicit casting for valid JSON types. Numbers,
+ * bools and null are held inline; strings, arrays and objects share a
+ * document.
+ */
+class JsonValue {
+ public:
+  JsonValue() {}
+  JsonValue(double d) {
+    local.type = flatjson::Node::Number;
+    local.number = d;
+  }
+  JsonValue(int i) : JsonValue(static_cast<double>(i)) {}
+  JsonValue(const std::string& s) { setOwned(s); }
+  JsonValue(const char* s) { setOwned(s); }
+  JsonValue(bool b) {
+    local.type = flatjson::Node::Bool;
+    local.b = b;
+  }
+  JsonValue(const JsonObject& o);
+  JsonValue(const JsonArray& a);
+
+  /**
+   * @return The underlying node
+   */
+  const flatjson::Node& getNode() const { return node ? *node : local; }
+
+  operator double() const;
+  operator float() const { return static_cast<float>(operator double()); }
+  operator int() const { return static_cast<int>(operator double()); }
+  operator std::string() const;
+  operator bool() const;
+  operator JsonObject() const;
+  operator JsonArray() const;
+
+  JsonValue& operator=(double d);
+  JsonValue& operator=(float f) { return operator=(static_cast<double>(f)); }
+  JsonValue& operator=(int i) { return operator=(static_cast<double>(i)); }
+  JsonValue& operator=(const std::string& s);
+  JsonValue& operator=(const char* s) { return operator=(std::string(s)); }
+  JsonValue& operator=(bool b);
+  JsonValue& operator=(const JsonObject& o);
+  JsonValue& operator=(const JsonArray& a);
+
+  /**
+   * @brief Serialize this to valid JSON text.
+   * @return This as a serialized JSON-formatted string.
+   */
+  std::string toString() const;
+
+ private:
+  friend class JsonObject;
+  friend class JsonArray;
+
+  // A value that refers to a node inside a container, written through
+  static JsonValue reference(const std::shared_ptr<flatjson::Document>& doc,
+                             flatjson::Node* node);
+  // A read only view of a node inside a document
+  static JsonValue view(const std::shared_ptr<flatjson::Document>& doc,
+                        const flatjson::Node* node);
+
+  void setOwned(std::string_view s);
+  // Replaces the value: written into the container for references, otherwise
+  // this value lets go of its document
+  void assign(const flatjson::Node& n);
+  // The document a string or container value lives in
+  std::shared_ptr<flatjson::Document> document() const;
+
+  std::shared_ptr<flatjson::Document> doc;   // set for strings and containers
+  std::weak_ptr<flatjson::Document> parent;  // set for references
+  flatjson::Node* node = nullptr;            // null when held in local
+  flatjson::Node local;
+  bool isRef = false;
+};
+
+/**
+ * @class A JSON object, works with JsonValue to provide implicit casting
+ */
+class JsonObject {
+ public:
+  /**
+   * @brief Default constructor
+   */
+  JsonObject() = default;
+
+  /**
+   * @brief Read/write access to a value in this JSON object from a given key.
+   * You can add to the JsonObject this way.
+   * @param key: the key
+   * @return read/write access to a JsonValue
+   */
+  JsonValue operator[](const std::string& key);
+
+  /**
+   * @brief Read only access to a value in this JSON object from a given key.
+   * Requires existence of provided key. The value shares this object's
+   * document rather than copying it.
+   * @throws std::out_of_range: if the key does not exist
+   * @param key: the key
+   * @return the value at the provided key
+   */
+  JsonValue operator[](const std::string& key) const;
+
+  /**
+   * @brief Serialize this to valid JSON text.
+   * @return This as a serialized JSON-formatted string.
+   */
+  std::string toString() const;
+
+  /**
+   * @brief Check if this JSON object contains a given key.
+   * @param key: the key
+   * @return whether or not key exists in this JsonObject
+   */
+  bool contains(const std::string& key) const {
+    return flatjson::findMember(getNode(), key) != nullptr;
+  }
+
+  /**
+   * @brief Removes a key from this JSON object, if it is there.
+   * @param key: the key
+   */
+  void erase(const std::string& key);
+
+  /**
+   * @return A vector of all the keys in this JsonObject
+   */
+  std::vector<std::string> getKeys() const;
+
+  /**
+   * @return The underlying node
+   */
+  const flatjson::Node& getNode() const;
+
+  /**
+   * @brief Parses JSON text
+   * @param text The text
+   * @param out Receives the object
+   * @return false if the text is not a valid JSON object
+   */
+  static bool parse(std::string_view text, JsonObject& out);
+
+ private:
+  friend class JsonValue;
+  JsonObject(std::shared_ptr<flatjson::Document> doc, flatjson::Node* node)
+      : doc(std::move(doc)), node(node) {}
+
+  // The node to change, copying the document first if it is shared
+  flatjson::Node& mutableNode();
+
+  std::shared_ptr<flatjson::Document> doc;  // null while empty
+  flatjson::Node* node = nullptr;
+};
+
+/**
+ * @class A JSON array. Works with JsonValue for implicit casting.
+ */
+class JsonArray {
+ public:
+  /**
+   * @brief Default constructor.
+   */
+  JsonArray() = default;
+
+  /**
+   * @brief Construct using an initializer list
+   * @param ls: the initializer list
+   */
+  JsonArray(const std::initializer_list<JsonValue> ls);
+
+  /**
+   * @brief Initialize a JsonArray to a given size.
+   * @param size: the size of the array
+   */
+  explicit JsonArray(int size) { resize(size); }
+
+  /**
+   * @brief Serialize this to valid JSON text.
+   * @return This as a serialized JSON-formatted string.
+   */
+  std::string toString() const;
+
+  /**
+   * @brief Read-write access to the entry at the given index.
+   * @param idx: the index
+   * @return read/write access to a JsonValue
+   */
+  JsonValue operator[](int idx);
+
+  /**
+   * @brief Read-only access to the entry at the given index.
+   * @throws std::out_of_range: if the index is not within the bounds of the
+   * array
+   * @param idx: the index
+   * @return the entry at the given index, sharing this array's document
+   */
+  JsonValue operator[](int idx) const { return at(idx); }
+
+  /**
+   * @brief Refer to operator[] const
+   */
+  JsonValue at(int idx) const;
+
+  /**
+   * @brief push a JsonValue to the array (like std::vector::push_back())
+   * @param val: the value to push
+   */
+  void push(const JsonValue& val);
+
+  /**
+   * @return The size of the array
+   */
+  int size() const { return getNode().size; }
+
+  /**
+   * @brief resize the array to the given size.
+   * @param size: the new size
+   */
+  void resize(int size);
+
+  /**
+   * @return The underlying node
+   */
+  const flatjson::Node& getNode() const;
+
+ private:
+  friend class JsonValue;
+  JsonArray(std::shared_ptr<flatjson::Document> doc, flatjson::Node* node)
+      : doc(std::move(doc)), node(node) {}
+
+  flatjson::Node& mutableNode();
+  void reserve(flatjson::Node& n, unsigned size);
+
+  std::shared_ptr<flatjson::Document> doc;  // null while empty
+  flatjson::Node* node = nullptr;
+};
+
+/**
+ * @brief Operator overload for writing to a stream.
+ */
+inline std::ostream& operator<<(std::ostream& os, const JsonValue& val) {
+  os << val.toString();
+  return os;
+}
+
+/**
+ * @brief Operator overload for writing to a stream.
+ */
+inline std::ostream& operator<<(std::ostream& os, const JsonObject& obj) {
+  os << obj.toString();
+  return os;
+}
+
+/**
+ * @brief Operator overload for writing to a stream.
+ */
+inline std::ostream& operator<<(std::ostream& os, const JsonArray& array) {
+  os << array.toString();
+  return os;
+}
+
+#endif  // UTIL_JSON_FLAT_H_
@@ -1,18 +1,51 @@
 #include "Graph.h"
 
+#include <algorithm>
+#include <chrono>  // NOLINT [build/c++11]
+#include <cmath>
+
+#include "util/AllocationStats.h"
+
 using routing::Graph;
 using routing::GraphNode;
 
+Graph::QueryStats Graph::queryStats;
+
 GraphNode::GraphNode(int id, const Vector3& pos) : id(id), position(pos) {}
 
+bool Graph::singlePrecisionByDefault = false;
+
+void Graph::setSinglePrecision(bool enabled) {
+  singlePrecision = enabled;
+  coordinates = Float3Array();
+  coordinateError = 0;
+  if (!enabled) return;
+  coordinates.reserve(nodes.size());
+  for (const GraphNode& node : nodes) addCoordinates(node.getPosition());
+}
+
 void Graph::addNode(const Vector3& pos) {
   nodes.push_back(GraphNode(nodes.size(), pos));
+  if (singlePrecision) addCoordinates(pos);
   adjacencyList.push_back(std::vector<int>());
 }
 
+void Graph::addCoordinates(const Vector3& pos) {
+  coordinates.push_back(pos);
+  // rounding the coordinates and the target to floats, then the
+  // subtractions, squares, sum and root, each err by at most half a unit in
+  // the last place of numbers no bigger than a few times the largest
+  // coordinate. 2^-19 of it is well past all of them together.
+  double largest =
+      std::max({std::abs(pos.x), std::abs(pos.y), std::abs(pos.z)});
+  coordinateError =
+      std::max(coordinateError, static_cast<float>(std::ldexp(largest, -19)));
+}
+
 void Graph::addEdge(int n1, int n2) { adjacencyList[n1].push_back(n2); }
 
 int Graph::nearestNode(const Vector3& pos) const {
+  if (singlePrecision) return kernels::nearest(coordinates, pos);
   int min_i = -1;
   double min_d = INFINITY;
   for (int i = 0; i < nodes.size(); i++) {
@@ -28,10 +61,22 @@ int Graph::nearestNode(const Vector3& pos) const {
 std::optional<std::vector<Vector3>> Graph::getPath(
     const Vector3& start, const Vector3& end,
     const RoutingStrategy& strat) const {
+  // searching the graph allocates; it happens when an entity plans a route
+  AllocationStats::expect();
+  auto begin = std::chrono::steady_clock::now();
   auto n1 = nearestNode(start);
   auto n2 = nearestNode(end);
   auto path = strat.getPath(*this, n1, n2);
-  if (!path.has_value()) return std::nullopt;
+  queryStats.queries.fetch_add(1, std::memory_order_relaxed);
+  queryStats.nanoseconds.fetch_add(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - begin)
+          .count(),
+      std::memory_order_relaxed);
+  if (!path.has_value()) {
+    queryStats.failures.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+  }
   auto v = path.value();
   auto result = std::vector<Vector3>(v.size());
   for (int i = 0; i < v.size(); i++) result[i] = nodes[v[i]].getPosition();
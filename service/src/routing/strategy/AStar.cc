@@ -5,10 +5,13 @@
 #include <queue>
 #include <set>
 
+#include "util/Trace.h"
+
 using routing::AStar;
 
 std::optional<std::vector<int>> AStar::getPath(const Graph& g, int start,
                                                int end) const {
+  TRACE_SCOPE("AStar::getPath");
   struct t {
     double order;
     struct {
@@ -21,6 +24,8 @@ std::optional<std::vector<int>> AStar::getPath(const Graph& g, int start,
   auto q = std::priority_queue<t>();
   auto v = std::set<int>();
   auto parents = std::map<int, int>();
+  const GraphNode& goal = g.nodes[end];
+  std::vector<float> estimates;
   q.push({0, {start, -1, 0}});
   while (!q.empty()) {
     auto [n, p, d] = q.top().info;
@@ -29,11 +34,23 @@ std::optional<std::vector<int>> AStar::getPath(const Graph& g, int start,
     v.insert(n);
     parents[n] = p;
     if (n == end) break;
-    auto n1 = g.nodes[n];
-    for (auto& o : g.adjacencyList[n]) {
-      auto n2 = g.nodes[o];
+    const GraphNode& n1 = g.nodes[n];
+    const std::vector<int>& adjacent = g.adjacencyList[n];
+    bool batched = euclidean && g.isSinglePrecision();
+    if (batched) {
+      estimates.resize(adjacent.size());
+      kernels::distances(g.coordinates, adjacent.data(), adjacent.size(),
+                         goal.getPosition(), estimates.data());
+    }
+    for (size_t i = 0; i < adjacent.size(); i++) {
+      int o = adjacent[i];
+      const GraphNode& n2 = g.nodes[o];
       auto dist = n1.getPosition().dist(n2.getPosition());
-      q.push({d + dist + heuristic(n2, g.nodes[end]), {o, n, d + dist}});
+      // a rounded up estimate could overshoot the real distance and cost
+      // the best path, so it is taken down by as much as it can be off
+      double h = batched ? std::max(0.0f, estimates[i] - g.coordinateError)
+                         : heuristic(n2, goal);
+      q.push({d + dist + h, {o, n, d + dist}});
     }
   }
   auto n = end;
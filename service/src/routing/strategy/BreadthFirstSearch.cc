@@ -5,11 +5,14 @@
 #include <queue>
 #include <set>
 
+#include "util/Trace.h"
+
 using routing::BreadthFirstSearch;
 
 std::optional<std::vector<int>> BreadthFirstSearch::getPath(const Graph& g,
                                                             int start,
                                                             int end) const {
+  TRACE_SCOPE("BreadthFirstSearch::getPath");
   struct t {
     int node;
     int parent;
@@ -5,11 +5,14 @@
 #include <set>
 #include <stack>
 
+#include "util/Trace.h"
+
 using routing::DepthFirstSearch;
 
 std::optional<std::vector<int>> DepthFirstSearch::getPath(const Graph& g,
                                                           int start,
                                                           int end) const {
+  TRACE_SCOPE("DepthFirstSearch::getPath");
   struct t {
     int node;
     int parent;
@@ -1,58 +1,293 @@
 #include "DataCollector.h"
 
+#include <algorithm>
 #include <iomanip>
 
 DataCollector* DataCollector::instance = nullptr;
+thread_local DataCollector* DataCollector::threadInstance = nullptr;
+std::atomic<uint64_t> DataCollector::nextSerial{0};
+thread_local DataCollector::BufferCache DataCollector::bufferCache;
 
 DataCollector& DataCollector::getInstance() {
-  if (instance == nullptr) {
-    instance = new DataCollector();
+  if (threadInstance) return *threadInstance;
+  // created by whichever thread gets here first
+  static DataCollector* shared = instance = new DataCollector();
+  return *shared;
+}
+
+DataCollector::DataCollector()
+    : blocks(new std::atomic<Slot*>[maxBlocks]()), serial(++nextSerial) {}
+
+DataCollector::~DataCollector() {
+  // a thread's own collector is thrown away with its data
+  if (this == instance) outputDataToCSV();
+  clear();
+}
+
+DataCollector::ThreadScope::ThreadScope() : previous(threadInstance) {
+  threadInstance = new DataCollector();
+}
+
+DataCollector::ThreadScope::~ThreadScope() {
+  delete threadInstance;
+  threadInstance = previous;
+}
+
+DataCollector::Slot& DataCollector::slot(int id) {
+  unsigned index = id;
+  if (index >= maxBlocks * blockSize) return discarded;
+  std::atomic<Slot*>& block = blocks[index >> blockBits];
+  Slot* slots = block.load(std::memory_order_acquire);
+  if (!slots) {
+    // threads adding the same block at once keep whichever got in first
+    Slot* added = new Slot[blockSize];
+    if (block.compare_exchange_strong(slots, added,
+                                      std::memory_order_acq_rel)) {
+      slots = added;
+    } else {
+      delete[] added;
+    }
   }
-  return *instance;
+  return slots[index & (blockSize - 1)];
 }
 
-DataCollector::DataCollector() {}
+const DataCollector::Slot* DataCollector::findSlot(int id) const {
+  unsigned index = id;
+  if (index >= maxBlocks * blockSize) return nullptr;
+  const Slot* slots =
+      blocks[index >> blockBits].load(std::memory_order_acquire);
+  return slots ? &slots[index & (blockSize - 1)] : nullptr;
+}
+
+double DataCollector::scheduledAt(const Slot& drone) const {
+  const Slot* package = drone.package >= 0 ? findSlot(drone.package) : nullptr;
+  return package ? package->scheduledAt : -1;
+}
 
-DataCollector::~DataCollector() { outputDataToCSV(); }
+DataCollector::EventBuffer& DataCollector::localBuffer() {
+  if (bufferCache.collector == serial) return *bufferCache.buffer;
+  std::lock_guard<std::mutex> lock(buffersMutex);
+  std::thread::id thread = std::this_thread::get_id();
+  EventBuffer* buffer = nullptr;
+  for (auto& b : buffers) {
+    if (b->thread == thread) buffer = b.get();
+  }
+  if (!buffer) {
+    buffers.push_back(std::make_unique<EventBuffer>());
+    buffer = buffers.back().get();
+    buffer->thread = thread;
+  }
+  bufferCache = {serial, buffer};
+  return *buffer;
+}
+
+void DataCollector::keepEvent(const Event& event) {
+  if (keptEvents.fetch_add(1, std::memory_order_relaxed) >= maxKeptEvents) {
+    keptEvents.fetch_sub(1, std::memory_order_relaxed);
+    unkeptEvents.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  localBuffer().events.push_back(event);
+}
+
+std::map<int, DataCollector::History> DataCollector::histories() const {
+  std::vector<const Event*> events;
+  {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (auto& buffer : buffers) {
+      for (const Event& event : buffer->events) events.push_back(&event);
+    }
+  }
+  std::sort(events.begin(), events.end(), [](const Event* a, const Event* b) {
+    return a->sequence < b->sequence;
+  });
+  std::map<int, History> out;
+  for (const Event* event : events) {
+    History& history = out[event->droneId];
+    if (event->dropoff) {
+      history.dropoffTimes.push_back(event->time);
+      history.dropoffLocations.push_back(event->location);
+    } else {
+      history.pickupTimes.push_back(event->time);
+      history.pickupLocations.push_back(event->location);
+    }
+  }
+  return out;
+}
+
+void DataCollector::clear() {
+  for (unsigned i = 0; i < maxBlocks; i++) {
+    delete[] blocks[i].exchange(nullptr);
+  }
+  queued.clear();
+  pickup.clear();
+  delivery.clear();
+  liveDrones = busyDrones = 0;
+  dispatches = pickups = dropoffs = 0;
+  keptEvents = 0;
+  unkeptEvents = 0;
+  droneSeconds = busySeconds = 0;
+  std::lock_guard<std::mutex> lock(buffersMutex);
+  // threads keep their buffers, just emptied
+  for (auto& buffer : buffers) buffer->events.clear();
+}
+
+bool DataCollector::startExport(const TelemetryExporter::Options& options,
+                                std::string& error) {
+  auto opened = std::make_unique<TelemetryExporter>();
+  if (!opened->open(options, error)) return false;
+  exporter = std::move(opened);
+  return true;
+}
+
+void DataCollector::stopExport() {
+  if (exporter) exporter->close();
+  exporter.reset();
+}
+
+void DataCollector::flush(double time, double dt, FleetSchedule& fleet) {
+  // every simulation flushes its own ticks, so their clocks, which start
+  // over on a reset and jump on loading a checkpoint, are never compared
+  if (dt > 0) {
+    droneSeconds += liveDrones * dt;
+    busySeconds += busyDrones * dt;
+  }
+
+  if (!exporter) return;
+  bool merged;
+  {
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    merged = buffers.size() > 1;
+    for (auto& buffer : buffers) {
+      for (const Event& e : buffer->events) {
+        exportRows.push_back(
+            {e.sequence, e.simTime < 0 ? time : e.simTime, e.time,
+             e.droneId, e.dropoff, e.location});
+      }
+      buffer->events.clear();
+    }
+    keptEvents = 0;
+  }
+  if (merged) {
+    std::sort(exportRows.begin(), exportRows.end(),
+              [](const auto& a, const auto& b) {
+                return a.sequence < b.sequence;
+              });
+  }
+  if (time < fleet.last) fleet.next = time;
+  TelemetryExporter::FleetRow row;
+  bool fleetDue = time >= fleet.next;
+  if (fleetDue) {
+    row = fleetRow(time);
+    fleet.next = time + exporter->getOptions().fleetInterval;
+    fleet.last = time;
+  }
+  exporter->push(exportRows, fleetDue ? &row : nullptr);
+}
+
+TelemetryExporter::FleetRow DataCollector::fleetRow(double time) const {
+  TelemetryExporter::FleetRow row{time, 0, 0, 0, 0};
+  for (unsigned b = 0; b < maxBlocks; b++) {
+    const Slot* slots = blocks[b].load(std::memory_order_acquire);
+    for (unsigned i = 0; slots && i < blockSize; i++) {
+      const Slot& data = slots[i];
+      if (!data.drone) continue;
+      row.drones++;
+      row.busy += data.numDeliveries > data.completed;
+      row.deliveries += data.completed;
+      row.distance += data.totalDistance;
+    }
+  }
+  return row;
+}
+
+DataCollector::Stats DataCollector::getStats() const {
+  Stats stats;
+  stats.queued = queued.summarize();
+  stats.pickup = pickup.summarize();
+  stats.delivery = delivery.summarize();
+  stats.drones = liveDrones;
+  stats.busy = busyDrones;
+  stats.dispatched = dispatches.load(std::memory_order_relaxed);
+  stats.pickups = pickups.load(std::memory_order_relaxed);
+  stats.deliveries = dropoffs.load(std::memory_order_relaxed);
+  stats.utilization = droneSeconds > 0 ? busySeconds / droneSeconds : 0;
+  stats.unkeptEvents = unkeptEvents.load(std::memory_order_relaxed);
+  stats.unexported = exporter ? exporter->getDropped() : 0;
+  return stats;
+}
 
 void DataCollector::recordDroneSpeed(int droneId, double speed) {
-  DroneData& data = droneDataMap[droneId];
-  data.totalSpeed += speed;
+  slot(droneId).totalSpeed += speed;
 }
 
 void DataCollector::recordDroneMileage(int droneId, double mileage) {
-  if (droneDataMap[droneId].numDeliveries > 0) {
-    droneDataMap[droneId].totalMileage += mileage;
-    droneDataMap[droneId].totalDistance += mileage;
+  Slot& data = slot(droneId);
+  if (data.numDeliveries > 0) {
+    data.totalMileage += mileage;
+    data.totalDistance += mileage;
   }
 }
 
-void DataCollector::startDelivery(int droneId) {
-  if (droneDataMap.find(droneId) == droneDataMap.end()) {
-    droneDataMap[droneId] = {0, 0, 0};
-  }
+void DataCollector::recordScheduled(int packageId, double time) {
+  slot(packageId).scheduledAt = time;
+}
 
-  droneDataMap[droneId].numDeliveries++;
+double DataCollector::getScheduledTime(int packageId) const {
+  const Slot* package = findSlot(packageId);
+  return package ? package->scheduledAt : -1;
+}
+
+void DataCollector::startDelivery(int droneId, int packageId, double time) {
+  Slot& data = slot(droneId);
+  if (data.live && data.numDeliveries == data.completed) busyDrones++;
+  data.numDeliveries++;
+  dispatches.fetch_add(1, std::memory_order_relaxed);
+  data.package = packageId;
+  if (double scheduled = scheduledAt(data); scheduled >= 0) {
+    queued.record(time - scheduled);
+  }
 }
 
 void DataCollector::startDeliveryTimer(int droneId) {
-  deliveryStartTimes[droneId] = std::time(nullptr);
+  Slot& data = slot(droneId);
+  data.deliveryStart = std::time(nullptr);
+  data.timed = true;
 }
 
 void DataCollector::recordDeliveryTime(int droneId, double time) {
-  droneDataMap[droneId].totalTimeTaken += time;
+  slot(droneId).totalTimeTaken += time;
 }
 
 std::time_t DataCollector::getDeliveryStartTime(int droneId) {
-  return deliveryStartTimes[droneId];
+  const Slot* data = findSlot(droneId);
+  return data ? data->deliveryStart : 0;
 }
 
-void DataCollector::recordPickupTime(int droneId, const std::time_t& time) {
-  droneDataMap[droneId].pickupTimes.push_back(time);
+void DataCollector::recordPickup(int droneId, std::time_t time,
+                                 const Vector3& location, double simTime) {
+  if (double scheduled = scheduledAt(slot(droneId)); scheduled >= 0) {
+    pickup.record(simTime - scheduled);
+  }
+  pickups.fetch_add(1, std::memory_order_relaxed);
+  keepEvent({nextEvent.fetch_add(1, std::memory_order_relaxed), droneId, false,
+             time, simTime, location});
 }
 
-void DataCollector::recordDropoffTime(int droneId, const std::time_t& time) {
-  droneDataMap[droneId].dropoffTimes.push_back(time);
+void DataCollector::recordDropoff(int droneId, std::time_t time,
+                                  const Vector3& location, double simTime) {
+  Slot& data = slot(droneId);
+  data.completed++;
+  dropoffs.fetch_add(1, std::memory_order_relaxed);
+  if (data.live && data.numDeliveries == data.completed) busyDrones--;
+  if (double scheduled = scheduledAt(data); scheduled >= 0) {
+    delivery.record(simTime - scheduled);
+    // the package is done with; only the drone delivering it writes here
+    slot(data.package).scheduledAt = -1;
+  }
+  data.package = -1;
+  keepEvent({nextEvent.fetch_add(1, std::memory_order_relaxed), droneId, true,
+             time, simTime, location});
 }
 
 std::string DataCollector::formatTime(const std::time_t& time) {
@@ -61,32 +296,143 @@ std::string DataCollector::formatTime(const std::time_t& time) {
   return std::string(buffer);
 }
 
-void DataCollector::recordPickupLocation(int droneId, const Vector3& location) {
-  droneDataMap[droneId].pickupLocations.push_back(location);
+void DataCollector::recordDrone(int droneId) {
+  Slot& data = slot(droneId);
+  data.drone = true;
+  if (!data.live) {
+    data.live = true;
+    liveDrones++;
+    if (data.numDeliveries > data.completed) busyDrones++;
+  }
+}
+
+void DataCollector::recordRemoved(int id) {
+  const Slot* found = findSlot(id);
+  if (!found || !found->live) return;
+  Slot& data = slot(id);
+  data.live = false;
+  liveDrones--;
+  if (data.numDeliveries > data.completed) busyDrones--;
 }
 
-void DataCollector::recordDropoffLocation(int droneId,
-                                          const Vector3& location) {
-  droneDataMap[droneId].dropoffLocations.push_back(location);
+void DataCollector::recordRobotSpawnLocation(int robotId,
+                                             const Vector3& location) {
+  Slot& data = slot(robotId);
+  data.robot = true;
+  data.spawnLocation = location;
 }
 
-void DataCollector::recordDrone(int droneId) {
-  if (droneDataMap.find(droneId) == droneDataMap.end()) {
-    DroneData data = {0, 0, 0, 0, 0, {}, {}, {}, {}};
-    droneDataMap[droneId] = data;
+void DataCollector::save(CheckpointWriter& writer) const {
+  // written as one list per kind of data, as when they were kept in maps
+  std::map<int, History> history = histories();
+  std::vector<int> drones, timed, robots;
+  for (unsigned b = 0; b < maxBlocks; b++) {
+    const Slot* slots = blocks[b].load(std::memory_order_acquire);
+    if (!slots) continue;
+    for (unsigned i = 0; i < blockSize; i++) {
+      int id = b * blockSize + i;
+      if (slots[i].drone) drones.push_back(id);
+      if (slots[i].timed) timed.push_back(id);
+      if (slots[i].robot) robots.push_back(id);
+    }
+  }
+  writer.write(static_cast<uint64_t>(drones.size()));
+  for (int id : drones) {
+    const Slot& data = *findSlot(id);
+    const History& events = history[id];
+    writer.write(id);
+    writer.write(data.totalSpeed);
+    writer.write(data.totalMileage);
+    writer.write(data.numDeliveries);
+    writer.write(data.totalDistance);
+    writer.write(data.totalTimeTaken);
+    writer.writeArray(events.pickupTimes.data(), events.pickupTimes.size());
+    writer.writeArray(events.dropoffTimes.data(), events.dropoffTimes.size());
+    writer.writeArray(events.pickupLocations.data(),
+                      events.pickupLocations.size());
+    writer.writeArray(events.dropoffLocations.data(),
+                      events.dropoffLocations.size());
+  }
+  writer.write(static_cast<uint64_t>(timed.size()));
+  for (int id : timed) {
+    writer.write(id);
+    writer.write(findSlot(id)->deliveryStart);
+  }
+  writer.write(static_cast<uint64_t>(robots.size()));
+  for (int id : robots) {
+    writer.write(id);
+    writer.write(findSlot(id)->spawnLocation);
   }
 }
 
-void DataCollector::recordRobotSpawnLocation(int robotId,
-                                             const Vector3& location) {
-  robotDataMap[robotId].spawnLocation = location;
+bool DataCollector::load(CheckpointReader& reader) {
+  clear();
+  bool inRange = true;
+  auto at = [&](int id) -> Slot& {
+    if (unsigned(id) < maxBlocks * blockSize) return slot(id);
+    inRange = false;
+    return discarded;
+  };
+  EventBuffer& buffer = localBuffer();
+  History history;
+  // counts are checked against what is left as they are read, so a bad one
+  // ends the loop instead of running on
+  for (uint64_t n = reader.read<uint64_t>(); n > 0 && reader.ok(); n--) {
+    int id = reader.read<int>();
+    Slot& data = at(id);
+    data.drone = true;
+    data.totalSpeed = reader.read<double>();
+    data.totalMileage = reader.read<double>();
+    data.numDeliveries = reader.read<int>();
+    dispatches += std::max(data.numDeliveries, 0);
+    data.totalDistance = reader.read<double>();
+    data.totalTimeTaken = reader.read<double>();
+    reader.readArray(history.pickupTimes);
+    reader.readArray(history.dropoffTimes);
+    reader.readArray(history.pickupLocations);
+    reader.readArray(history.dropoffLocations);
+    size_t pickups = std::min(history.pickupTimes.size(),
+                              history.pickupLocations.size());
+    this->pickups += pickups;
+    for (size_t i = 0; i < pickups; i++) {
+      buffer.events.push_back({nextEvent++, id, false, history.pickupTimes[i],
+                               -1, history.pickupLocations[i]});
+    }
+    size_t dropoffs = std::min(history.dropoffTimes.size(),
+                               history.dropoffLocations.size());
+    data.completed = dropoffs;
+    this->dropoffs += dropoffs;
+    for (size_t i = 0; i < dropoffs; i++) {
+      buffer.events.push_back({nextEvent++, id, true, history.dropoffTimes[i],
+                               -1, history.dropoffLocations[i]});
+    }
+  }
+  for (uint64_t n = reader.read<uint64_t>(); n > 0 && reader.ok(); n--) {
+    int id = reader.read<int>();
+    Slot& data = at(id);
+    data.deliveryStart = reader.read<std::time_t>();
+    data.timed = true;
+  }
+  for (uint64_t n = reader.read<uint64_t>(); n > 0 && reader.ok(); n--) {
+    int id = reader.read<int>();
+    Slot& data = at(id);
+    data.robot = true;
+    data.spawnLocation = reader.read<Vector3>();
+  }
+  keptEvents = buffer.events.size();
+  return reader.ok() && inRange;
 }
 
 void DataCollector::outputMoreDataToCSV() {
   std::ofstream file("more_data.csv");
   file << "Robot ID,  Spawn Location\n";
-  for (const auto& entry : robotDataMap) {
-    file << entry.first << " " << entry.second.spawnLocation.toString() << "\n";
+  for (unsigned b = 0; b < maxBlocks; b++) {
+    const Slot* slots = blocks[b].load(std::memory_order_acquire);
+    for (unsigned i = 0; slots && i < blockSize; i++) {
+      if (!slots[i].robot) continue;
+      file << b * blockSize + i << " " << slots[i].spawnLocation.toString()
+           << "\n";
+    }
   }
   file.close();
 }
@@ -94,9 +440,16 @@ void DataCollector::outputMoreDataToCSV() {
 void DataCollector::outputDataToCSV() {
   std::ofstream file("drone_data.csv");
 
+  std::map<int, History> history = histories();
+  std::vector<int> drones;
   int maxDeliveries = 0;
-  for (const auto& entry : droneDataMap) {
-    maxDeliveries = std::max(maxDeliveries, entry.second.numDeliveries);
+  for (unsigned b = 0; b < maxBlocks; b++) {
+    const Slot* slots = blocks[b].load(std::memory_order_acquire);
+    for (unsigned i = 0; slots && i < blockSize; i++) {
+      if (!slots[i].drone) continue;
+      drones.push_back(b * blockSize + i);
+      maxDeliveries = std::max(maxDeliveries, slots[i].numDeliveries);
+    }
   }
 
   std::vector<std::string> headers = {"Serial Number",  "Drone ID",
@@ -111,21 +464,25 @@ void DataCollector::outputDataToCSV() {
   writeCSVLine(file, headers);
 
   int serialNumber = 1;
-  for (const auto& entry : droneDataMap) {
-    const DroneData& droneData = entry.second;
+  for (int id : drones) {
+    const Slot& droneData = *findSlot(id);
+    const History& events = history[id];
     std::vector<std::string> lineData = {
         std::to_string(serialNumber++),
-        std::to_string(entry.first),
+        std::to_string(id),
         std::to_string(droneData.totalSpeed / droneData.numDeliveries),
         std::to_string(droneData.numDeliveries),
         std::to_string(droneData.totalDistance),
         std::to_string(droneData.totalTimeTaken)};
 
+    // a delivery still under way has no drop-off yet
     for (size_t i = 0; i < droneData.numDeliveries; ++i) {
-      lineData.push_back(formatTime(droneData.pickupTimes[i]));
-      lineData.push_back(formatTime(droneData.dropoffTimes[i]));
-      lineData.push_back(droneData.pickupLocations[i].toString());
-      lineData.push_back(droneData.dropoffLocations[i].toString());
+      bool picked = i < events.pickupTimes.size();
+      bool dropped = i < events.dropoffTimes.size();
+      lineData.push_back(picked ? formatTime(events.pickupTimes[i]) : "");
+      lineData.push_back(dropped ? formatTime(events.dropoffTimes[i]) : "");
+      lineData.push_back(picked ? events.pickupLocations[i].toString() : "");
+      lineData.push_back(dropped ? events.dropoffLocations[i].toString() : "");
     }
 
     writeCSVLine(file, lineData);
@@ -1,21 +1,40 @@
 #include "SimulationCaretaker.h"
 
+size_t SimulationCaretaker::defaultMemoryLimit = 256 << 20;
+
 void SimulationCaretaker::saveState(SimulationMemento* memento) {
-  mementos.push(memento);
+  mementos.push_back(memento);
+  memoryUsed += memento->memoryUsage();
+  trim();
 }
 
 SimulationMemento* SimulationCaretaker::restoreState() {
   if (!mementos.empty()) {
-    SimulationMemento* memento = mementos.top();
-    mementos.pop();
+    SimulationMemento* memento = mementos.back();
+    mementos.pop_back();
+    memoryUsed -= memento->memoryUsage();
     return memento;
   }
   return nullptr;
 }
 void SimulationCaretaker::clear() {
   while (!mementos.empty()) {
-    delete mementos.top();
-    mementos.pop();
+    delete mementos.back();
+    mementos.pop_back();
+  }
+  memoryUsed = 0;
+}
+
+void SimulationCaretaker::setMemoryLimit(size_t bytes) {
+  memoryLimit = bytes;
+  trim();
+}
+
+void SimulationCaretaker::trim() {
+  while (mementos.size() > 1 && memoryUsed > memoryLimit) {
+    memoryUsed -= mementos.front()->memoryUsage();
+    delete mementos.front();
+    mementos.pop_front();
   }
 }
 SimulationCaretaker::~SimulationCaretaker() { this->clear(); }
@@ -0,0 +1,54 @@
+#include "SimulationFork.h"
+
+#include <chrono>  // NOLINT [build/c++11]
+#include <cmath>
+
+#include "DataCollector.h"
+#include "Package.h"
+
+SimulationFork::SimulationFork(const SimulationModel& model)
+    : model(model.fork(*this)) {
+  const DataCollector& data = DataCollector::getInstance();
+  for (const Package* package : this->model->scheduledDeliveries) {
+    scheduled.emplace_back(package->getId(),
+                           data.getScheduledTime(package->getId()));
+  }
+}
+
+SimulationFork::~SimulationFork() {
+  if (thread.joinable()) thread.join();
+}
+
+void SimulationFork::start(double seconds, double step,
+                           std::function<void()> finished) {
+  thread = std::thread([this, seconds, step, finished] {
+    // drone data of the fork stays with the fork
+    DataCollector::ThreadScope scope;
+    DataCollector& data = DataCollector::getInstance();
+    for (auto [package, time] : scheduled) data.recordScheduled(package, time);
+    auto begin = std::chrono::steady_clock::now();
+    int ticks = std::ceil(seconds / step);
+    int ran = 0;
+    while (ran < ticks && !cancelled.load(std::memory_order_relaxed)) {
+      model->update(step);
+      ran++;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - begin;
+    metrics.ticks = ran;
+    metrics.simulatedTime = ran * step;
+    metrics.wallTime = elapsed.count();
+    metrics.pending = model->scheduledDeliveries.size();
+    DataCollector::Stats stats = data.getStats();
+    metrics.dispatched = stats.dispatched;
+    metrics.pickups = stats.pickups;
+    metrics.deliveries = stats.deliveries;
+    metrics.latency = stats.delivery;
+    if (finished) finished();
+  });
+}
+
+const SimulationFork::Metrics& SimulationFork::join() {
+  if (thread.joinable()) thread.join();
+  return metrics;
+}
@@ -1,10 +1,4 @@
 #include "SimulationMemento.h"
 
-SimulationMemento::SimulationMemento(std::vector<const JsonObject*>& obj)
-    : objects(obj) {}
-
-SimulationMemento::~SimulationMemento() {
-  for (const JsonObject* object : objects) {
-    delete object;
-  }
-}
+SimulationMemento::SimulationMemento(Snapshot&& snapshot)
+    : snapshot(std::move(snapshot)) {}
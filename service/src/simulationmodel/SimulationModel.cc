@@ -1,11 +1,30 @@
 #include "SimulationModel.h"
 
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
 #include "DataCollector.h"
 #include "DroneFactory.h"
 #include "HelicopterFactory.h"
 #include "HumanFactory.h"
+#include "OBJParser.h"
 #include "PackageFactory.h"
 #include "RobotFactory.h"
+#include "util/Checkpoint.h"
+#include "util/Trace.h"
+
+namespace {
+
+constexpr uint32_t metaSection = checkpoint::tag("META");
+constexpr uint32_t templateSection = checkpoint::tag("TMPL");
+constexpr uint32_t entitySection = checkpoint::tag("ENTS");
+constexpr uint32_t snapshotSection = checkpoint::tag("SNAP");
+constexpr uint32_t deliverySection = checkpoint::tag("DELV");
+constexpr uint32_t tripSection = checkpoint::tag("TRIP");
+constexpr uint32_t dataSection = checkpoint::tag("DATA");
+
+}  // namespace
 
 SimulationModel::SimulationModel(IController& controller)
     : controller(controller) {
@@ -20,7 +39,6 @@ SimulationModel::~SimulationModel() {
   for (auto& [id, entity] : entities) {
     delete entity;
   }
-  delete graph;
 }
 
 IEntity* SimulationModel::createEntity(const JsonObject& entity) {
@@ -29,10 +47,11 @@ IEntity* SimulationModel::createEntity(const JsonObject& entity) {
   std::cout << name << ": " << position << std::endl;
 
   IEntity* myNewEntity = nullptr;
-  if (myNewEntity = entityFactory.createEntity(entity)) {
+  if (myNewEntity = entityFactory.createEntity(entity, &arena)) {
     myNewEntity->linkModel(this);
     controller.addEntity(*myNewEntity);
     entities[myNewEntity->getId()] = myNewEntity;
+    entityCounts[std::string(entity["type"])]++;
     myNewEntity->addObserver(this);
   }
 
@@ -42,8 +61,14 @@ IEntity* SimulationModel::createEntity(const JsonObject& entity) {
 void SimulationModel::removeEntity(int id) { removed.insert(id); }
 
 void SimulationModel::resetSimulation() {
+  // cleared first, so it doesn't keep the entities being removed
+  timeline.clear();
   this->removeAllEntities();
+  scheduledDeliveries.clear();
   caretaker.clear();
+  time = 0;
+  // nothing allocated from the arena is left
+  arena.release();
 }
 void SimulationModel::removeAllEntities() {
   std::set<int> entityIds;
@@ -94,28 +119,44 @@ void SimulationModel::scheduleTrip(const JsonObject& details) {
     std::string strategyName = details["search"];
     package->setStrategyName(strategyName);
     scheduledDeliveries.push_back(package);
+    DataCollector::getInstance().recordScheduled(package->getId(), time);
     controller.sendEventToView("DeliveryScheduled", details);
   }
 
-  trips.push_back(new JsonObject(details));
+  // forks share the list until one side adds to it
+  if (trips.use_count() > 1) {
+    trips = std::make_shared<std::vector<JsonObject>>(*trips);
+  }
+  trips->push_back(details);
 }
 
-const routing::Graph* SimulationModel::getGraph() const { return graph; }
+const routing::Graph* SimulationModel::getGraph() const { return graph.get(); }
 
-void SimulationModel::setGraph(const routing::Graph* graph) {
-  if (this->graph) delete this->graph;
-  this->graph = graph;
+void SimulationModel::setGraph(const routing::Graph* graph,
+                               const std::string& source) {
+  this->graph.reset(graph);
+  graphSource = source;
 }
 
 void SimulationModel::update(double dt) {
-  for (auto& [id, entity] : entities) {
-    entity->update(dt);
-    controller.updateEntity(*entity);
+  TRACE_SCOPE("SimulationModel::update");
+  time += dt;
+  {
+    TRACE_SCOPE("update entities");
+    for (auto& [id, entity] : entities) {
+      entity->update(dt);
+      controller.updateEntity(*entity);
+    }
   }
-  for (int id : removed) {
-    removeFromSim(id);
+  {
+    TRACE_SCOPE("remove entities");
+    for (int id : removed) {
+      removeFromSim(id);
+    }
+    removed.clear();
   }
-  removed.clear();
+  TRACE_SCOPE("DataCollector::flush");
+  DataCollector::getInstance().flush(time, dt, fleetSchedule);
 }
 
 void SimulationModel::removeFromSim(int id) {
@@ -129,7 +170,18 @@ void SimulationModel::removeFromSim(int id) {
       }
     }
     controller.removeEntity(*entity);
+    // only an entity that was there in a recorded tick can be sought back
+    if (timeline.getEndTick() > 0) {
+      timeline.entityRemoved(id, creationDetails(*entity));
+    }
     entities.erase(id);
+    const JsonObject& details = entity->getDetails();
+    auto count = entityCounts.find(
+        details.contains("type") ? std::string(details["type"]) : "");
+    if (count != entityCounts.end() && --count->second == 0) {
+      entityCounts.erase(count);
+    }
+    DataCollector::getInstance().recordRemoved(id);
     delete entity;
   }
 }
@@ -141,47 +193,335 @@ void SimulationModel::notify(const std::string& message) const {
 }
 
 void SimulationModel::saveSimulationState() {
-  std::vector<const JsonObject*> objects;
+  Snapshot snapshot;
+  snapshot.records.reserve(entities.size());
+  SnapshotWriter writer(snapshot);
   for (auto& [id, entity] : entities) {
-    objects.push_back(new JsonObject(entity->toJson()));
+    writer.beginRecord(id);
+    entity->save(writer);
   }
-  SimulationMemento* memento = new SimulationMemento(objects);
-  caretaker.saveState(memento);
+  caretaker.saveState(new SimulationMemento(std::move(snapshot)));
 }
 
 void SimulationModel::restoreSimulationState() {
   SimulationMemento* memento = caretaker.restoreState();
-  if (memento) {
-    std::set<int> mementoIds;
-    for (const JsonObject* obj : memento->getObjects()) {
-      int objid = (*obj)["id"];
-      mementoIds.insert(objid);
+  if (!memento) return;
+  restoreSnapshot(memento->getSnapshot(), false);
+  delete memento;
+}
+
+std::unique_ptr<SimulationModel> SimulationModel::fork(
+    IController& controller) const {
+  auto copy = std::make_unique<SimulationModel>(controller);
+  copy->graph = graph;
+  copy->graphSource = graphSource;
+  copy->time = time;
+  copy->trips = trips;
+  copy->entityCounts = entityCounts;
+  copy->removed = removed;
+  copy->timeline.setEnabled(false);
+
+  // copy every entity first, then point references at the copies
+  std::vector<IEntity*> byId(entities.empty() ? 0
+                                              : entities.rbegin()->first + 1);
+  for (auto& [id, entity] : entities) {
+    IEntity* clone = entity->clone(&copy->arena);
+    clone->addObserver(copy.get());
+    clone->linkModel(copy.get());
+    copy->entities.emplace_hint(copy->entities.end(), id, clone);
+    byId[id] = clone;
+  }
+  for (auto& [id, entity] : copy->entities) entity->relink(byId);
+  for (Package* package : scheduledDeliveries) {
+    copy->scheduledDeliveries.push_back(
+        static_cast<Package*>(byId[package->getId()]));
+  }
+  return copy;
+}
+
+void SimulationModel::recordTick() {
+  if (!timeline.isEnabled()) return;
+  SnapshotWriter& writer = timeline.beginTick();
+  for (auto& [id, entity] : entities) {
+    writer.beginRecord(id);
+    entity->save(writer);
+  }
+  timeline.recordTick(time);
+}
+
+bool SimulationModel::seekSimulation(uint64_t tick, std::string& error) {
+  double tickTime;
+  if (!timeline.reconstruct(tick, sought, tickTime, error)) return false;
+  restoreSnapshot(sought, true);
+  timeline.seek(tick);
+  time = tickTime;
+  return true;
+}
+
+void SimulationModel::restoreSnapshot(const Snapshot& snapshot,
+                                      bool recreate) {
+  // entities that still exist, by id. ids are handed out in order, so the
+  // table is about as long as the entity map.
+  int idCount = entities.empty() ? 0 : entities.rbegin()->first + 1;
+  if (recreate && !snapshot.records.empty()) {
+    idCount = std::max(idCount, snapshot.records.back().id + 1);
+  }
+  std::vector<IEntity*> byId(idCount);
+  for (auto& [id, entity] : entities) byId[id] = entity;
+
+  // entities created since the snapshot are removed
+  std::vector<bool> saved(byId.size());
+  for (const Snapshot::Record& record : snapshot.records) {
+    if (record.id < saved.size()) saved[record.id] = true;
+  }
+  for (int id = 0; id < byId.size(); id++) {
+    if (byId[id] && !saved[id]) {
+      removeFromSim(id);
+      byId[id] = nullptr;
     }
+  }
 
-    std::vector<int> idsToRemove;
-    for (auto& [id, entity] : entities) {
-      if (mementoIds.find(id) == mementoIds.end()) {
-        idsToRemove.push_back(id);
-      }
+  // and those removed since then come back under their old ids
+  if (recreate) {
+    for (const Snapshot::Record& record : snapshot.records) {
+      if (byId[record.id]) continue;
+      const JsonObject* details = timeline.getCreationDetails(record.id);
+      if (!details) continue;
+      IEntity::reuseId(record.id);
+      byId[record.id] = createEntity(*details);
     }
+  }
 
-    for (int id : idsToRemove) {
-      removeFromSim(id);
+  // each entity's own state first, then the references between them
+  SnapshotLinks links;
+  for (const Snapshot::Record& record : snapshot.records) {
+    if (record.id >= byId.size() || !byId[record.id]) continue;
+    SnapshotReader reader(snapshot, record, links);
+    byId[record.id]->load(reader);
+  }
+  links.resolve(byId);
+}
+
+JsonObject SimulationModel::creationDetails(const IEntity& entity) const {
+  JsonObject details = entity.getDetails();
+  Vector3 pos = entity.getPosition();
+  Vector3 dir = entity.getDirection();
+  details["name"] = entity.getName();
+  details["position"] = JsonArray{pos.x, pos.y, pos.z};
+  details["direction"] = JsonArray{dir.x, dir.y, dir.z};
+  if (const Package* p = dynamic_cast<const Package*>(&entity)) {
+    details["colors"] = p->getColorChain();
+  }
+  return details;
+}
+
+bool SimulationModel::saveCheckpoint(const std::string& path,
+                                     std::string& error) const {
+  CheckpointWriter writer;
+  writer.beginSection(metaSection);
+  writer.write(time);
+  writer.write(IEntity::getCurrentId());
+  writer.writeString(graphSource);
+
+  // entities share templates, each is written once
+  std::unordered_map<int, uint32_t> templates;
+  std::vector<const std::string*> texts;
+  for (auto& [id, entity] : entities) {
+    auto [it, added] =
+        templates.try_emplace(entity->getDetailsId(), templates.size());
+    if (added) texts.push_back(&entity->getDetailsText());
+  }
+  writer.beginSection(templateSection);
+  writer.write(static_cast<uint64_t>(texts.size()));
+  for (const std::string* text : texts) writer.writeString(*text);
+  writer.beginSection(entitySection);
+  writer.write(static_cast<uint64_t>(entities.size()));
+  for (auto& [id, entity] : entities) {
+    writer.write(id);
+    writer.write(templates[entity->getDetailsId()]);
+    writer.writeString(entity->getName());
+    writer.write(entity->getPosition());
+    const Package* p = dynamic_cast<const Package*>(entity);
+    writer.writeString(p ? p->getColorChain() : std::string());
+  }
+
+  // everything else about the entities is in their snapshot records
+  Snapshot snapshot;
+  snapshot.records.reserve(entities.size());
+  SnapshotWriter records(snapshot);
+  for (auto& [id, entity] : entities) {
+    records.beginRecord(id);
+    entity->save(records);
+  }
+  writer.beginSection(snapshotSection);
+  writer.write(static_cast<uint64_t>(snapshot.strings.size()));
+  for (const std::string& s : snapshot.strings) writer.writeString(s);
+  writer.writeArray(snapshot.records.data(), snapshot.records.size());
+  writer.writeArray(snapshot.data.data(), snapshot.data.size());
+
+  std::vector<int> scheduled;
+  for (const Package* p : scheduledDeliveries) scheduled.push_back(p->getId());
+  writer.beginSection(deliverySection);
+  writer.writeArray(scheduled.data(), scheduled.size());
+
+  writer.beginSection(tripSection);
+  writer.write(static_cast<uint64_t>(trips->size()));
+  for (const JsonObject& trip : *trips) writer.writeString(trip.toString());
+
+  writer.beginSection(dataSection);
+  DataCollector::getInstance().save(writer);
+  return writer.save(path, error);
+}
+
+bool SimulationModel::loadCheckpoint(const std::string& path,
+                                     std::string& error) {
+  CheckpointFile file;
+  if (!file.open(path, error)) return false;
+  CheckpointReader meta, templates, list, records, delivery, trip, data;
+  if (!file.section(metaSection, meta) ||
+      !file.section(templateSection, templates) ||
+      !file.section(entitySection, list) ||
+      !file.section(snapshotSection, records) ||
+      !file.section(deliverySection, delivery) ||
+      !file.section(tripSection, trip) ||
+      !file.section(dataSection, data)) {
+    error = path + " is missing a section";
+    return false;
+  }
+
+  // everything is read and checked before the simulation is touched
+  double savedTime = meta.read<double>();
+  int nextId = meta.read<int>();
+  std::string savedGraph(meta.readString());
+
+  std::vector<JsonObject> details;
+  for (uint64_t n = templates.read<uint64_t>(); n > 0; n--) {
+    std::string_view text = templates.readString();
+    if (!templates.ok() || !JsonObject::parse(text, details.emplace_back())) {
+      error = path + " has a bad entity template";
+      return false;
     }
+  }
 
-    for (const JsonObject* obj : memento->getObjects()) {
-      int objid = (*obj)["id"];
-      if (entities.find(objid) != entities.end()) {
-        entities[objid]->fromJson(*obj);
-      }
+  struct Created {
+    int id;
+    uint32_t details;
+    std::string_view name;
+    Vector3 position;
+    std::string_view colors;
+  };
+  std::vector<Created> created;
+  for (uint64_t n = list.read<uint64_t>(); n > 0 && list.ok(); n--) {
+    Created& c = created.emplace_back();
+    c.id = list.read<int>();
+    c.details = list.read<uint32_t>();
+    c.name = list.readString();
+    c.position = list.read<Vector3>();
+    c.colors = list.readString();
+    if (c.id < 0 || c.details >= details.size()) {
+      error = path + " has a bad entity";
+      return false;
     }
-    delete memento;
   }
+
+  std::vector<std::string> strings;
+  for (uint64_t n = records.read<uint64_t>(); n > 0 && records.ok(); n--) {
+    strings.emplace_back(records.readString());
+  }
+  size_t recordCount, dataSize;
+  const char* recordBytes = records.readSpan<Snapshot::Record>(recordCount);
+  const char* recordData = records.readSpan<char>(dataSize);
+
+  std::vector<int> scheduled;
+  delivery.readArray(scheduled);
+
+  std::vector<JsonObject> savedTrips;
+  for (uint64_t n = trip.read<uint64_t>(); n > 0 && trip.ok(); n--) {
+    std::string_view text = trip.readString();
+    if (!trip.ok() || !JsonObject::parse(text, savedTrips.emplace_back())) {
+      error = path + " has a bad trip";
+      return false;
+    }
+  }
+
+  if (!meta.ok() || !list.ok() || !records.ok() || !delivery.ok()) {
+    error = path + " is cut short";
+    return false;
+  }
+  for (size_t i = 0; i < recordCount; i++) {
+    Snapshot::Record record;
+    std::memcpy(&record, recordBytes + i * sizeof(record), sizeof(record));
+    if (record.id < 0 || record.offset > dataSize) {
+      error = path + " has a bad entity record";
+      return false;
+    }
+  }
+
+  // from here on the checkpoint replaces the simulation
+  resetSimulation();
+  if (!savedGraph.empty() && savedGraph != graphSource) {
+    setGraph(routing::OBJGraphParser(savedGraph), savedGraph);
+  }
+
+  int idCount = 0;
+  for (const Created& c : created) idCount = std::max(idCount, c.id + 1);
+  std::vector<IEntity*> byId(idCount);
+  for (const Created& c : created) {
+    JsonObject entity = details[c.details];
+    entity["name"] = std::string(c.name);
+    entity["position"] = JsonArray{c.position.x, c.position.y, c.position.z};
+    if (!c.colors.empty()) entity["colors"] = std::string(c.colors);
+    IEntity::reuseId(c.id);
+    byId[c.id] = createEntity(entity);
+  }
+  IEntity::resetCurrentId(nextId);
+
+  // a record running past the data leaves nothing half loaded behind
+  SnapshotLinks links;
+  for (size_t i = 0; i < recordCount; i++) {
+    Snapshot::Record record;
+    std::memcpy(&record, recordBytes + i * sizeof(record), sizeof(record));
+    if (record.id >= byId.size() || !byId[record.id]) continue;
+    SnapshotReader reader(recordData + record.offset, recordData + dataSize,
+                          strings, links);
+    byId[record.id]->load(reader);
+    if (!reader.ok()) {
+      resetSimulation();
+      error = path + " has a bad entity record";
+      return false;
+    }
+  }
+  links.resolve(byId);
+
+  for (int id : scheduled) {
+    Package* p = dynamic_cast<Package*>(getEntity(id));
+    if (p) scheduledDeliveries.push_back(p);
+  }
+  trips = std::make_shared<std::vector<JsonObject>>(std::move(savedTrips));
+  if (!DataCollector::getInstance().load(data)) {
+    std::cerr << path << ": collected data is cut short" << std::endl;
+  }
+  // the loaded data knows the drones, not which of them are here now
+  for (auto& [id, entity] : entities) {
+    if (dynamic_cast<Drone*>(entity)) {
+      DataCollector::getInstance().recordDrone(id);
+    }
+  }
+  time = savedTime;
+  return true;
 }
 
-std::map<int, IEntity*> SimulationModel::getEntities() { return entities; }
+const std::map<int, IEntity*>& SimulationModel::getEntities() const {
+  return entities;
+}
+
+IEntity* SimulationModel::getEntity(int id) const {
+  auto it = entities.find(id);
+  return it != entities.end() ? it->second : nullptr;
+}
 
 void SimulationModel::stop(void) {
+  DataCollector::getInstance().stopExport();
   DataCollector::getInstance().outputDataToCSV();
   DataCollector::getInstance().outputMoreDataToCSV();
 }
@@ -0,0 +1,587 @@
+#include "SimulationTimeline.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string_view>
+
+#include "util/AllocationStats.h"
+
+/*
+ * Layout of a chunk, all numbers in native byte order:
+ *
+ * keyframe: u64 tick, f64 time,
+ *           u32 string count, strings (u32 length, bytes),
+ *           u32 record count, records (i32 id, u32 length, bytes)
+ * delta:    u64 tick, f64 time,
+ *           u32 new string count, new strings,
+ *           u32 removed count, removed ids (i32),
+ *           u32 changed count, changed records (i32 id, u8 kind, ...)
+ *             kind patch: u32 span count, spans (u32 offset, u32 length,
+ *                         bytes) over the record of the tick before
+ *             kind full:  u32 length, bytes
+ */
+
+SimulationTimeline::Options SimulationTimeline::defaultOptions;
+
+namespace {
+
+enum ChangeKind : uint8_t { Patch, Full };
+
+// equal bytes between two differences that are still sent as one span,
+// since a span costs eight bytes of header
+constexpr size_t spanGap = 8;
+
+template <class T>
+void put(std::vector<char>& out, const T& value) {
+  const char* bytes = reinterpret_cast<const char*>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void putBytes(std::vector<char>& out, const char* bytes, size_t n) {
+  put(out, static_cast<uint32_t>(n));
+  out.insert(out.end(), bytes, bytes + n);
+}
+
+// Writes or reads n bytes at an offset of a file, however many calls it
+// takes. Reading fails at the end of the file.
+bool writeAt(int fd, const char* bytes, size_t n, uint64_t offset) {
+  while (n > 0) {
+    ssize_t done = pwrite(fd, bytes, n, offset);
+    if (done < 0 && errno == EINTR) continue;
+    if (done <= 0) return false;
+    bytes += done;
+    n -= done;
+    offset += done;
+  }
+  return true;
+}
+
+bool readAt(int fd, char* bytes, size_t n, uint64_t offset) {
+  while (n > 0) {
+    ssize_t done = pread(fd, bytes, n, offset);
+    if (done < 0 && errno == EINTR) continue;
+    if (done < 0) return false;
+    if (done == 0) {
+      errno = 0;
+      return false;
+    }
+    bytes += done;
+    n -= done;
+    offset += done;
+  }
+  return true;
+}
+
+// Overwrites a count written earlier as a placeholder
+void patchCount(std::vector<char>& out, size_t at, uint32_t count) {
+  std::memcpy(out.data() + at, &count, sizeof(count));
+}
+
+struct Cursor {
+  const char* pos;
+
+  template <class T>
+  T get() {
+    T value;
+    std::memcpy(&value, pos, sizeof(T));
+    pos += sizeof(T);
+    return value;
+  }
+
+  std::string_view bytes() {
+    uint32_t n = get<uint32_t>();
+    std::string_view view(pos, n);
+    pos += n;
+    return view;
+  }
+};
+
+// Bytes of the i-th record of a snapshot
+std::string_view recordBytes(const Snapshot& s, size_t i) {
+  size_t begin = s.records[i].offset;
+  size_t end = i + 1 < s.records.size() ? s.records[i + 1].offset
+                                        : s.data.size();
+  return std::string_view(s.data.data() + begin, end - begin);
+}
+
+// State of every entity while a chunk is being replayed
+struct Replay {
+  std::vector<std::string> strings;
+  std::map<int, std::string> records;
+
+  void readStrings(Cursor& c) {
+    uint32_t n = c.get<uint32_t>();
+    for (uint32_t i = 0; i < n; i++) strings.emplace_back(c.bytes());
+  }
+
+  void readKeyframe(Cursor& c) {
+    readStrings(c);
+    uint32_t n = c.get<uint32_t>();
+    for (uint32_t i = 0; i < n; i++) {
+      int id = c.get<int>();
+      records[id] = c.bytes();
+    }
+  }
+
+  void applyDelta(Cursor& c) {
+    readStrings(c);
+    uint32_t removed = c.get<uint32_t>();
+    for (uint32_t i = 0; i < removed; i++) records.erase(c.get<int>());
+    uint32_t changed = c.get<uint32_t>();
+    for (uint32_t i = 0; i < changed; i++) {
+      int id = c.get<int>();
+      if (c.get<uint8_t>() == Full) {
+        records[id] = c.bytes();
+        continue;
+      }
+      std::string& record = records[id];
+      uint32_t spans = c.get<uint32_t>();
+      for (uint32_t j = 0; j < spans; j++) {
+        uint32_t offset = c.get<uint32_t>();
+        std::string_view bytes = c.bytes();
+        record.replace(offset, bytes.size(), bytes);
+      }
+    }
+  }
+
+  void output(Snapshot& out) const {
+    out.strings = strings;
+    out.records.clear();
+    out.data.clear();
+    for (const auto& [id, record] : records) {
+      out.records.push_back({id, static_cast<uint32_t>(out.data.size())});
+      out.data.insert(out.data.end(), record.begin(), record.end());
+    }
+  }
+};
+
+}  // namespace
+
+SimulationTimeline::~SimulationTimeline() {
+  if (sealer.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(sealerMutex);
+      stopping = true;
+    }
+    sealerChanged.notify_all();
+    sealer.join();
+  }
+  if (spillFile >= 0) close(spillFile);
+}
+
+void SimulationTimeline::entityRemoved(int id, const JsonObject& details) {
+  removed[id] = {details, endTick};
+}
+
+const JsonObject* SimulationTimeline::getCreationDetails(int id) const {
+  auto it = removed.find(id);
+  return it != removed.end() ? &it->second.details : nullptr;
+}
+
+SnapshotWriter& SimulationTimeline::beginTick() {
+  if (soughtTick) {
+    truncate(*soughtTick);
+    soughtTick.reset();
+  }
+  // the string table is kept from chunk to chunk. Once strings of entities
+  // that are gone have filled it up, it is built up again at a keyframe
+  if (openTickEnds.empty() && current.strings.size() > 2 * builtStrings + 64) {
+    AllocationStats::expect();
+    writer.clearStrings();
+    rebuildingStrings = true;
+  }
+  writer.clearRecords();
+  return writer;
+}
+
+void SimulationTimeline::recordTick(double time) {
+  if (!sealer.joinable()) {
+    // pages of the reserved buffers are only used as chunks fill them
+    open.reserve(options.chunkReserve);
+    sealing.reserve(options.chunkReserve);
+    openTickEnds.reserve(options.keyframeInterval);
+    sealingTickEnds.reserve(options.keyframeInterval);
+    sealer = std::thread(&SimulationTimeline::sealLoop, this);
+  }
+  if (openTickEnds.empty()) {
+    openFirstTick = endTick;
+    writeKeyframe(time);
+    if (rebuildingStrings) {
+      builtStrings = current.strings.size();
+      rebuildingStrings = false;
+    }
+  } else {
+    writeDelta(time);
+  }
+  openTickEnds.push_back(open.size());
+  endTick++;
+  previousStrings = current.strings.size();
+  current.data.swap(previous.data);
+  current.records.swap(previous.records);
+  if (openTickEnds.size() >= options.keyframeInterval) sealChunk();
+}
+
+void SimulationTimeline::writeKeyframe(double time) {
+  put(open, endTick);
+  put(open, time);
+  put(open, static_cast<uint32_t>(current.strings.size()));
+  for (const std::string& s : current.strings) {
+    putBytes(open, s.data(), s.size());
+  }
+  put(open, static_cast<uint32_t>(current.records.size()));
+  for (size_t i = 0; i < current.records.size(); i++) {
+    std::string_view record = recordBytes(current, i);
+    put(open, current.records[i].id);
+    putBytes(open, record.data(), record.size());
+  }
+}
+
+void SimulationTimeline::writeDelta(double time) {
+  put(open, endTick);
+  put(open, time);
+  put(open, static_cast<uint32_t>(current.strings.size() - previousStrings));
+  for (size_t i = previousStrings; i < current.strings.size(); i++) {
+    putBytes(open, current.strings[i].data(), current.strings[i].size());
+  }
+
+  // records are in id order in both snapshots, so one walk pairs them up
+  const std::vector<Snapshot::Record>& now = current.records;
+  const std::vector<Snapshot::Record>& before = previous.records;
+
+  size_t removedAt = open.size();
+  uint32_t removed = 0;
+  put(open, removed);
+  for (size_t i = 0, j = 0; j < before.size(); j++) {
+    while (i < now.size() && now[i].id < before[j].id) i++;
+    if (i == now.size() || now[i].id != before[j].id) {
+      put(open, before[j].id);
+      removed++;
+    }
+  }
+  patchCount(open, removedAt, removed);
+
+  size_t changedAt = open.size();
+  uint32_t changed = 0;
+  put(open, changed);
+  for (size_t i = 0, j = 0; i < now.size(); i++) {
+    while (j < before.size() && before[j].id < now[i].id) j++;
+    std::string_view a = recordBytes(current, i);
+    if (j == before.size() || before[j].id != now[i].id ||
+        recordBytes(previous, j).size() != a.size()) {
+      put(open, now[i].id);
+      put(open, Full);
+      putBytes(open, a.data(), a.size());
+      changed++;
+      continue;
+    }
+    std::string_view b = recordBytes(previous, j);
+    if (a == b) continue;
+
+    put(open, now[i].id);
+    put(open, Patch);
+    size_t spansAt = open.size();
+    uint32_t spans = 0;
+    put(open, spans);
+    for (size_t k = 0; k < a.size();) {
+      if (a[k] == b[k]) {
+        k++;
+        continue;
+      }
+      size_t last = k;
+      for (size_t m = k + 1; m < a.size() && m - last <= spanGap; m++) {
+        if (a[m] != b[m]) last = m;
+      }
+      put(open, static_cast<uint32_t>(k));
+      putBytes(open, a.data() + k, last + 1 - k);
+      spans++;
+      k = last + 1;
+    }
+    patchCount(open, spansAt, spans);
+    changed++;
+  }
+  patchCount(open, changedAt, changed);
+}
+
+void SimulationTimeline::sealChunk() {
+  waitForSealer();
+  forgetRemoved();
+  {
+    // the buffers of the chunk sealed last are empty and become the open
+    // ones, keeping their capacity
+    std::lock_guard<std::mutex> lock(sealerMutex);
+    open.swap(sealing);
+    openTickEnds.swap(sealingTickEnds);
+    sealingFirstTick = openFirstTick;
+    handedOver = true;
+  }
+  sealerChanged.notify_all();
+}
+
+void SimulationTimeline::sealLoop() {
+  std::unique_lock<std::mutex> lock(sealerMutex);
+  while (true) {
+    sealerChanged.wait(lock, [this] { return handedOver || stopping; });
+    if (!handedOver) return;
+    lock.unlock();
+    seal();
+    lock.lock();
+    handedOver = false;
+    sealerChanged.notify_all();
+  }
+}
+
+void SimulationTimeline::waitForSealer() {
+  std::unique_lock<std::mutex> lock(sealerMutex);
+  sealerChanged.wait(lock, [this] { return !handedOver; });
+}
+
+void SimulationTimeline::seal() {
+  Chunk chunk;
+  chunk.firstTick = sealingFirstTick;
+  chunk.tickEnds = sealingTickEnds;
+  chunk.rawSize = sealing.size();
+  uLongf size = compressBound(sealing.size());
+  chunk.compressed.resize(size);
+  int result = compress2(reinterpret_cast<Bytef*>(chunk.compressed.data()),
+                         &size, reinterpret_cast<const Bytef*>(sealing.data()),
+                         sealing.size(), Z_BEST_SPEED);
+  if (result == Z_OK) {
+    chunk.compressed.resize(size);
+    chunk.compressed.shrink_to_fit();
+    chunk.compressedSize = size;
+    memoryUsed += size;
+    chunks.push_back(std::move(chunk));
+  } else {
+    // its ticks are lost, like those of a chunk that can't be read back
+    std::cerr << "timeline: can't compress the chunk from tick "
+              << chunk.firstTick << ": " << zError(result)
+              << ", dropping its ticks" << std::endl;
+  }
+
+  uint64_t end = sealingFirstTick + sealingTickEnds.size();
+  sealing.clear();
+  sealingTickEnds.clear();
+  dropOldChunks(end);
+  spill();
+}
+
+void SimulationTimeline::dropOldChunks(uint64_t end) {
+  if (options.maxTicks == 0) return;
+  size_t dropped = 0;
+  for (const Chunk& chunk : chunks) {
+    if (chunk.firstTick + chunk.tickEnds.size() + options.maxTicks > end) {
+      break;
+    }
+    if (chunk.spilled) {
+      // the file keeps its size and offsets, but not the blocks
+      fallocate(spillFile, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                chunk.fileOffset, chunk.compressedSize);
+    } else {
+      memoryUsed -= chunk.compressedSize;
+    }
+    dropped++;
+  }
+  chunks.erase(chunks.begin(), chunks.begin() + dropped);
+}
+
+void SimulationTimeline::forgetRemoved() {
+  if (options.maxTicks == 0 || chunks.empty()) return;
+  // entities removed by the oldest tick left can't be sought back to
+  uint64_t oldest = chunks.front().firstTick;
+  if (oldest == forgottenBefore) return;
+  forgottenBefore = oldest;
+  std::erase_if(removed, [oldest](const auto& entry) {
+    return entry.second.tick <= oldest;
+  });
+}
+
+void SimulationTimeline::spill() {
+  for (Chunk& chunk : chunks) {
+    if (memoryUsed <= options.memoryLimit) break;
+    if (chunk.spilled) continue;
+    if (spillFile < 0) {
+      static int files = 0;
+      std::filesystem::path dir =
+          options.spillDirectory.empty()
+              ? std::filesystem::temp_directory_path()
+              : std::filesystem::path(options.spillDirectory);
+      std::string spillPath = (dir / ("timeline-" + std::to_string(getpid()) +
+                                      "-" + std::to_string(files++) + ".bin"))
+                                  .string();
+      spillFile = ::open(spillPath.c_str(),
+                         O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+      if (spillFile < 0) {
+        std::cerr << "timeline: can't open " << spillPath
+                  << ", keeping chunks in memory" << std::endl;
+        options.memoryLimit = SIZE_MAX;
+        break;
+      }
+      // the open descriptor keeps the file, which goes away with the process
+      // however it ends
+      std::filesystem::remove(spillPath);
+    }
+    if (!writeAt(spillFile, chunk.compressed.data(), chunk.compressedSize,
+                 spillSize)) {
+      std::cerr << "timeline: can't spill: " << std::strerror(errno)
+                << ", keeping chunks in memory" << std::endl;
+      options.memoryLimit = SIZE_MAX;
+      break;
+    }
+    chunk.fileOffset = spillSize;
+    chunk.spilled = true;
+    spillSize += chunk.compressedSize;
+    memoryUsed -= chunk.compressedSize;
+    std::vector<char>().swap(chunk.compressed);
+  }
+}
+
+bool SimulationTimeline::readChunk(const Chunk& chunk, std::vector<char>& raw,
+                                   std::string& error) {
+  std::string from = "the chunk from tick " + std::to_string(chunk.firstTick);
+  std::vector<char> spilled;
+  const char* compressed = chunk.compressed.data();
+  if (chunk.spilled) {
+    spilled.resize(chunk.compressedSize);
+    if (!readAt(spillFile, spilled.data(), chunk.compressedSize,
+                chunk.fileOffset)) {
+      error = "can't read " + from + " back from the spill file: " +
+              (errno ? std::strerror(errno) : "the file is cut short");
+      return false;
+    }
+    compressed = spilled.data();
+  }
+  raw.resize(chunk.rawSize);
+  uLongf size = chunk.rawSize;
+  int result = uncompress(reinterpret_cast<Bytef*>(raw.data()), &size,
+                          reinterpret_cast<const Bytef*>(compressed),
+                          chunk.compressedSize);
+  if (result != Z_OK || size != chunk.rawSize) {
+    error = "can't uncompress " + from + ": " +
+            (result != Z_OK ? zError(result) : "it is cut short");
+    return false;
+  }
+  return true;
+}
+
+bool SimulationTimeline::reconstruct(uint64_t tick, Snapshot& out,
+                                     double& time, std::string& error) {
+  error = "tick " + std::to_string(tick) + " has not been recorded";
+  if (tick >= endTick) return false;
+  waitForSealer();
+
+  std::vector<char> chunkBytes;
+  const char* raw;
+  uint64_t first;
+  if (!openTickEnds.empty() && tick >= openFirstTick) {
+    raw = open.data();
+    first = openFirstTick;
+  } else {
+    auto it = std::upper_bound(
+        chunks.begin(), chunks.end(), tick,
+        [](uint64_t t, const Chunk& c) { return t < c.firstTick; });
+    // ticks of chunks that could not be read back are gone
+    if (it == chunks.begin()) return false;
+    const Chunk& chunk = *(it - 1);
+    if (tick - chunk.firstTick >= chunk.tickEnds.size()) return false;
+    if (!readChunk(chunk, chunkBytes, error)) return false;
+    raw = chunkBytes.data();
+    first = chunk.firstTick;
+  }
+
+  Replay replay;
+  Cursor c{raw};
+  c.get<uint64_t>();
+  time = c.get<double>();
+  replay.readKeyframe(c);
+  for (uint64_t t = first + 1; t <= tick; t++) {
+    c.get<uint64_t>();
+    time = c.get<double>();
+    replay.applyDelta(c);
+  }
+  replay.output(out);
+  return true;
+}
+
+void SimulationTimeline::truncate(uint64_t tick) {
+  // ticks are numbered on from the given one again
+  for (auto& [id, removal] : removed) {
+    removal.tick = std::min(removal.tick, tick + 1);
+  }
+  if (tick + 1 >= endTick) return;
+  waitForSealer();
+
+  if (!openTickEnds.empty() && tick >= openFirstTick) {
+    // cut the open chunk short and finish it, the next tick is a keyframe
+    openTickEnds.resize(tick - openFirstTick + 1);
+    open.resize(openTickEnds.back());
+  } else {
+    open.clear();
+    openTickEnds.clear();
+    auto it = std::upper_bound(
+        chunks.begin(), chunks.end(), tick,
+        [](uint64_t t, const Chunk& c) { return t < c.firstTick; });
+    for (auto dropped = it; dropped != chunks.end(); ++dropped) {
+      if (dropped->spilled) {
+        spillSize = std::min(spillSize, dropped->fileOffset);
+      } else {
+        memoryUsed -= dropped->compressedSize;
+      }
+    }
+    chunks.erase(it, chunks.end());
+    if (chunks.empty() ||
+        tick - chunks.back().firstTick >= chunks.back().tickEnds.size()) {
+      // the tick's chunk is gone already, dropped or never stored, so
+      // recording carries on after it with a keyframe
+      endTick = tick + 1;
+      return;
+    }
+
+    // the chunk with the tick in it becomes the open one again, so it can
+    // be cut short and sealed like one
+    Chunk& last = chunks.back();
+    std::string error;
+    bool readable = readChunk(last, open, error);
+    openFirstTick = last.firstTick;
+    openTickEnds = last.tickEnds;
+    if (last.spilled) {
+      spillSize = last.fileOffset;
+    } else {
+      memoryUsed -= last.compressedSize;
+    }
+    chunks.pop_back();
+    if (!readable) {
+      // its ticks are lost, and recording carries on after the sought one
+      std::cerr << "timeline: " << error << ", dropping its ticks"
+                << std::endl;
+      open.clear();
+      openTickEnds.clear();
+      endTick = tick + 1;
+      return;
+    }
+    openTickEnds.resize(tick - openFirstTick + 1);
+    open.resize(openTickEnds.back());
+  }
+  endTick = tick + 1;
+  sealChunk();
+}
+
+void SimulationTimeline::clear() {
+  waitForSealer();
+  chunks.clear();
+  open.clear();
+  openTickEnds.clear();
+  endTick = 0;
+  soughtTick.reset();
+  memoryUsed = 0;
+  spillSize = 0;  // the file is overwritten from the start
+  removed.clear();
+  forgottenBefore = 0;
+}
@@ -1,57 +1,209 @@
-#include <chrono>  // NOLINT [build/c++11]
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <map>
+#include <memory>
 
+#include "DataCollector.h"
 #include "OBJParser.h"
+#include "SimulationFork.h"
 #include "SimulationModel.h"
+#include "TransitSimulation.h"
 #include "WebServer.h"
+#include "util/Checkpoint.h"
+#include "util/Trace.h"
 
 //--------------------  Controller ----------------------------
 bool stopped = false;
 /// A Transit Service that communicates with a web page through web sockets.  It
 /// also acts as the controller in the model view controller pattern.
-class TransitService : public JsonSession, public IController {
+class TransitService : public JsonSession {
  public:
+  /// Runs a simulation of its own for this session
   TransitService()
-      : model(*this), start(std::chrono::system_clock::now()), time(0.0) {}
+      : owned(std::make_unique<TransitSimulation>()),
+        simulation(owned.get()) {
+    if (!resumeFile.empty()) resume(*owned);
+  }
+
+  /// Watches (and maybe controls) a simulation shared with other sessions
+  TransitService(TransitSimulation* shared) : simulation(shared) {}
+
+  ~TransitService() { simulation->unsubscribe(this); }
+
+  /// Where checkpoint and trace commands read and write their files
+  static std::string checkpointDir;
+  /// Checkpoint every new simulation starts from, if not empty
+  static std::string resumeFile;
+  /// Limits on what one evaluateDispatch may ask for
+  static constexpr int maxForks = 8;
+  static constexpr double maxForkSeconds = 600;
+  /// evaluateDispatch requests that may run at once, over every session
+  static constexpr int maxEvaluations = 4;
+  /// Stops every evaluateDispatch still running, whose results then go
+  /// nowhere. Call before the server goes away.
+  static void stopEvaluations() {
+    for (auto& [key, evaluation] : evaluations) {
+      for (auto& fork : evaluation->forks) fork->cancel();
+    }
+    evaluations.clear();
+  }
+
+  /// Appends the simulations' metrics, in the Prometheus text format, to
+  /// what the server serves at /metrics
+  static void writeMetrics(std::string& out) {
+    auto number = [](double value) {
+      char text[32];
+      std::snprintf(text, sizeof(text), "%.9g", value);
+      return std::string(text);
+    };
+    auto family = [&](const char* name, const char* type, const char* help) {
+      out += std::string("# HELP ") + name + " " + help + "\n";
+      out += std::string("# TYPE ") + name + " " + type + "\n";
+    };
+    auto sample = [&](const std::string& name, double value) {
+      out += name + " " + number(value) + "\n";
+    };
+
+    const Histogram& ticks = TransitSimulation::getTickDurations();
+    Histogram::Summary tickSummary = ticks.summarize();
+    family("transit_tick_duration_seconds", "histogram",
+           "Wall time of a simulation tick.");
+    for (double bound : {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+                         0.025, 0.05, 0.1, 0.25, 0.5, 1.0}) {
+      sample("transit_tick_duration_seconds_bucket{le=\"" + number(bound) +
+                 "\"}",
+             ticks.countAtMost(bound));
+    }
+    sample("transit_tick_duration_seconds_bucket{le=\"+Inf\"}",
+           tickSummary.count);
+    sample("transit_tick_duration_seconds_sum",
+           tickSummary.mean * tickSummary.count);
+    sample("transit_tick_duration_seconds_count", tickSummary.count);
+
+    // summed over the simulations, one per session unless shared
+    std::map<std::string, int> entities;
+    size_t pending = 0;
+    for (TransitSimulation* simulation : TransitSimulation::getInstances()) {
+      SimulationModel& model = simulation->getModel();
+      for (auto& [type, count] : model.getEntityCounts()) {
+        entities[type] += count;
+      }
+      pending += model.scheduledDeliveries.size();
+    }
+    family("transit_simulations", "gauge", "Simulations being run.");
+    sample("transit_simulations", TransitSimulation::getInstances().size());
+    family("transit_entities", "gauge", "Entities in the simulations.");
+    for (auto& [type, count] : entities) {
+      sample("transit_entities{type=\"" + type + "\"}", count);
+    }
+    family("transit_deliveries_pending", "gauge",
+           "Scheduled deliveries no drone has set out on.");
+    sample("transit_deliveries_pending", pending);
+
+    DataCollector::Stats stats = DataCollector::getInstance().getStats();
+    family("transit_deliveries_completed_total", "counter",
+           "Packages dropped off.");
+    sample("transit_deliveries_completed_total", stats.deliveries);
+    family("transit_delivery_latency_seconds", "summary",
+           "Simulated time from scheduling a delivery to its drop-off.");
+    for (auto [quantile, value] : {std::pair{"0.5", stats.delivery.p50},
+                                   std::pair{"0.95", stats.delivery.p95},
+                                   std::pair{"0.99", stats.delivery.p99}}) {
+      sample(std::string("transit_delivery_latency_seconds{quantile=\"") +
+                 quantile + "\"}",
+             value);
+    }
+    sample("transit_delivery_latency_seconds_sum",
+           stats.delivery.mean * stats.delivery.count);
+    sample("transit_delivery_latency_seconds_count", stats.delivery.count);
+    family("transit_drones_busy", "gauge", "Drones on a delivery.");
+    sample("transit_drones_busy", stats.busy);
+    family("transit_fleet_utilization", "gauge",
+           "Busy drone-seconds over drone-seconds so far.");
+    sample("transit_fleet_utilization", stats.utilization);
+
+    const routing::Graph::QueryStats& routes = routing::Graph::queryStats;
+    family("transit_route_queries_total", "counter", "Routes planned.");
+    sample("transit_route_queries_total", routes.queries);
+    family("transit_route_failures_total", "counter",
+           "Route queries that found no route.");
+    sample("transit_route_failures_total", routes.failures);
+    family("transit_route_planning_seconds_total", "counter",
+           "Wall time spent planning routes.");
+    sample("transit_route_planning_seconds_total", routes.nanoseconds * 1e-9);
+  }
+
+  /// Loads the resume file into a simulation
+  static bool resume(TransitSimulation& simulation) {
+    std::string error;
+    if (simulation.getModel().loadCheckpoint(resumeFile, error)) return true;
+    std::cerr << "can't resume: " << error << std::endl;
+    return false;
+  }
+
+  void onConnect() {
+    const std::string& token = simulation->getControlToken();
+    bool control = !token.empty() && getConnectArg("control") == token;
+    simulation->subscribe(this, control);
+  }
 
   /// Handles specific commands from the web server
   void receiveCommand(const std::string& cmd, const JsonObject& data,
                       JsonObject& returnValue) {
+    TRACE_SCOPE("TransitService::receiveCommand", cmd);
+    SimulationModel& model = simulation->getModel();
+
+    if (cmd == "ping") {
+      if (data.contains("message"))
+        std::cout << std::string(data["message"]) << std::endl;
+      returnValue["response"] = data;
+      return;
+    } else if (cmd == "SetViewport") {
+      simulation->setViewport(this, data);
+      return;
+    } else if (cmd == "GetStats") {
+      // delivery statistics of every simulation in this process
+      DataCollector::Stats stats = DataCollector::getInstance().getStats();
+      returnValue["time"] = model.getTime();
+      returnValue["queued"] = summarize(stats.queued);
+      returnValue["pickup"] = summarize(stats.pickup);
+      returnValue["delivery"] = summarize(stats.delivery);
+      JsonObject fleet;
+      fleet["drones"] = stats.drones;
+      fleet["busy"] = stats.busy;
+      fleet["utilization"] = stats.utilization;
+      returnValue["fleet"] = fleet;
+      JsonObject telemetry;
+      telemetry["unkeptEvents"] = static_cast<double>(stats.unkeptEvents);
+      telemetry["unexported"] = static_cast<double>(stats.unexported);
+      returnValue["telemetry"] = telemetry;
+      return;
+    }
+
+    // everything else changes the simulation
+    if (!simulation->canControl(this)) {
+      if (cmd != "Update") {
+        returnValue["error"] = "session is not allowed to control simulation";
+      }
+      return;
+    }
+
     if (cmd == "CreateEntity") {
       model.createEntity(data);
     } else if (cmd == "SetGraph") {
       std::string path = data["filePath"];
-      model.setGraph(routing::OBJGraphParser(path));
+      model.setGraph(routing::OBJGraphParser(path), path);
     } else if (cmd == "ScheduleTrip") {
       model.scheduleTrip(data);
     } else if (cmd == "resetSimulation") {
       model.resetSimulation();
-    } else if (cmd == "ping") {
-      if (data.contains("message"))
-        std::cout << std::string(data["message"]) << std::endl;
-      returnValue["response"] = data;
     } else if (cmd == "Update") {
-      updateEntites.clear();
-
-      std::chrono::time_point<std::chrono::system_clock> end =
-          std::chrono::system_clock::now();
-      std::chrono::duration<double> diff = end - start;
-      double delta = diff.count() - time;
-      time += delta;
-
       double simSpeed = data["simSpeed"];
-      delta *= simSpeed;
-
-      if (delta > 0.1) {
-        for (float f = 0.0; f < delta; f += 0.01) {
-          model.update(0.01);
-        }
+      if (simulation->isTicking()) {
+        simulation->setSimSpeed(simSpeed);
       } else {
-        model.update(delta);
-      }
-
-      for (auto& [id, entity] : updateEntites) {
-        sendEntity("UpdateEntity", *entity);
+        simulation->update(simSpeed);
       }
     } else if (cmd == "stopSimulation") {
       std::cout << "Stop command administered\n";
@@ -60,80 +212,299 @@ class TransitService : public JsonSession, public IController {
     } else if (cmd == "saveSimulation") {
       model.saveSimulationState();
       returnValue["status"] = "Simulation state saved";
-      sendEventToView("SimulationSaved", returnValue);
+      simulation->sendEventToView("SimulationSaved", returnValue);
     } else if (cmd == "restoreSimulation") {
       model.restoreSimulationState();
       returnValue["status"] = "Simulation state restored";
-      sendEventToView("SimulationRestored", returnValue);
-    }
-  }
-
-  void sendEntity(const std::string& event, const IEntity& entity,
-                  bool includeDetails = true) {
-    // JsonObject details = entity.GetDetails();
-    JsonObject details;
-    if (includeDetails) {
-      details["details"] = entity.getDetails();
+      simulation->sendEventToView("SimulationRestored", returnValue);
+    } else if (cmd == "checkpoint" || cmd == "resume" || cmd == "dumpTrace") {
+      std::string fallback =
+          cmd == "dumpTrace" ? "trace.json" : "simulation.ckpt";
+      std::string name =
+          data.contains("file") ? std::string(data["file"]) : fallback;
+      // sessions only get to name a file in the checkpoint directory
+      if (name.empty() || name.find('/') != std::string::npos ||
+          name[0] == '.') {
+        returnValue["error"] = "bad file name";
+        return;
+      }
+      std::string path = checkpointDir + "/" + name;
+      std::string error;
+      if (cmd == "dumpTrace") {
+        // scopes recorded so far, for chrome://tracing or Perfetto
+        if (!Trace::dump(path, error)) {
+          returnValue["error"] = error;
+          return;
+        }
+        returnValue["file"] = name;
+        returnValue["status"] = "Trace written";
+        return;
+      }
+      bool done = cmd == "checkpoint" ? model.saveCheckpoint(path, error)
+                                      : model.loadCheckpoint(path, error);
+      if (!done) {
+        returnValue["error"] = error;
+        return;
+      }
+      returnValue["file"] = name;
+      if (cmd == "checkpoint") {
+        returnValue["status"] = "Simulation checkpoint written";
+        simulation->sendEventToView("SimulationCheckpointed", returnValue);
+      } else {
+        returnValue["status"] = "Simulation resumed from checkpoint";
+        simulation->sendEventToView("SimulationResumed", returnValue);
+      }
+    } else if (cmd == "seekSimulation") {
+      double tick = data["tick"];
+      const SimulationTimeline& timeline = model.getTimeline();
+      std::string error = "tick has not been recorded";
+      if (tick < 0 ||
+          !model.seekSimulation(static_cast<uint64_t>(tick), error)) {
+        returnValue["error"] = error;
+        returnValue["endTick"] = static_cast<double>(timeline.getEndTick());
+        return;
+      }
+      returnValue["status"] = "Simulation state sought";
+      returnValue["tick"] = tick;
+      returnValue["endTick"] = static_cast<double>(timeline.getEndTick());
+      returnValue["time"] = model.getTime();
+      simulation->sendEventToView("SimulationSought", returnValue);
+    } else if (cmd == "evaluateDispatch") {
+      // runs the simulation ahead once per strategy, all at once on forks,
+      // with every scheduled delivery using that strategy
+      JsonArray strategies = data["strategies"];
+      double seconds = data.contains("seconds")
+                           ? static_cast<double>(data["seconds"])
+                           : 30.0;
+      if (strategies.size() == 0 || strategies.size() > maxForks ||
+          !(seconds > 0 && seconds <= maxForkSeconds)) {
+        returnValue["error"] = "bad strategies or seconds";
+        return;
+      }
+      if (evaluations.size() >= maxEvaluations) {
+        returnValue["error"] = "too many evaluations running";
+        return;
+      }
+      // the forks run detached so the event loop goes on meanwhile; the
+      // last one to finish hands the results back to the service thread,
+      // which sends them with the request's id
+      int key = nextEvaluation++;
+      Evaluation& evaluation =
+          *evaluations.emplace(key, std::make_unique<Evaluation>())
+               .first->second;
+      evaluation.session = getId();
+      evaluation.reply["id"] = data["id"];
+      evaluation.reply["seconds"] = seconds;
+      evaluation.running = strategies.size();
+      for (int i = 0; i < strategies.size(); i++) {
+        std::string strategy = strategies[i];
+        evaluation.strategies.push_back(strategy);
+        evaluation.forks.push_back(std::make_unique<SimulationFork>(model));
+        for (Package* package :
+             evaluation.forks.back()->getModel().scheduledDeliveries) {
+          package->setStrategyName(strategy);
+        }
+      }
+      WebServerBase* server = getServer();
+      std::atomic<int>* running = &evaluation.running;
+      for (auto& fork : evaluation.forks) {
+        fork->start(seconds, SimulationFork::defaultStep,
+                    [server, running, key] {
+                      if (running->fetch_sub(1) == 1) {
+                        server->post([server, key] {
+                          finishEvaluation(*server, key);
+                        });
+                      }
+                    });
+      }
+      returnValue["status"] = "evaluating";
     }
-    details["id"] = entity.getId();
-    Vector3 pos_ = entity.getPosition();
-    Vector3 dir_ = entity.getDirection();
-    JsonArray pos = {pos_.x, pos_.y, pos_.z};
-    JsonArray dir = {dir_.x, dir_.y, dir_.z};
-    details["pos"] = pos;
-    details["dir"] = dir;
-    std::string col_ = entity.getColor();
-    if (col_ != "") details["color"] = col_;
-    sendEventToView(event, details);
   }
 
-  void addEntity(const IEntity& entity) {
-    sendEntity("AddEntity", entity, true);
-  }
+ private:
+  /// An evaluateDispatch whose forks are running
+  struct Evaluation {
+    int session;  // that asked, by id
+    JsonObject reply;
+    std::vector<std::string> strategies;
+    std::vector<std::unique_ptr<SimulationFork>> forks;
+    std::atomic<int> running;  // forks not finished yet
+  };
 
-  void updateEntity(const IEntity& entity) {
-    updateEntites[entity.getId()] = &entity;
+  /// Sends the results of a finished evaluation, if whoever asked is still
+  /// connected, and forgets it
+  static void finishEvaluation(WebServerBase& server, int key) {
+    auto it = evaluations.find(key);
+    if (it == evaluations.end()) return;
+    Evaluation& evaluation = *it->second;
+    JsonArray results;
+    for (int i = 0; i < evaluation.forks.size(); i++) {
+      const SimulationFork::Metrics& metrics = evaluation.forks[i]->join();
+      JsonObject result;
+      result["strategy"] = evaluation.strategies[i];
+      result["dispatched"] = metrics.dispatched;
+      result["pickups"] = metrics.pickups;
+      result["deliveries"] = metrics.deliveries;
+      result["pending"] = metrics.pending;
+      result["meanDeliveryTime"] = metrics.latency.mean;
+      result["deliveryTime"] = summarize(metrics.latency);
+      result["ticks"] = metrics.ticks;
+      result["wallTime"] = metrics.wallTime;
+      results.push(result);
+    }
+    evaluation.reply["results"] = results;
+    auto session = server.sessionMap.find(evaluation.session);
+    if (session != server.sessionMap.end()) {
+      session->second->sendMessage(evaluation.reply.toString());
+    }
+    evaluations.erase(it);
   }
 
-  void removeEntity(const IEntity& entity) {
-    JsonObject details;
-    details["id"] = entity.getId();
-    updateEntites.erase(entity.getId());
-    sendEventToView("RemoveEntity", details);
+  /// A histogram's summary as sent to views, durations in simulated seconds
+  static JsonObject summarize(const Histogram::Summary& summary) {
+    JsonObject out;
+    out["count"] = static_cast<double>(summary.count);
+    out["min"] = summary.min;
+    out["max"] = summary.max;
+    out["mean"] = summary.mean;
+    out["p50"] = summary.p50;
+    out["p95"] = summary.p95;
+    out["p99"] = summary.p99;
+    return out;
   }
 
-  /// Allows messages to be passed back to the view
-  void sendEventToView(const std::string& event, const JsonObject& details) {
-    JsonObject eventData;
-    eventData["event"] = event;
-    eventData["details"] = details;
-    sendMessage(eventData.toString());
-  }
+  // evaluateDispatch requests being worked on, by key
+  static std::map<int, std::unique_ptr<Evaluation>> evaluations;
+  static int nextEvaluation;
 
- private:
-  // Simulation Model
-  SimulationModel model;
-  // Used for tracking time since last update
-  std::chrono::time_point<std::chrono::system_clock> start;
-  // The total time the server has been running.
-  double time;
-  // Current entities to update
-  std::map<int, const IEntity*> updateEntites;
+  // Set when this session runs a simulation of its own
+  std::unique_ptr<TransitSimulation> owned;
+  // The simulation this session shows
+  TransitSimulation* simulation;
 };
 
+std::map<int, std::unique_ptr<TransitService::Evaluation>>
+    TransitService::evaluations;
+int TransitService::nextEvaluation = 0;
+std::string TransitService::checkpointDir = ".";
+std::string TransitService::resumeFile;
+
 /// The main program that handles starting the web sockets service.
 int main(int argc, char** argv) {
-  if (argc > 1) {
+  if (argc > 2) {
     int port = std::atoi(argv[1]);
     std::string webDir = std::string(argv[2]);
-    WebServer<TransitService> server(port, webDir);
-    while (!stopped) {
-      server.service();
+
+    bool shared = false;
+    std::string controlToken;
+    double tickRate = 0;
+    SimulationTimeline::Options timeline;
+    TelemetryExporter::Options telemetry;
+    for (int i = 3; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "--shared") {
+        shared = true;
+      } else if (arg == "--control-token" && i + 1 < argc) {
+        controlToken = argv[++i];
+      } else if (arg == "--tick-rate" && i + 1 < argc) {
+        tickRate = std::atof(argv[++i]);
+      } else if (arg == "--snapshot-memory" && i + 1 < argc) {
+        // megabytes of saved states each simulation may keep
+        SimulationCaretaker::setDefaultMemoryLimit(
+            static_cast<size_t>(std::atof(argv[++i]) * (1 << 20)));
+      } else if (arg == "--float-graph") {
+        // graph nodes are also kept in single precision, for AVX2 scans
+        routing::Graph::setSinglePrecisionByDefault(true);
+      } else if (arg == "--checkpoint-dir" && i + 1 < argc) {
+        TransitService::checkpointDir = argv[++i];
+      } else if (arg == "--resume" && i + 1 < argc) {
+        TransitService::resumeFile = argv[++i];
+      } else if (arg == "--no-timeline") {
+        timeline.enabled = false;
+      } else if (arg == "--keyframe-interval" && i + 1 < argc) {
+        timeline.keyframeInterval = std::max(1, std::atoi(argv[++i]));
+      } else if (arg == "--timeline-memory" && i + 1 < argc) {
+        // megabytes of compressed ticks kept before they go to disk
+        timeline.memoryLimit =
+            static_cast<size_t>(std::atof(argv[++i]) * (1 << 20));
+      } else if (arg == "--timeline-ticks" && i + 1 < argc) {
+        // ticks that can be sought back to at least, 0 for all of them
+        timeline.maxTicks = std::max(0LL, std::atoll(argv[++i]));
+      } else if (arg == "--timeline-dir" && i + 1 < argc) {
+        timeline.spillDirectory = argv[++i];
+      } else if (arg == "--telemetry" && i + 1 < argc) {
+        telemetry.path = argv[++i];
+      } else if (arg == "--telemetry-csv") {
+        telemetry.csv = true;
+      } else if (arg == "--telemetry-interval" && i + 1 < argc) {
+        // simulated seconds between fleet metrics
+        telemetry.fleetInterval = std::atof(argv[++i]);
+      } else if (arg == "--alloc-check") {
+        // profiling builds abort on a steady tick that allocates
+        AllocationStats::setStrict(true);
+      }
+    }
+
+    SimulationTimeline::setDefaultOptions(timeline);
+    if (!telemetry.path.empty()) {
+      std::string error;
+      if (!DataCollector::getInstance().startExport(telemetry, error)) {
+        std::cerr << "can't export telemetry: " << error << std::endl;
+        return 1;
+      }
+    }
+
+    if (shared) {
+      // one simulation watched by every connected session
+      TransitSimulation simulation(controlToken);
+      // resumed before the server listens, so nobody sees it half loaded
+      if (!TransitService::resumeFile.empty() &&
+          !TransitService::resume(simulation)) {
+        return 1;
+      }
+      WebServerWithState<TransitService, TransitSimulation*> server(
+          &simulation, port, webDir);
+      server.setMetrics(TransitService::writeMetrics);
+      if (tickRate > 0) {
+        // the server keeps time, so viewers see the same pace whatever the
+        // controlling browser is doing
+        simulation.setTicking(true);
+        server.addTimer(1.0 / tickRate, [&simulation]() {
+          simulation.update(simulation.getSimSpeed());
+        });
+      }
+      while (!stopped) {
+        server.service();
+      }
+      TransitService::stopEvaluations();
+    } else {
+      // every session resumes the file when it connects, so a bad one is
+      // reported now rather than then
+      CheckpointFile file;
+      std::string error;
+      if (!TransitService::resumeFile.empty() &&
+          !file.open(TransitService::resumeFile, error)) {
+        std::cerr << "can't resume: " << error << std::endl;
+        return 1;
+      }
+      WebServer<TransitService> server(port, webDir);
+      server.setMetrics(TransitService::writeMetrics);
+      while (!stopped) {
+        server.service();
+      }
+      TransitService::stopEvaluations();
     }
   } else {
-    std::cout
-        << "Usage: ./build/bin/transit_service <port> apps/transit_service/web/"
-        << std::endl;
+    std::cout << "Usage: ./build/bin/transit_service <port> "
+                 "apps/transit_service/web/ [--shared] "
+                 "[--control-token <token>] [--tick-rate <hz>] "
+                 "[--snapshot-memory <MB>] [--float-graph] [--no-timeline] "
+                 "[--keyframe-interval <ticks>] [--timeline-memory <MB>] "
+                 "[--timeline-ticks <ticks>] [--timeline-dir <dir>] "
+                 "[--checkpoint-dir <dir>] [--resume <file>] "
+                 "[--telemetry <file>] [--telemetry-csv] "
+                 "[--telemetry-interval <seconds>] [--alloc-check]"
+              << std::endl;
   }
 
   return 0;
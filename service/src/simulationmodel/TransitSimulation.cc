@@ -0,0 +1,450 @@
+#include "TransitSimulation.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "util/Trace.h"
+
+std::vector<TransitSimulation*> TransitSimulation::instances;
+Histogram TransitSimulation::tickDurations(1e-6);
+
+TransitSimulation::TransitSimulation(const std::string& controlToken)
+    : controlToken(controlToken),
+      model(*this),
+      start(std::chrono::system_clock::now()) {
+  instances.push_back(this);
+}
+
+TransitSimulation::~TransitSimulation() {
+  instances.erase(std::find(instances.begin(), instances.end(), this));
+}
+
+void TransitSimulation::subscribe(WebServerBase::Session* session,
+                                  bool control) {
+  bool anyControl = std::any_of(subscribers.begin(), subscribers.end(),
+                                [](const Subscriber& s) { return s.control; });
+  if (controlToken.empty() && !anyControl) control = true;
+  subscribers.push_back({session, control});
+  reserveEnvelopes();
+
+  // catch the new view up with the entities that already exist
+  for (auto& [id, entity] : model.getEntities()) {
+    introduce(subscribers.back(), *entity);
+  }
+  if (control && subscribers.size() > 1) {
+    JsonObject details;
+    details["message"] = "You are in control of the simulation";
+    sendEvent(session, "Notification", details);
+  }
+}
+
+void TransitSimulation::unsubscribe(WebServerBase::Session* session) {
+  eventful = true;
+  auto it = std::find_if(
+      subscribers.begin(), subscribers.end(),
+      [session](const Subscriber& s) { return s.session == session; });
+  if (it == subscribers.end()) return;
+  bool hadControl = it->control;
+  subscribers.erase(it);
+
+  // hand control to the oldest remaining view
+  if (hadControl && controlToken.empty() && !subscribers.empty() &&
+      std::none_of(subscribers.begin(), subscribers.end(),
+                   [](const Subscriber& s) { return s.control; })) {
+    subscribers.front().control = true;
+    JsonObject details;
+    details["message"] = "You are in control of the simulation";
+    sendEvent(subscribers.front().session, "Notification", details);
+  }
+}
+
+void TransitSimulation::setViewport(WebServerBase::Session* session,
+                                    const JsonObject& region) {
+  Subscriber* s = findSubscriber(session);
+  if (!s) return;
+  eventful = true;
+
+  if (region.contains("min") && region.contains("max")) {
+    JsonArray min = region["min"];
+    JsonArray max = region["max"];
+    double margin = region.contains("margin")
+                        ? static_cast<double>(region["margin"])
+                        : defaultMargin;
+    if (!s->limited) {
+      // the view was sent everything so far
+      s->visible.clear();
+      for (auto& [id, entity] : model.getEntities()) s->visible.push_back(id);
+    }
+    s->limited = true;
+    s->minX = static_cast<double>(min[0]) - margin;
+    s->minZ = static_cast<double>(min[1]) - margin;
+    s->maxX = static_cast<double>(max[0]) + margin;
+    s->maxZ = static_cast<double>(max[1]) + margin;
+  } else if (s->limited) {
+    // back to the whole world: send whatever the view is missing
+    for (auto& [id, entity] : model.getEntities()) {
+      if (!std::binary_search(s->visible.begin(), s->visible.end(), id)) {
+        introduce(*s, *entity);
+      }
+    }
+    s->limited = false;
+    s->visible.clear();
+  }
+}
+
+bool TransitSimulation::canControl(
+    const WebServerBase::Session* session) const {
+  for (const Subscriber& s : subscribers) {
+    if (s.session == session) return s.control;
+  }
+  return false;
+}
+
+void TransitSimulation::update(double simSpeed) {
+  TRACE_SCOPE("TransitSimulation::update");
+  auto tickStart = std::chrono::steady_clock::now();
+  for (int id : updatedIds) updateEntites[id] = nullptr;
+  updatedIds.clear();
+  tickAllocations = {};
+
+  std::chrono::time_point<std::chrono::system_clock> end =
+      std::chrono::system_clock::now();
+  std::chrono::duration<double> diff = end - start;
+  double delta = diff.count() - time;
+  time += delta;
+  double wallDelta = delta;
+
+  delta *= simSpeed;
+
+  {
+    AllocationScope scope(tickAllocations.entities);
+    TRACE_SCOPE("model");
+    if (delta > 0.1) {
+      for (float f = 0.0; f < delta; f += 0.01) {
+        model.update(0.01);
+      }
+    } else {
+      model.update(delta);
+    }
+  }
+
+  if (delta > 0) {
+    AllocationScope scope(tickAllocations.timeline);
+    TRACE_SCOPE("timeline");
+    model.recordTick();
+  }
+
+  // velocities are measured on the wall clock, which is what clients
+  // extrapolate with
+  {
+    AllocationScope scope(tickAllocations.motion);
+    TRACE_SCOPE("motion");
+    for (int id : updatedIds) {
+      const IEntity* entity = updated(id);
+      if (!entity) continue;
+      Vector3 pos = entity->getPosition();
+      auto [it, added] = motion.try_emplace(id, Motion{pos, Vector3()});
+      if (!added && wallDelta > 1e-4) {
+        it->second.vel = (pos - it->second.pos) / wallDelta;
+        it->second.pos = pos;
+      }
+    }
+  }
+
+  {
+    AllocationScope scope(tickAllocations.views);
+    TRACE_SCOPE("views");
+    if (frames.size() < updateEntites.size()) {
+      frames.resize(updateEntites.size());
+    }
+    bool anyLimited =
+        std::any_of(subscribers.begin(), subscribers.end(),
+                    [](const Subscriber& s) { return s.limited; });
+    if (anyLimited) {
+      grid.clear();
+      for (int id : updatedIds) {
+        if (const IEntity* entity = updated(id)) {
+          grid.insert(id, entity->getPosition());
+        }
+      }
+    }
+
+    for (Subscriber& s : subscribers) {
+      if (s.limited) {
+        updateInterest(s);
+      } else {
+        for (int id : updatedIds) {
+          if (updated(id)) sendCorrection(s, id);
+        }
+      }
+    }
+    // the sessions now hold what they were sent; keeping a frame past the
+    // fan-out would only keep its buffer from being reused
+    for (int id : updatedIds) frames[id].reset();
+  }
+
+  checkAllocations();
+  tickDurations.record(std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - tickStart)
+                           .count());
+}
+
+void TransitSimulation::checkAllocations() {
+  if constexpr (!AllocationStats::enabled) return;
+  if (AllocationStats::takeExpected()) eventful = true;
+  quietTicks = eventful ? 0 : quietTicks + 1;
+  eventful = false;
+  if (quietTicks <= settleTicks) return;
+
+  AllocationStats::Counts total;
+  total += tickAllocations.entities;
+  total += tickAllocations.motion;
+  total += tickAllocations.views;
+  total += tickAllocations.timeline;
+  steadyTicks++;
+  steadyAllocations += total;
+  if (total.allocations == 0) return;
+  std::cerr << "steady tick allocated " << total.allocations << " times ("
+            << total.bytes << " bytes): entities "
+            << tickAllocations.entities.allocations << ", motion "
+            << tickAllocations.motion.allocations << ", views "
+            << tickAllocations.views.allocations << ", timeline "
+            << tickAllocations.timeline.allocations << std::endl;
+  if (AllocationStats::isStrict()) std::abort();
+}
+
+void TransitSimulation::updateInterest(Subscriber& s) {
+  inRegion.clear();
+  grid.query(s.minX, s.minZ, s.maxX, s.maxZ, inRegion);
+  std::sort(inRegion.begin(), inRegion.end());
+
+  // both lists are sorted, so whatever left the region is found in one pass
+  auto now = inRegion.begin();
+  for (int id : s.visible) {
+    while (now != inRegion.end() && *now < id) ++now;
+    if (now == inRegion.end() || *now != id) {
+      s.session->sendMessage(removeEvent(id));
+      s.reckoned.erase(id);
+      eventful = true;
+    }
+  }
+  for (int id : inRegion) {
+    if (std::binary_search(s.visible.begin(), s.visible.end(), id)) {
+      sendCorrection(s, id);
+    } else {
+      introduce(s, *updated(id));
+    }
+  }
+  s.visible.assign(inRegion.begin(), inRegion.end());
+}
+
+void TransitSimulation::sendCorrection(Subscriber& s, int id) {
+  const IEntity& entity = *updated(id);
+  auto it = s.reckoned.find(id);
+  if (it != s.reckoned.end()) {
+    const Reckoning& r = it->second;
+    Vector3 predicted = r.pos + r.vel * (time - r.time);
+    bool drifted =
+        (entity.getPosition() - predicted).magnitude() > correctionThreshold;
+    bool turned = (entity.getDirection() - r.dir).magnitude() > 1e-6;
+    bool stale = time - r.time >= maxSilence && r.vel.magnitude() > 0;
+    if (!drifted && !turned && !stale && entity.getColor() == r.color) return;
+  }
+  s.session->sendMessage(updateFrame(id));
+  remember(s, entity);
+}
+
+void TransitSimulation::introduce(Subscriber& s, const IEntity& entity) {
+  eventful = true;
+  bool known = !s.knownDetails.insert(entity.getDetailsId()).second;
+  s.session->sendMessage(addEvent(entity, !known));
+  remember(s, entity);
+}
+
+void TransitSimulation::remember(Subscriber& s, const IEntity& entity) {
+  auto m = motion.find(entity.getId());
+  Vector3 vel = m != motion.end() ? m->second.vel : Vector3();
+  // assigned member by member so the color reuses the string it replaces
+  Reckoning& r = s.reckoned[entity.getId()];
+  r.pos = entity.getPosition();
+  r.vel = vel;
+  r.dir = entity.getDirection();
+  r.color = entity.getColor();
+  r.time = time;
+}
+
+const std::shared_ptr<const std::string>& TransitSimulation::updateFrame(
+    int id) {
+  std::shared_ptr<const std::string>& frame = frames[id];
+  if (!frame) {
+    frame = updateEvent(*updated(id));
+  }
+  return frame;
+}
+
+void TransitSimulation::addEntity(const IEntity& entity) {
+  eventful = true;
+  reserveEnvelopes();
+  // limited views pick new entities up from the grid on the next frame.
+  // both forms of the message are serialized at most once.
+  std::shared_ptr<const std::string> full, brief;
+  for (Subscriber& s : subscribers) {
+    if (s.limited) continue;
+    bool known = !s.knownDetails.insert(entity.getDetailsId()).second;
+    std::shared_ptr<const std::string>& msg = known ? brief : full;
+    if (!msg) msg = addEvent(entity, !known);
+    s.session->sendMessage(msg);
+    remember(s, entity);
+  }
+}
+
+void TransitSimulation::updateEntity(const IEntity& entity) {
+  int id = entity.getId();
+  if (id >= updateEntites.size()) {
+    updateEntites.resize(id + 1);
+    eventful = true;
+  }
+  // entities are updated more than once when a frame is split into steps
+  if (!updateEntites[id]) updatedIds.push_back(id);
+  updateEntites[id] = &entity;
+}
+
+void TransitSimulation::removeEntity(const IEntity& entity) {
+  eventful = true;
+  int id = entity.getId();
+  // its id stays in updatedIds until the next frame, pointing at nothing
+  if (id < updateEntites.size()) updateEntites[id] = nullptr;
+  if (id < frames.size()) frames[id].reset();
+  motion.erase(id);
+  std::shared_ptr<const std::string> msg = removeEvent(id);
+  for (Subscriber& s : subscribers) {
+    s.reckoned.erase(id);
+    if (!s.limited) {
+      s.session->sendMessage(msg);
+      continue;
+    }
+    auto it = std::lower_bound(s.visible.begin(), s.visible.end(), id);
+    if (it != s.visible.end() && *it == id) {
+      s.visible.erase(it);
+      s.session->sendMessage(msg);
+    }
+  }
+}
+
+void TransitSimulation::sendEventToView(const std::string& event,
+                                        const JsonObject& details) {
+  eventful = true;
+  broadcast(serializeEvent(event, details));
+}
+
+std::shared_ptr<const std::string> TransitSimulation::serializeEvent(
+    const std::string& event, const JsonObject& details) {
+  JsonObject eventData;
+  eventData["event"] = event;
+  eventData["details"] = details;
+  return std::make_shared<const std::string>(eventData.toString());
+}
+
+std::shared_ptr<const std::string> TransitSimulation::addEvent(
+    const IEntity& entity, bool withDetails) {
+  writer.clear();
+  writer.beginObject().key("event").value("AddEntity").key("details");
+  writer.beginObject();
+  if (withDetails) writer.key("details").raw(entity.getDetailsText());
+  writer.key("name").value(entity.getName());
+  writeState(entity);
+  writer.endObject().endObject();
+  return envelope(writer.str());
+}
+
+std::shared_ptr<const std::string> TransitSimulation::updateEvent(
+    const IEntity& entity) {
+  writer.clear();
+  writer.beginObject().key("event").value("UpdateEntity").key("details");
+  writer.beginObject();
+  writeState(entity);
+  writer.endObject().endObject();
+  return envelope(writer.str());
+}
+
+void TransitSimulation::writeState(const IEntity& entity) {
+  writer.key("detailsId").value(entity.getDetailsId());
+  writer.key("id").value(entity.getId());
+  writer.key("pos").value(entity.getPosition());
+  writer.key("dir").value(entity.getDirection());
+  auto m = motion.find(entity.getId());
+  if (m != motion.end()) writer.key("vel").value(m->second.vel);
+  writer.key("time").value(time);
+  const std::string& color = entity.getColor();
+  if (color != "") writer.key("color").value(color);
+}
+
+std::shared_ptr<const std::string> TransitSimulation::removeEvent(int id) {
+  writer.clear();
+  writer.beginObject().key("event").value("RemoveEntity").key("details");
+  writer.beginObject().key("id").value(id).endObject().endObject();
+  return envelope(writer.str());
+}
+
+std::shared_ptr<const std::string> TransitSimulation::envelope(
+    const std::string& text) {
+  // buffers are handed out around the ring and usually released in that
+  // order, so the oldest ones after the last one used are the likeliest to
+  // be free; only a few are tried before the ring grows
+  size_t tries = std::min(envelopes.size(), envelopeTries);
+  for (size_t n = 0; n < tries; n++) {
+    std::shared_ptr<std::string>& e = envelopes[nextEnvelope];
+    nextEnvelope = (nextEnvelope + 1) % envelopes.size();
+    if (e.use_count() == 1) {
+      e->assign(text);
+      return e;
+    }
+  }
+  std::shared_ptr<std::string> e = std::make_shared<std::string>();
+  e->reserve(envelopeReserve);
+  e->assign(text);
+  // while sessions hold every buffer the ring stays as it is and messages
+  // get buffers of their own
+  if (envelopes.size() < maxEnvelopes) {
+    // the new buffer goes just before the oldest, as the newest in the ring
+    envelopes.insert(envelopes.begin() + nextEnvelope, e);
+    nextEnvelope = (nextEnvelope + 1) % envelopes.size();
+  }
+  return e;
+}
+
+void TransitSimulation::reserveEnvelopes() {
+  // a tick sends about one message per entity, and a session that keeps up
+  // has sent them by the next one. Buffers are added as the newest in the
+  // ring, so those handed out go on being tried first.
+  size_t wanted = std::min(maxEnvelopes, 2 * model.getEntities().size());
+  if (envelopes.size() >= wanted) return;
+  std::vector<std::shared_ptr<std::string>> added(wanted - envelopes.size());
+  for (std::shared_ptr<std::string>& e : added) {
+    e = std::make_shared<std::string>();
+    e->reserve(envelopeReserve);
+  }
+  envelopes.insert(envelopes.begin() + nextEnvelope, added.begin(),
+                   added.end());
+  nextEnvelope = (nextEnvelope + added.size()) % envelopes.size();
+}
+
+void TransitSimulation::broadcast(
+    const std::shared_ptr<const std::string>& msg) {
+  for (Subscriber& s : subscribers) s.session->sendMessage(msg);
+}
+
+TransitSimulation::Subscriber* TransitSimulation::findSubscriber(
+    const WebServerBase::Session* session) {
+  for (Subscriber& s : subscribers) {
+    if (s.session == session) return &s;
+  }
+  return nullptr;
+}
+
+void TransitSimulation::sendEvent(WebServerBase::Session* session,
+                                  const std::string& event,
+                                  const JsonObject& details) {
+  session->sendMessage(serializeEvent(event, details));
+}
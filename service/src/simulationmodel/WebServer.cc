@@ -4,15 +4,52 @@ Copyright (c) 2019 Dan Orban
 
 #include "WebServer.h"
 
+#include <sys/timerfd.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 
+#include "util/MessageDeflater.h"
+#include "util/Trace.h"
+
 struct WebServerSessionState {
   struct lws *wsi;
-  std::vector<std::string> inMessages;
-  std::vector<std::string> outMessages;
+  WebServerBase *server;
+  std::string inFrame;  // message being reassembled from its fragments
+  // queued messages from outHead on. Sent entries are only dropped once the
+  // queue drains, so its storage is reused instead of growing and shrinking
+  std::vector<std::shared_ptr<const std::string>> outMessages;
+  size_t outHead = 0;
   std::vector<WebServerBase::Session *> *sessions;
   std::map<int, WebServerBase::Session *> *sessionMap;
+  std::map<std::string, std::string> connectArgs;
+  bool deflate = false;                    // set if the client negotiated it
+  bool closing = false;                    // disconnected for falling behind
+  std::vector<unsigned char> writeBuffer;  // reused between writes
+  WebServerBase::TransferStats stats;
+
+  // whether the session sends the message deflated, and so holds its frame
+  bool holds(const std::string &msg) const {
+    return deflate && msg.length() >= server->deflate.threshold;
+  }
+
+  // forgets every message still queued
+  void dropQueue() {
+    for (size_t i = outHead; i < outMessages.size(); i++) {
+      if (holds(*outMessages[i])) server->releaseFrame(outMessages[i]);
+    }
+    outMessages.clear();
+    outHead = 0;
+  }
+
+  // closes the connection from the event loop, sending nothing more
+  void hangUp() {
+    dropQueue();
+    closing = true;
+    lws_set_timeout(wsi, PENDING_TIMEOUT_USER_OK, LWS_TO_KILL_ASYNC);
+  }
 };
 
 WebServerBase::Session::Session() {
@@ -34,39 +71,127 @@ WebServerBase::Session::~Session() {
   std::map<int, Session *> &sessionMap = *sessionState->sessionMap;
   sessionMap.erase(sessionMap.find(id));
 
+  sessionState->dropQueue();
   delete sessionState;
 }
 
 void WebServerBase::Session::sendMessage(const std::string &msg) {
+  sendMessage(std::make_shared<const std::string>(msg));
+}
+
+void WebServerBase::Session::sendMessage(
+    const std::shared_ptr<const std::string> &msg) {
   WebServerSessionState &sessionState =
       *static_cast<WebServerSessionState *>(state);
-  sessionState.outMessages.push_back(msg);
+  std::vector<std::shared_ptr<const std::string>> &queue =
+      sessionState.outMessages;
+  if (sessionState.closing) return;
+  if (queue.size() - sessionState.outHead >= sessionState.server->maxQueued) {
+    // dropping some of the frames would leave the client's view wrong, so a
+    // client this far behind is hung up on and has to reconnect
+    std::cout << "Session " << id << " fell behind by "
+              << queue.size() - sessionState.outHead
+              << " messages, disconnecting" << std::endl;
+    static const char reason[] = "too far behind";
+    lws_close_reason(sessionState.wsi, LWS_CLOSE_STATUS_POLICY_VIOLATION,
+                     (unsigned char *)reason, sizeof(reason) - 1);
+    sessionState.hangUp();
+    return;
+  }
+  // a client that reads slower than it is sent to keeps the queue from ever
+  // draining, so sent entries are dropped once they are half of it
+  if (sessionState.outHead >= 64 && sessionState.outHead * 2 >= queue.size()) {
+    queue.erase(queue.begin(), queue.begin() + sessionState.outHead);
+    sessionState.outHead = 0;
+  }
+  if (sessionState.holds(*msg)) sessionState.server->holdFrame(msg);
+  queue.push_back(msg);
   lws_callback_on_writable(sessionState.wsi);
 }
 
 void WebServerBase::Session::onWrite() {
+  TRACE_SCOPE("Session::onWrite");
   WebServerSessionState &sessionState =
       *static_cast<WebServerSessionState *>(state);
 
-  if (sessionState.outMessages.size() == 0) {
+  std::vector<std::shared_ptr<const std::string>> &queue =
+      sessionState.outMessages;
+  if (sessionState.outHead == queue.size()) {
+    return;
+  }
+  std::shared_ptr<const std::string> msg =
+      std::move(queue[sessionState.outHead++]);
+  if (sessionState.outHead == queue.size()) {
+    queue.clear();
+    sessionState.outHead = 0;
+  }
+  const std::string &val = *msg;
+  std::vector<unsigned char> &buf = sessionState.writeBuffer;
+  TransferStats &stats = sessionState.stats;
+
+  // large frames are deflated and sent as binary, everything else as text
+  const unsigned char *payload =
+      reinterpret_cast<const unsigned char *>(val.data());
+  size_t newLen = val.length();
+  enum lws_write_protocol mode = LWS_WRITE_TEXT;
+  bool held = sessionState.holds(val);
+  if (held) {
+    const std::vector<unsigned char> &deflated =
+        sessionState.server->deflateFrame(msg, stats);
+    if (!deflated.empty()) {
+      payload = deflated.data();
+      newLen = deflated.size();
+      mode = LWS_WRITE_BINARY;
+      stats.compressed++;
+    }
+  }
+  if (buf.size() < LWS_SEND_BUFFER_PRE_PADDING + newLen) {
+    buf.resize(LWS_SEND_BUFFER_PRE_PADDING + newLen);
+  }
+  memcpy(&buf[LWS_SEND_BUFFER_PRE_PADDING], payload, newLen);
+  int written = lws_write(sessionState.wsi, &buf[LWS_SEND_BUFFER_PRE_PADDING],
+                          newLen, mode);
+  if (held) sessionState.server->releaseFrame(msg);
+  if (written < static_cast<int>(newLen)) {
+    // lws buffers what the socket does not take, so this only happens on a
+    // broken connection. A client that missed a frame would show the
+    // simulation wrong from then on, so it has to reconnect.
+    std::cout << "Session " << id << " could not be written to, disconnecting"
+              << std::endl;
+    sessionState.hangUp();
     return;
   }
-  std::string val = sessionState.outMessages[0];
-
-  int newLen = val.length();
-  unsigned char *buf = (unsigned char *)malloc(
-      LWS_SEND_BUFFER_PRE_PADDING + newLen + LWS_SEND_BUFFER_POST_PADDING);
-  memcpy(&buf[LWS_SEND_BUFFER_PRE_PADDING], val.c_str(), newLen);
-  lws_write(sessionState.wsi, &buf[LWS_SEND_BUFFER_PRE_PADDING], newLen,
-            LWS_WRITE_TEXT);
-  free(buf);
-  sessionState.outMessages.erase(sessionState.outMessages.begin());
-
-  if (sessionState.outMessages.size() > 0) {
+
+  stats.messages++;
+  stats.rawBytes += val.length();
+  stats.wireBytes += newLen;
+
+  if (sessionState.outHead < queue.size()) {
     lws_callback_on_writable(sessionState.wsi);
   }
 }
 
+bool WebServerBase::Session::isCompressed() const {
+  return static_cast<WebServerSessionState *>(state)->deflate;
+}
+
+const WebServerBase::TransferStats &WebServerBase::Session::getTransferStats()
+    const {
+  return static_cast<WebServerSessionState *>(state)->stats;
+}
+
+WebServerBase *WebServerBase::Session::getServer() const {
+  return static_cast<WebServerSessionState *>(state)->server;
+}
+
+std::string WebServerBase::Session::getConnectArg(
+    const std::string &name) const {
+  const std::map<std::string, std::string> &args =
+      static_cast<WebServerSessionState *>(state)->connectArgs;
+  auto it = args.find(name);
+  return it != args.end() ? it->second : "";
+}
+
 struct web_server_per_session_data_input {
   struct lws *wsi;
   WebServerBase::Session *impl;
@@ -76,6 +201,7 @@ struct web_server_per_session_data_input {
 struct post_per_session_data_input {
   int id;
   std::string data;
+  std::string *response;  // body still to be written, if any
 };
 
 static const struct lws_protocol_vhost_options pvo_mime = {
@@ -135,13 +261,24 @@ int callback_web_server(struct lws *wsi, enum lws_callback_reasons reason,
       break;
     }
     case LWS_CALLBACK_CLOSED: {
+      const WebServerBase::TransferStats &stats =
+          pss->impl->getTransferStats();
+      std::cout << "Connection closed (" << stats.messages << " messages, "
+                << stats.compressed << " deflated, " << stats.rawBytes
+                << " -> " << stats.wireBytes << " bytes, "
+                << stats.deflateSeconds * 1000 << " ms deflating)"
+                << std::endl;
       delete pss->impl;
-      std::cout << "Connection closed" << std::endl;
       break;
     }
     case LWS_CALLBACK_RECEIVE: {
-      std::string data(reinterpret_cast<char *>(in), len);
-      pss->state->inMessages.push_back(data);
+      // large messages arrive in pieces, handle them as soon as complete
+      std::string &frame = pss->state->inFrame;
+      frame.append(reinterpret_cast<char *>(in), len);
+      if (lws_is_final_fragment(wsi)) {
+        pss->impl->receiveMessage(frame);
+        frame.clear();
+      }
       break;
     }
     case LWS_CALLBACK_SERVER_WRITEABLE: {
@@ -173,6 +310,23 @@ int callback_post(struct lws *wsi, enum lws_callback_reasons reason, void *user,
         // std::cout << pss->id << std::endl;
         return 0;
       }
+      if (target == "/metrics") {
+        // headers now, the body once the connection is writable
+        pss->response = new std::string(webServer->getMetrics());
+        unsigned char headers[LWS_PRE + 256];
+        unsigned char *p = headers + LWS_PRE;
+        unsigned char *end = headers + sizeof(headers);
+        if (lws_add_http_common_headers(
+                wsi, HTTP_STATUS_OK, "text/plain; version=0.0.4",
+                pss->response->size(), &p, end) ||
+            lws_finalize_http_header(wsi, &p, end)) {
+          return 1;
+        }
+        lws_write(wsi, headers + LWS_PRE, p - (headers + LWS_PRE),
+                  LWS_WRITE_HTTP_HEADERS);
+        lws_callback_on_writable(wsi);
+        return 0;
+      }
       // if (!strcmp((const char *)in, "/post")) {
       /* assertively allow it to exist in the URL space */
       // return 0;
@@ -205,6 +359,17 @@ int callback_post(struct lws *wsi, enum lws_callback_reasons reason, void *user,
       break;
 
     case LWS_CALLBACK_HTTP_WRITEABLE: {
+      if (pss->response) {
+        std::vector<unsigned char> body(LWS_PRE + pss->response->size());
+        memcpy(&body[LWS_PRE], pss->response->data(), pss->response->size());
+        delete pss->response;
+        pss->response = nullptr;
+        if (lws_write(wsi, &body[LWS_PRE], body.size() - LWS_PRE,
+                      LWS_WRITE_HTTP_FINAL) < 0) {
+          return -1;
+        }
+        return lws_http_transaction_completed(wsi) ? -1 : 0;
+      }
       // std::cout << "LWS_CALLBACK_HTTP_WRITEABLE" << std::endl;
       // std::cout << webServer->sessions.size() << std::endl;
       // std::cout << pss->data << std::endl;
@@ -214,7 +379,13 @@ int callback_post(struct lws *wsi, enum lws_callback_reasons reason, void *user,
     }
 
     case LWS_CALLBACK_HTTP_DROP_PROTOCOL:
+    case LWS_CALLBACK_CLOSED_HTTP:
       // std::cout << "LWS_CALLBACK_HTTP_DROP_PROTOCOL" << std::endl;
+      // a metrics body the connection closed before taking
+      if (pss) {
+        delete pss->response;
+        pss->response = nullptr;
+      }
       break;
 
     default:
@@ -224,6 +395,31 @@ int callback_post(struct lws *wsi, enum lws_callback_reasons reason, void *user,
   return lws_callback_http_dummy(wsi, reason, user, in, len);
 }
 
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+/* RFC 7692 permessage-deflate, used when libwebsockets is built with it */
+static const struct lws_extension web_server_extensions[] = {
+    {"permessage-deflate", lws_extension_callback_pm_deflate,
+     "permessage-deflate; client_no_context_takeover; "
+     "client_max_window_bits"},
+    {NULL, NULL, NULL /* terminator */}};
+#endif
+
+int callback_timer(struct lws *wsi, enum lws_callback_reasons reason,
+                   void *user, void *in, size_t len) {
+  if (reason == LWS_CALLBACK_RAW_RX_FILE) {
+    std::function<void()> *callback =
+        static_cast<std::function<void()> *>(lws_get_opaque_user_data(wsi));
+    uint64_t expirations;
+    // missed expirations are folded into one call
+    if (read(lws_get_socket_fd(wsi), &expirations, sizeof(expirations)) ==
+            sizeof(expirations) &&
+        callback) {
+      (*callback)();
+    }
+  }
+  return 0;
+}
+
 struct lws_protocols web_server_protocols[] = {
     /* first protocol must always be HTTP handler */
     {
@@ -237,6 +433,11 @@ struct lws_protocols web_server_protocols[] = {
         sizeof(
             struct web_server_per_session_data_input)  // per_session_data_size
     },
+    {
+        "timer",         // name
+        callback_timer,  // callback
+        0                // per_session_data_size
+    },
     /*{
                     "protocol-post",   // name
                     callback_post, // callback
@@ -248,7 +449,11 @@ struct lws_protocols web_server_protocols[] = {
     }};
 
 WebServerBase::WebServerBase(int port, const std::string &webDir)
-    : webDir(webDir) {
+    : WebServerBase(port, webDir, DeflateOptions()) {}
+
+WebServerBase::WebServerBase(int port, const std::string &webDir,
+                             const DeflateOptions &deflate)
+    : webDir(webDir), deflate(deflate) {
   struct lws_context_creation_info info;
 
   memset(&info, 0, sizeof(info));
@@ -256,7 +461,11 @@ WebServerBase::WebServerBase(int port, const std::string &webDir)
   info.port = port;
   info.iface = NULL;
   info.protocols = web_server_protocols;
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+  info.extensions = deflate.enabled ? web_server_extensions : NULL;
+#else
   info.extensions = NULL;
+#endif
   info.ssl_cert_filepath = NULL;
   info.ssl_private_key_filepath = NULL;
   info.ssl_ca_filepath = NULL;
@@ -291,25 +500,188 @@ void WebServerBase::createSession(void *info) {
   pss->impl = session;
   pss->state = new WebServerSessionState();
   pss->state->wsi = pss->wsi;
+  pss->state->server = this;
+  // with sent entries dropped once they are half of it, the queue never
+  // holds more than twice maxQueued, so it is reserved once and never grows
+  pss->state->outMessages.reserve(2 * maxQueued + 64);
   session->state = pss->state;
   pss->state->sessions = &sessions;
   pss->state->sessionMap = &sessionMap;
   sessionMap[session->getId()] = session;
+
+  // the request headers are only around until the handshake completes
+  char arg[256];
+  for (int n = 0; lws_hdr_copy_fragment(pss->wsi, arg, sizeof(arg),
+                                        WSI_TOKEN_HTTP_URI_ARGS, n) > 0;
+       n++) {
+    std::string kv(arg);
+    size_t eq = kv.find('=');
+    pss->state->connectArgs[kv.substr(0, eq)] =
+        eq == std::string::npos ? "" : kv.substr(eq + 1);
+  }
+  negotiateDeflate(pss->state);
+
   std::string id = std::to_string(session->getId());
   session->sendMessage(id);
+  session->onConnect();
+}
+
+void WebServerBase::negotiateDeflate(WebServerSessionState *state) {
+  if (!deflate.enabled) return;
+
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+  // permessage-deflate negotiated by libwebsockets itself already compresses
+  // every frame, so don't compress twice
+  char ext[256];
+  if (lws_hdr_copy(state->wsi, ext, sizeof(ext), WSI_TOKEN_EXTENSIONS) > 0 &&
+      strstr(ext, "permessage-deflate")) {
+    return;
+  }
+#endif
+
+  // otherwise clients opt in by connecting to /?compress=deflate
+  auto it = state->connectArgs.find("compress");
+  if (it != state->connectArgs.end() && it->second == "deflate") {
+    if (!deflater) deflater = std::make_unique<MessageDeflater>(deflate.level);
+    state->deflate = true;
+  }
+}
+
+void WebServerBase::holdFrame(const std::shared_ptr<const std::string> &msg) {
+  deflatedFrames[msg.get()].queued++;
+}
+
+const std::vector<unsigned char> &WebServerBase::deflateFrame(
+    const std::shared_ptr<const std::string> &msg, TransferStats &stats) {
+  DeflatedFrame &frame = deflatedFrames[msg.get()];
+  if (!frame.compressed) {
+    // CPU time of this thread alone, so dispatch evaluations running beside
+    // the event loop are not counted
+    double start = MessageDeflater::threadSeconds();
+    deflater->compress(*msg, frame.data);
+    frame.compressed = true;
+    stats.deflateSeconds += MessageDeflater::threadSeconds() - start;
+  }
+  return frame.data;
+}
+
+void WebServerBase::releaseFrame(
+    const std::shared_ptr<const std::string> &msg) {
+  auto it = deflatedFrames.find(msg.get());
+  if (it != deflatedFrames.end() && --it->second.queued == 0) {
+    deflatedFrames.erase(it);
+  }
 }
 
 void WebServerBase::service(int time) {
-  lws_service(context, time);
-  for (int f = 0; f < sessions.size(); f++) {
-    WebServerSessionState *sessionState =
-        static_cast<WebServerSessionState *>(sessions[f]->state);
-    for (int i = 0; i < sessionState->inMessages.size(); i++) {
-      sessions[f]->receiveMessage(sessionState->inMessages[i]);
-    }
+  {
+    // libwebsockets sleeps in poll() until a socket, a timer or the eventfd
+    // behind lws_cancel_service() is ready
+    TRACE_SCOPE("lws_service");
+    lws_service(context, 0);
+  }
 
+  TRACE_SCOPE("WebServerBase::service");
+  {
+    std::lock_guard<std::mutex> lock(postedMutex);
+    running.swap(posted);
+  }
+  for (std::function<void()> &task : running) task();
+  running.clear();
+
+  for (int f = 0; f < sessions.size(); f++) {
     sessions[f]->update();
+  }
+}
+
+bool WebServerBase::addTimer(double interval, std::function<void()> callback) {
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) return false;
+
+  struct itimerspec spec;
+  spec.it_interval.tv_sec = static_cast<time_t>(interval);
+  spec.it_interval.tv_nsec =
+      static_cast<long>((interval - spec.it_interval.tv_sec) * 1e9);  // NOLINT
+  spec.it_value = spec.it_interval;
+  if (timerfd_settime(fd, 0, &spec, NULL) < 0) {
+    close(fd);
+    return false;
+  }
+
+  lws_sock_file_fd_type desc;
+  desc.filefd = fd;
+  struct lws *wsi = lws_adopt_descriptor_vhost(
+      lws_get_vhost_by_name(context, "default"), LWS_ADOPT_RAW_FILE_DESC, desc,
+      "timer", NULL);
+  if (!wsi) {
+    close(fd);
+    return false;
+  }
+
+  timers.push_back(
+      std::make_unique<std::function<void()>>(std::move(callback)));
+  lws_set_opaque_user_data(wsi, timers.back().get());
+  return true;
+}
+
+void WebServerBase::post(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(postedMutex);
+    posted.push_back(std::move(task));
+  }
+  wake();
+}
+
+void WebServerBase::wake() { lws_cancel_service(context); }
 
-    sessionState->inMessages.clear();
+void WebServerBase::setMetrics(std::function<void(std::string &)> writer) {
+  metricsWriter = std::move(writer);
+}
+
+std::string WebServerBase::getMetrics() const {
+  std::string out;
+  out += "# HELP transit_sessions Connected websocket sessions.\n";
+  out += "# TYPE transit_sessions gauge\n";
+  out += "transit_sessions " + std::to_string(sessions.size()) + "\n";
+  out += "# HELP transit_deflated_frames Frames kept deflated for the "
+         "sessions that have them queued.\n";
+  out += "# TYPE transit_deflated_frames gauge\n";
+  out += "transit_deflated_frames " + std::to_string(deflatedFrames.size()) +
+         "\n";
+
+  struct Family {
+    const char *name;
+    const char *type;
+    const char *help;
+    size_t (*value)(const WebServerSessionState &);
+  };
+  static const Family families[] = {
+      {"transit_session_queue_depth", "gauge",
+       "Messages queued for a session and not yet written.",
+       [](const WebServerSessionState &s) {
+         return s.outMessages.size() - s.outHead;
+       }},
+      {"transit_session_messages_total", "counter",
+       "Messages written to a session.",
+       [](const WebServerSessionState &s) { return s.stats.messages; }},
+      {"transit_session_raw_bytes_total", "counter",
+       "Payload bytes written to a session, before compression.",
+       [](const WebServerSessionState &s) { return s.stats.rawBytes; }},
+      {"transit_session_wire_bytes_total", "counter",
+       "Payload bytes written to a session, after compression.",
+       [](const WebServerSessionState &s) { return s.stats.wireBytes; }},
+  };
+  for (const Family &family : families) {
+    out += std::string("# HELP ") + family.name + " " + family.help + "\n";
+    out += std::string("# TYPE ") + family.name + " " + family.type + "\n";
+    for (const Session *session : sessions) {
+      const WebServerSessionState &state =
+          *static_cast<const WebServerSessionState *>(session->state);
+      out += std::string(family.name) + "{session=\"" +
+             std::to_string(session->getId()) + "\"} " +
+             std::to_string(family.value(state)) + "\n";
+    }
   }
+  if (metricsWriter) metricsWriter(out);
+  return out;
 }
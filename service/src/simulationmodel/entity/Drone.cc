@@ -4,16 +4,9 @@
 #include <cmath>
 #include <limits>
 
-#include "AstarStrategy.h"
-#include "BeelineStrategy.h"
-#include "BfsStrategy.h"
 #include "DataCollector.h"
-#include "DfsStrategy.h"
-#include "DijkstraStrategy.h"
-#include "JumpDecorator.h"
 #include "Package.h"
 #include "SimulationModel.h"
-#include "SpinDecorator.h"
 #include "StrategyFactory.h"
 
 Drone::Drone(const JsonObject& obj) : IEntity(obj) {
@@ -23,10 +16,7 @@ Drone::Drone(const JsonObject& obj) : IEntity(obj) {
   DataCollector::getInstance().recordDrone(this->getId());
 }
 
-Drone::~Drone() {
-  if (toPackage) delete toPackage;
-  if (toFinalDestination) delete toFinalDestination;
-}
+Drone::~Drone() {}
 
 void Drone::getNextDelivery() {
   if (model && model->scheduledDeliveries.size() > 0) {
@@ -42,30 +32,14 @@ void Drone::getNextDelivery() {
       Vector3 packagePosition = package->getPosition();
       Vector3 finalDestination = package->getDestination();
 
-      toPackage = new BeelineStrategy(position, packagePosition);
-
-      std::string strat = package->getStrategyName();
-      if (strat == "astar") {
-        toFinalDestination = new JumpDecorator(new AstarStrategy(
-            packagePosition, finalDestination, model->getGraph()));
-      } else if (strat == "dfs") {
-        toFinalDestination =
-            new SpinDecorator(new JumpDecorator(new DfsStrategy(
-                packagePosition, finalDestination, model->getGraph())));
-      } else if (strat == "bfs") {
-        toFinalDestination =
-            new SpinDecorator(new SpinDecorator(new BfsStrategy(
-                packagePosition, finalDestination, model->getGraph())));
-      } else if (strat == "dijkstra") {
-        toFinalDestination =
-            new JumpDecorator(new SpinDecorator(new DijkstraStrategy(
-                packagePosition, finalDestination, model->getGraph())));
-      } else {
-        toFinalDestination =
-            new BeelineStrategy(packagePosition, finalDestination);
-      }
+      toPackage.start<BeelineStrategy>(position, packagePosition,
+                                       getMemoryResource());
+      StrategyFactory::createDelivery(
+          package->getStrategyName(), packagePosition, finalDestination,
+          model->getGraph(), toFinalDestination, getMemoryResource());
       // Indicate that this drone has started a delivery
-      DataCollector::getInstance().startDelivery(this->getId());
+      DataCollector::getInstance().startDelivery(
+          this->getId(), package->getId(), model->getTime());
       DataCollector::getInstance().startDeliveryTimer(this->getId());
     }
   }
@@ -77,33 +51,30 @@ void Drone::update(double dt) {
   Vector3 previousPosition = this->getPosition();
 
   if (toPackage) {
-    toPackage->move(this, dt);
+    toPackage.move(this, dt);
 
-    if (toPackage && toPackage->isCompleted()) {
+    if (toPackage.isCompleted()) {
       std::string message = getName() + " picked up: " + package->getName();
       notifyObservers(message);
-      delete toPackage;
-      toPackage = nullptr;
+      toPackage.reset();
       pickedUp = true;
 
-      DataCollector::getInstance().recordPickupTime(this->getId(),
-                                                    std::time(nullptr));
-      DataCollector::getInstance().recordPickupLocation(this->getId(),
-                                                        this->getPosition());
+      DataCollector::getInstance().recordPickup(
+          this->getId(), std::time(nullptr), this->getPosition(),
+          model->getTime());
     }
   } else if (toFinalDestination) {
-    toFinalDestination->move(this, dt);
+    toFinalDestination.move(this, dt);
 
     if (package && pickedUp) {
       package->setPosition(position);
       package->setDirection(direction);
     }
 
-    if (toFinalDestination && toFinalDestination->isCompleted()) {
+    if (toFinalDestination.isCompleted()) {
       std::string message = getName() + " dropped off: " + package->getName();
       notifyObservers(message);
-      delete toFinalDestination;
-      toFinalDestination = nullptr;
+      toFinalDestination.reset();
       package->handOff();
       package = nullptr;
       available = true;
@@ -114,9 +85,8 @@ void Drone::update(double dt) {
           DataCollector::getInstance().getDeliveryStartTime(this->getId());
       int duration = static_cast<int>(difftime(end, start));
       DataCollector::getInstance().recordDeliveryTime(this->getId(), duration);
-      DataCollector::getInstance().recordDropoffTime(this->getId(), end);
-      DataCollector::getInstance().recordDropoffLocation(this->getId(),
-                                                         this->getPosition());
+      DataCollector::getInstance().recordDropoff(
+          this->getId(), end, this->getPosition(), model->getTime());
     }
   }
 
@@ -144,7 +114,7 @@ JsonObject Drone::toJson() const {
       {this->getDirection().x, this->getDirection().y, this->getDirection().z});
   obj["speed"] = static_cast<double>(this->getSpeed());
   obj["color"] = this->getColor();
-  obj["details"] = this->getDetails();
+  obj["detailsId"] = this->getDetailsId();
 
   obj["available"] = available;
   obj["pickedUp"] = pickedUp;
@@ -156,7 +126,7 @@ JsonObject Drone::toJson() const {
   }
 
   if (toPackage) {
-    obj["toPackageStrategy"] = toPackage->getName();
+    obj["toPackageStrategy"] = toPackage.getName();
   } else {
     obj["toPackageStrategy"] = "None";
   }
@@ -171,7 +141,6 @@ JsonObject Drone::toJson() const {
 }
 
 void Drone::fromJson(const JsonObject& obj) {
-  details = obj["details"];
   JsonArray posi = obj["position"];
   Vector3 pos = {posi[0], posi[1], posi[2]};
   this->setPosition(pos);
@@ -189,43 +158,64 @@ void Drone::fromJson(const JsonObject& obj) {
 
   int objid = obj["packageID"];
   if (objid != -1) {
-    std::map<int, IEntity*> curr = model->getEntities();
     int packageID = obj["packageID"];
-    package = static_cast<Package*>(curr[packageID]);
+    package = static_cast<Package*>(model->getEntity(packageID));
 
   } else {
-    toPackage = nullptr;
-    toFinalDestination = nullptr;
+    toPackage.reset();
+    toFinalDestination.reset();
     package = nullptr;
     return;
   }
 
-  const routing::Graph* graph = model->getGraph();
-
   std::string toFinalDestinationName = obj["toFinalDestinationStrategy"];
 
-  toPackage = new BeelineStrategy(position, package->getPosition());
-
-  if ((toFinalDestinationName.compare("None"))) {
-    if (toFinalDestinationName == "astar") {
-      toFinalDestination = new JumpDecorator(
-          new AstarStrategy(package->getPosition(), package->getDestination(),
-                            model->getGraph()));
-    } else if (toFinalDestinationName == "dfs") {
-      toFinalDestination = new SpinDecorator(new JumpDecorator(
-          new DfsStrategy(package->getPosition(), package->getDestination(),
-                          model->getGraph())));
-    } else if (toFinalDestinationName == "bfs") {
-      toFinalDestination = new SpinDecorator(new SpinDecorator(
-          new BfsStrategy(package->getPosition(), package->getDestination(),
-                          model->getGraph())));
-    } else if (toFinalDestinationName == "dijkstra") {
-      toFinalDestination = new JumpDecorator(new SpinDecorator(
-          new DijkstraStrategy(package->getPosition(),
-                               package->getDestination(), model->getGraph())));
-    } else {
-      toFinalDestination = new BeelineStrategy(package->getPosition(),
-                                               package->getDestination());
-    }
+  toPackage.start<BeelineStrategy>(position, package->getPosition(),
+                                   getMemoryResource());
+
+  if (toFinalDestinationName != "None") {
+    StrategyFactory::createDelivery(
+        toFinalDestinationName, package->getPosition(),
+        package->getDestination(), model->getGraph(), toFinalDestination,
+        getMemoryResource());
+  } else {
+    toFinalDestination.reset();
   }
 }
+
+void Drone::save(SnapshotWriter& writer) const {
+  IEntity::save(writer);
+  writer.write(available);
+  writer.write(pickedUp);
+  writer.writeReference(package);
+  toPackage.save(writer);
+  toFinalDestination.save(writer);
+}
+
+void Drone::load(SnapshotReader& reader) {
+  IEntity::load(reader);
+  available = reader.read<bool>();
+  pickedUp = reader.read<bool>();
+  package = nullptr;
+  reader.readReference(
+      [this](IEntity* entity) { package = static_cast<Package*>(entity); });
+  toPackage.load(reader, getMemoryResource());
+  toFinalDestination.load(reader, getMemoryResource());
+}
+
+Drone::Drone(const Drone& drone, std::pmr::memory_resource* resource)
+    : IEntity(drone),
+      available(drone.available),
+      pickedUp(drone.pickedUp),
+      package(drone.package),
+      toPackage(drone.toPackage, resource),
+      toFinalDestination(drone.toFinalDestination, resource),
+      totalMileage(drone.totalMileage) {}
+
+IEntity* Drone::clone(std::pmr::memory_resource* resource) const {
+  return new (resource) Drone(*this, resource);
+}
+
+void Drone::relink(const std::vector<IEntity*>& byId) {
+  package = relinked(package, byId);
+}
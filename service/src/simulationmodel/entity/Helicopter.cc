@@ -4,20 +4,16 @@
 #include <cmath>
 #include <limits>
 
-#include "BeelineStrategy.h"
-#include "StrategyFactory.h"
 
 Helicopter::Helicopter(const JsonObject& obj) : IEntity(obj) {
   this->lastPosition = this->position;
 }
 
-Helicopter::~Helicopter() {
-  if (movement) delete movement;
-}
+Helicopter::~Helicopter() {}
 
 void Helicopter::update(double dt) {
-  if (movement && !movement->isCompleted()) {
-    movement->move(this, dt);
+  if (!movement.isCompleted()) {
+    movement.move(this, dt);
 
     double diff = this->lastPosition.dist(this->position);
 
@@ -33,11 +29,10 @@ void Helicopter::update(double dt) {
       this->distanceTraveled = 0;
     }
   } else {
-    if (movement) delete movement;
     dest.x = ((static_cast<double>(rand())) / RAND_MAX) * (2900) - 1400;
     dest.y = position.y;
     dest.z = ((static_cast<double>(rand())) / RAND_MAX) * (1600) - 800;
-    movement = new BeelineStrategy(position, dest);
+    movement.start<BeelineStrategy>(position, dest, getMemoryResource());
   }
 }
 
@@ -51,7 +46,7 @@ JsonObject Helicopter::toJson() const {
       {this->getDirection().x, this->getDirection().y, this->getDirection().z});
   obj["speed"] = static_cast<double>(this->getSpeed());
   obj["color"] = this->getColor();
-  obj["details"] = this->getDetails();
+  obj["detailsId"] = this->getDetailsId();
 
   obj["distanceTraveled"] = static_cast<double>(distanceTraveled);
   obj["mileCounter"] = static_cast<int>(mileCounter);
@@ -60,7 +55,7 @@ JsonObject Helicopter::toJson() const {
   obj["dest"] = JsonArray({dest.x, dest.y, dest.z});
 
   if (movement) {
-    obj["movementStrategy"] = movement->getName();
+    obj["movementStrategy"] = movement.getName();
   }
 
   return obj;
@@ -90,5 +85,37 @@ void Helicopter::fromJson(const JsonObject& obj) {
   JsonArray destin = obj["dest"];
   Vector3 desti = {destin[0], destin[1], destin[2]};
   dest = desti;
-  movement = new BeelineStrategy(this->position, dest);
+  movement.start<BeelineStrategy>(this->position, dest,
+                                  getMemoryResource());
+}
+
+void Helicopter::save(SnapshotWriter& writer) const {
+  IEntity::save(writer);
+  writer.write(distanceTraveled);
+  writer.write(mileCounter);
+  writer.write(lastPosition);
+  writer.write(dest);
+  movement.save(writer);
+}
+
+void Helicopter::load(SnapshotReader& reader) {
+  IEntity::load(reader);
+  distanceTraveled = reader.read<double>();
+  mileCounter = reader.read<unsigned int>();
+  lastPosition = reader.read<Vector3>();
+  dest = reader.read<Vector3>();
+  movement.load(reader, getMemoryResource());
+}
+
+Helicopter::Helicopter(const Helicopter& helicopter,
+                       std::pmr::memory_resource* resource)
+    : IEntity(helicopter),
+      movement(helicopter.movement, resource),
+      distanceTraveled(helicopter.distanceTraveled),
+      mileCounter(helicopter.mileCounter),
+      lastPosition(helicopter.lastPosition),
+      dest(helicopter.dest) {}
+
+IEntity* Helicopter::clone(std::pmr::memory_resource* resource) const {
+  return new (resource) Helicopter(*this, resource);
 }
@@ -4,7 +4,6 @@
 #include <cmath>
 #include <limits>
 
-#include "AstarStrategy.h"
 #include "SimulationModel.h"
 #include "StrategyFactory.h"
 
@@ -12,13 +11,11 @@ Vector3 Human::kellerPosition(64.0, 254.0, -210.0);
 
 Human::Human(const JsonObject& obj) : IEntity(obj) {}
 
-Human::~Human() {
-  if (movement) delete movement;
-}
+Human::~Human() {}
 
 void Human::update(double dt) {
-  if (movement && !movement->isCompleted()) {
-    movement->move(this, dt);
+  if (!movement.isCompleted()) {
+    movement.move(this, dt);
     bool nearKeller = this->position.dist(Human::kellerPosition) < 85;
     if (nearKeller && !this->atKeller) {
       std::string message = this->getName() + " visited Keller hall";
@@ -26,11 +23,14 @@ void Human::update(double dt) {
     }
     atKeller = nearKeller;
   } else {
-    if (movement) delete movement;
+    movement.reset();
     dest.x = ((static_cast<double>(rand())) / RAND_MAX) * (2900) - 1400;
     dest.y = position.y;
     dest.z = ((static_cast<double>(rand())) / RAND_MAX) * (1600) - 800;
-    if (model) movement = new AstarStrategy(position, dest, model->getGraph());
+    if (model) {
+      movement.start<AstarStrategy>(position, dest, model->getGraph(),
+                                    getMemoryResource());
+    }
   }
 }
 
@@ -44,13 +44,13 @@ JsonObject Human::toJson() const {
       {this->getDirection().x, this->getDirection().y, this->getDirection().z});
   obj["speed"] = static_cast<double>(this->getSpeed());
   obj["color"] = this->getColor();
-  obj["details"] = this->getDetails();
+  obj["detailsId"] = this->getDetailsId();
 
   obj["atKeller"] = atKeller;
   obj["dest"] = JsonArray({dest.x, dest.y, dest.z});
 
   if (movement) {
-    obj["movementStrategy"] = movement->getName();
+    obj["movementStrategy"] = movement.getName();
   }
 
   return obj;
@@ -74,7 +74,32 @@ void Human::fromJson(const JsonObject& obj) {
   if (obj.contains("movementStrategy")) {
     std::string movementStrategyName = obj["movementStrategy"];
     Vector3 currentPosition = getPosition();
-    movement = StrategyFactory::createStrategy(movementStrategyName,
-                                               currentPosition, dest, graph);
+    StrategyFactory::createStrategy(movementStrategyName, currentPosition,
+                                    dest, graph, movement,
+                                    getMemoryResource());
   }
 }
+
+void Human::save(SnapshotWriter& writer) const {
+  IEntity::save(writer);
+  writer.write(atKeller);
+  writer.write(dest);
+  movement.save(writer);
+}
+
+void Human::load(SnapshotReader& reader) {
+  IEntity::load(reader);
+  atKeller = reader.read<bool>();
+  dest = reader.read<Vector3>();
+  movement.load(reader, getMemoryResource());
+}
+
+Human::Human(const Human& human, std::pmr::memory_resource* resource)
+    : IEntity(human),
+      movement(human.movement, resource),
+      atKeller(human.atKeller),
+      dest(human.dest) {}
+
+IEntity* Human::clone(std::pmr::memory_resource* resource) const {
+  return new (resource) Human(*this, resource);
+}
@@ -1,30 +1,83 @@
 #include "IEntity.h"
+
+#include "SimulationModel.h"
+
+namespace {
+
+// Written in front of every entity, so delete knows where it came from
+struct alignas(std::max_align_t) AllocationHeader {
+  std::pmr::memory_resource* resource;
+  std::size_t size;
+};
+
+}  // namespace
+
 int IEntity::currentId = 0;
+int IEntity::reusedId = -1;
 IEntity::IEntity() {
+  if (reusedId != -1) {
+    id = reusedId;
+    reusedId = -1;
+    return;
+  }
   id = currentId;
   currentId++;
 }
 
 IEntity::IEntity(const JsonObject& details) : IEntity() {
-  this->details = details;
-  JsonArray pos(details["position"]);
-  position = {pos[0], pos[1], pos[2]};
-  JsonArray dir(details["direction"]);
-  direction = {dir[0], dir[1], dir[2]};
+  this->details = SharedDetails::intern(details);
+  // decorators are created from the shared template, which has no position,
+  // direction or name; they take those from the entity they wrap
+  if (details.contains("position")) {
+    JsonArray pos(details["position"]);
+    position = {pos[0], pos[1], pos[2]};
+  }
+  if (details.contains("direction")) {
+    JsonArray dir(details["direction"]);
+    direction = {dir[0], dir[1], dir[2]};
+  }
   if (details.contains("color")) {
     std::string col = details["color"];
     color = col;
   }
-  std::string n = details["name"];
-  name = n;
+  if (details.contains("name")) {
+    std::string n = details["name"];
+    name = n;
+  }
   speed = details["speed"];
 }
 
 IEntity::~IEntity() {}
 
+void* IEntity::operator new(std::size_t size,
+                            std::pmr::memory_resource* resource) {
+  std::size_t total = sizeof(AllocationHeader) + size;
+  void* p = resource->allocate(total, alignof(AllocationHeader));
+  AllocationHeader* header = new (p) AllocationHeader{resource, total};
+  return header + 1;
+}
+
+void IEntity::operator delete(void* p) {
+  if (!p) return;
+  AllocationHeader* header = static_cast<AllocationHeader*>(p) - 1;
+  header->resource->deallocate(header, header->size, alignof(AllocationHeader));
+}
+
+void IEntity::operator delete(void* p, std::pmr::memory_resource*) {
+  operator delete(p);
+}
+
+std::pmr::memory_resource* IEntity::getMemoryResource() const {
+  return model ? model->getMemoryResource() : std::pmr::get_default_resource();
+}
+
 void IEntity::linkModel(SimulationModel* model) { this->model = model; }
 
-void IEntity::resetCurrentId() { currentId = 0; }
+void IEntity::resetCurrentId(int id) { currentId = id; }
+
+int IEntity::getCurrentId() { return currentId; }
+
+void IEntity::reuseId(int id) { reusedId = id; }
 
 int IEntity::getId() const { return id; }
 
@@ -32,9 +85,15 @@ Vector3 IEntity::getPosition() const { return position; }
 
 Vector3 IEntity::getDirection() const { return direction; }
 
-const JsonObject& IEntity::getDetails() const { return details; }
+const JsonObject& IEntity::getDetails() const { return details->getJson(); }
 
-std::string IEntity::getColor() const { return color; }
+int IEntity::getDetailsId() const { return details->getId(); }
+
+const std::string& IEntity::getDetailsText() const {
+  return details->getText();
+}
+
+const std::string& IEntity::getColor() const { return color; }
 
 std::string IEntity::getName() const { return name; }
 
@@ -51,3 +110,19 @@ void IEntity::rotate(double angle) {
   direction.x = dirTmp.x * std::cos(angle) - dirTmp.z * std::sin(angle);
   direction.z = dirTmp.x * std::sin(angle) + dirTmp.z * std::cos(angle);
 }
+
+void IEntity::save(SnapshotWriter& writer) const {
+  writer.write(position);
+  writer.write(direction);
+  writer.write(speed);
+  writer.writeString(color);
+  writer.writeString(name);
+}
+
+void IEntity::load(SnapshotReader& reader) {
+  setPosition(reader.read<Vector3>());
+  setDirection(reader.read<Vector3>());
+  speed = reader.read<double>();
+  color = reader.readString();
+  name = reader.readString();
+}
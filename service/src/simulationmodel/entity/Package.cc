@@ -21,6 +21,10 @@ void Package::setStrategyName(std::string strategyName_) {
   strategyName = strategyName_;
 }
 
+const std::string& Package::getColorChain() const { return colorChain; }
+
+void Package::setColorChain(const std::string& colors) { colorChain = colors; }
+
 void Package::update(double dt) {}
 
 void Package::initDelivery(Robot* owner) {
@@ -46,7 +50,7 @@ JsonObject Package::toJson() const {
       {this->getDirection().x, this->getDirection().y, this->getDirection().z});
   obj["speed"] = static_cast<double>(this->getSpeed());
   obj["color"] = this->getColor();
-  obj["details"] = this->getDetails();
+  obj["detailsId"] = this->getDetailsId();
 
   obj["destination"] =
       JsonArray({getDestination().x, getDestination().y, getDestination().z});
@@ -77,9 +81,34 @@ void Package::fromJson(const JsonObject& obj) {
   requiresDelivery_ = obj["requiresDelivery"];
 
   if (obj.contains("ownerID")) {
-    std::map<int, IEntity*> curr = model->getEntities();
     int ownerID = obj["ownerID"];
-    owner = static_cast<Robot*>(curr[ownerID]);
+    owner = static_cast<Robot*>(model->getEntity(ownerID));
     initDelivery(owner);
   }
 }
+
+void Package::save(SnapshotWriter& writer) const {
+  IEntity::save(writer);
+  writer.write(destination);
+  writer.writeString(strategyName);
+  writer.write(requiresDelivery_);
+  writer.writeReference(owner);
+}
+
+void Package::load(SnapshotReader& reader) {
+  IEntity::load(reader);
+  destination = reader.read<Vector3>();
+  strategyName = reader.readString();
+  requiresDelivery_ = reader.read<bool>();
+  // the owner's side of the delivery is restored from its own record
+  reader.readReference(
+      [this](IEntity* entity) { owner = static_cast<Robot*>(entity); });
+}
+
+IEntity* Package::clone(std::pmr::memory_resource* resource) const {
+  return new (resource) Package(*this);
+}
+
+void Package::relink(const std::vector<IEntity*>& byId) {
+  owner = relinked(owner, byId);
+}
@@ -24,7 +24,7 @@ JsonObject Robot::toJson() const {
       {this->getDirection().x, this->getDirection().y, this->getDirection().z});
   obj["speed"] = static_cast<double>(this->getSpeed());
   obj["color"] = this->getColor();
-  obj["details"] = this->getDetails();
+  obj["detailsId"] = this->getDetailsId();
 
   obj["requestedDelivery"] = requestedDelivery;
 
@@ -48,8 +48,29 @@ void Robot::fromJson(const JsonObject& obj) {
   requestedDelivery = obj["requestedDelivery"];
 
   if (obj.contains("packageID")) {
-    std::map<int, IEntity*> curr = model->getEntities();
     int packagedID = obj["packageID"];
-    package = static_cast<Package*>(curr[packagedID]);
+    package = static_cast<Package*>(model->getEntity(packagedID));
   }
 }
+
+void Robot::save(SnapshotWriter& writer) const {
+  IEntity::save(writer);
+  writer.write(requestedDelivery);
+  writer.writeReference(package);
+}
+
+void Robot::load(SnapshotReader& reader) {
+  IEntity::load(reader);
+  requestedDelivery = reader.read<bool>();
+  package = nullptr;
+  reader.readReference(
+      [this](IEntity* entity) { package = static_cast<Package*>(entity); });
+}
+
+IEntity* Robot::clone(std::pmr::memory_resource* resource) const {
+  return new (resource) Robot(*this);
+}
+
+void Robot::relink(const std::vector<IEntity*>& byId) {
+  package = relinked(package, byId);
+}
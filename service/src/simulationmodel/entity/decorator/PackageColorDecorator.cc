@@ -2,10 +2,32 @@
 
 PackageColorDecorator::PackageColorDecorator(Package* p, double h, double s,
                                              double l)
-    : PackageDecorator(p), hue(h), saturation(s), light(l) {}
+    : PackageDecorator(p), hue(h), saturation(s), light(l) {
+  blend();
+}
+
+IEntity* PackageColorDecorator::clone(
+    std::pmr::memory_resource* resource) const {
+  // the copy wraps a copy of the package, not the package itself
+  auto copy = new (resource) PackageColorDecorator(*this);
+  copy->sub = static_cast<Package*>(sub->clone(resource));
+  return copy;
+}
+
+const std::string& PackageColorDecorator::getColor() const { return blended; }
+
+void PackageColorDecorator::setColor(std::string col_) {
+  sub->setColor(col_);
+  blend();
+}
+
+void PackageColorDecorator::load(SnapshotReader& reader) {
+  PackageDecorator::load(reader);
+  blend();
+}
 
-std::string PackageColorDecorator::getColor() const {
-  auto sub_color = sub->getColor();
+void PackageColorDecorator::blend() {
+  const std::string& sub_color = sub->getColor();
   double h, s, l;
   auto format = "hsl(%lf, %lf%%, %lf%%)";
   if (sscanf(sub_color.c_str(), format, &h, &s, &l) == 3) {
@@ -20,5 +42,5 @@ std::string PackageColorDecorator::getColor() const {
   }
   char color[100];
   snprintf(color, sizeof(color), format, h, s, l);
-  return color;
+  blended = color;
 }
@@ -1,8 +1,10 @@
 #include "CompositeFactory.h"
 
-IEntity* CompositeFactory::createEntity(const JsonObject& entity) {
+IEntity* CompositeFactory::createEntity(const JsonObject& entity,
+                                        std::pmr::memory_resource* resource) {
   for (int i = 0; i < componentFactories.size(); i++) {
-    IEntity* createdEntity = componentFactories.at(i)->createEntity(entity);
+    IEntity* createdEntity =
+        componentFactories.at(i)->createEntity(entity, resource);
     if (createdEntity != nullptr) {
       return createdEntity;
     }
@@ -1,10 +1,11 @@
 #include "DroneFactory.h"
 
-IEntity* DroneFactory::createEntity(const JsonObject& entity) {
+IEntity* DroneFactory::createEntity(const JsonObject& entity,
+                                     std::pmr::memory_resource* resource) {
   std::string type = entity["type"];
   if (type.compare("drone") == 0) {
     std::cout << "Drone Created" << std::endl;
-    return new Drone(entity);
+    return new (resource) Drone(entity);
   }
   return nullptr;
 }
@@ -1,10 +1,11 @@
 #include "HelicopterFactory.h"
 
-IEntity* HelicopterFactory::createEntity(const JsonObject& entity) {
+IEntity* HelicopterFactory::createEntity(const JsonObject& entity,
+                                          std::pmr::memory_resource* resource) {
   std::string type = entity["type"];
   if (type.compare("helicopter") == 0) {
     std::cout << "Helicopter Created" << std::endl;
-    return new Helicopter(entity);
+    return new (resource) Helicopter(entity);
   }
   return nullptr;
 }
@@ -1,10 +1,11 @@
 #include "HumanFactory.h"
 
-IEntity* HumanFactory::createEntity(const JsonObject& entity) {
+IEntity* HumanFactory::createEntity(const JsonObject& entity,
+                                     std::pmr::memory_resource* resource) {
   std::string type = entity["type"];
   if (type.compare("human") == 0) {
     std::cout << "Human Created" << std::endl;
-    return new Human(entity);
+    return new (resource) Human(entity);
   }
   return nullptr;
 }
@@ -4,22 +4,31 @@
 #include "GreenDecorator.h"
 #include "RedDecorator.h"
 
-IEntity* PackageFactory::createEntity(const JsonObject& entity) {
+IEntity* PackageFactory::createEntity(const JsonObject& entity,
+                                       std::pmr::memory_resource* resource) {
   std::string type = entity["type"];
   if (type.compare("package") == 0) {
     std::cout << "Package Created" << std::endl;
-    Package* p = new Package(entity);
-    auto range = rand() % 6;  // more colors!!!
-    for (int i = 0; i < range; i++) {
-      switch (rand() % 3) {
-        case 0:
-          p = new RedDecorator(p);
+    Package* p = new (resource) Package(entity);
+    // packages created again, e.g. on resume, keep the colors they had
+    std::string colors;
+    if (entity.contains("colors")) {
+      colors = std::string(entity["colors"]);
+    } else {
+      auto range = rand() % 6;  // more colors!!!
+      for (int i = 0; i < range; i++) colors.push_back("rgb"[rand() % 3]);
+    }
+    p->setColorChain(colors);
+    for (char c : colors) {
+      switch (c) {
+        case 'r':
+          p = new (resource) RedDecorator(p);
           break;
-        case 1:
-          p = new GreenDecorator(p);
+        case 'g':
+          p = new (resource) GreenDecorator(p);
           break;
-        case 2:
-          p = new BlueDecorator(p);
+        case 'b':
+          p = new (resource) BlueDecorator(p);
           break;
       }
     }
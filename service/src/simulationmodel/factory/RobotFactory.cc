@@ -1,10 +1,11 @@
 #include "RobotFactory.h"
 
-IEntity* RobotFactory::createEntity(const JsonObject& entity) {
+IEntity* RobotFactory::createEntity(const JsonObject& entity,
+                                     std::pmr::memory_resource* resource) {
   std::string type = entity["type"];
   if (type.compare("robot") == 0) {
     std::cout << "Robot Created" << std::endl;
-    return new Robot(entity);
+    return new (resource) Robot(entity);
   }
   return nullptr;
 }
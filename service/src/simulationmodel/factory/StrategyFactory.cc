@@ -1,20 +1,39 @@
 #include "StrategyFactory.h"
 
-IStrategy* StrategyFactory::createStrategy(const std::string& strategyName,
-                                           const Vector3& start,
-                                           const Vector3& end,
-                                           const routing::Graph* graph) {
-  if (strategyName == "Astar") {
-    return new AstarStrategy(start, end, graph);
-  } else if (strategyName == "Bfs") {
-    return new BfsStrategy(start, end, graph);
-  } else if (strategyName == "Dfs") {
-    return new DfsStrategy(start, end, graph);
-  } else if (strategyName == "Dijkstra") {
-    return new DijkstraStrategy(start, end, graph);
-  } else if (strategyName == "Beeline") {
-    return new BeelineStrategy(start, end);
+void StrategyFactory::createStrategy(std::string_view strategyName,
+                                     const Vector3& start, const Vector3& end,
+                                     const routing::Graph* graph,
+                                     Movement& movement,
+                                     std::pmr::memory_resource* resource) {
+  if (strategyName == "astar") {
+    movement.start<AstarStrategy>(start, end, graph, resource);
+  } else if (strategyName == "bfs") {
+    movement.start<BfsStrategy>(start, end, graph, resource);
+  } else if (strategyName == "dfs") {
+    movement.start<DfsStrategy>(start, end, graph, resource);
+  } else if (strategyName == "dijkstra") {
+    movement.start<DijkstraStrategy>(start, end, graph, resource);
+  } else if (strategyName == "beeline") {
+    movement.start<BeelineStrategy>(start, end, resource);
   } else {
-    return nullptr;
+    movement.reset();
+  }
+}
+
+void StrategyFactory::createDelivery(std::string_view strategyName,
+                                     const Vector3& start, const Vector3& end,
+                                     const routing::Graph* graph,
+                                     Movement& movement,
+                                     std::pmr::memory_resource* resource) {
+  if (strategyName == "astar") {
+    movement.start<AstarStrategy, Jump>(start, end, graph, resource);
+  } else if (strategyName == "dfs") {
+    movement.start<DfsStrategy, Jump, Spin>(start, end, graph, resource);
+  } else if (strategyName == "bfs") {
+    movement.start<BfsStrategy, Spin, Spin>(start, end, graph, resource);
+  } else if (strategyName == "dijkstra") {
+    movement.start<DijkstraStrategy, Spin, Jump>(start, end, graph, resource);
+  } else {
+    movement.start<BeelineStrategy>(start, end, resource);
   }
 }
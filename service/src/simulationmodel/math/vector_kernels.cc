@@ -0,0 +1,163 @@
+#include "math/vector_kernels.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// The scalar versions do the arithmetic in the same order as the AVX2 ones,
+// so both give identical results. FMA is left out for the same reason.
+
+float squaredDistance(const Float3Array& pos, size_t i, float tx, float ty,
+                      float tz) {
+  float dx = pos.x[i] - tx;
+  float dy = pos.y[i] - ty;
+  float dz = pos.z[i] - tz;
+  return dx * dx + dy * dy + dz * dz;
+}
+
+#ifdef KERNELS_AVX2
+bool cpuHasAvx2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+
+bool avx2Enabled = true;
+
+bool hasAvx2() { return avx2Enabled && cpuHasAvx2(); }
+
+// Squared distances from the eight positions given by x, y and z to
+// (tx, ty, tz)
+__attribute__((target("avx2"))) inline __m256 squaredDistance8(
+    __m256 x, __m256 y, __m256 z, __m256 tx, __m256 ty, __m256 tz) {
+  __m256 dx = _mm256_sub_ps(x, tx);
+  __m256 dy = _mm256_sub_ps(y, ty);
+  __m256 dz = _mm256_sub_ps(z, tz);
+  __m256 d = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+  return _mm256_add_ps(d, _mm256_mul_ps(dz, dz));
+}
+
+__attribute__((target("avx2"))) int nearestAvx2(const Float3Array& pos,
+                                               float tx, float ty, float tz) {
+  __m256 x = _mm256_set1_ps(tx);
+  __m256 y = _mm256_set1_ps(ty);
+  __m256 z = _mm256_set1_ps(tz);
+  // each lane keeps the closest of the positions it has seen
+  __m256 best = _mm256_set1_ps(INFINITY);
+  __m256 bestIndex = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i eight = _mm256_set1_epi32(8);
+  size_t n = pos.size();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 d = squaredDistance8(_mm256_loadu_ps(pos.x.data() + i),
+                                _mm256_loadu_ps(pos.y.data() + i),
+                                _mm256_loadu_ps(pos.z.data() + i), x, y, z);
+    __m256 closer = _mm256_cmp_ps(d, best, _CMP_LT_OQ);
+    best = _mm256_blendv_ps(best, d, closer);
+    bestIndex =
+        _mm256_blendv_ps(bestIndex, _mm256_castsi256_ps(index), closer);
+    index = _mm256_add_epi32(index, eight);
+  }
+
+  float lanes[8];
+  int lanesIndex[8];
+  _mm256_storeu_ps(lanes, best);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanesIndex),
+                      _mm256_castps_si256(bestIndex));
+  float minD = INFINITY;
+  int result = -1;
+  for (int l = 0; l < 8; l++) {
+    if (lanesIndex[l] < 0) continue;
+    if (lanes[l] < minD || (lanes[l] == minD && lanesIndex[l] < result)) {
+      minD = lanes[l];
+      result = lanesIndex[l];
+    }
+  }
+  for (; i < n; i++) {
+    float d = squaredDistance(pos, i, tx, ty, tz);
+    if (d < minD) {
+      minD = d;
+      result = i;
+    }
+  }
+  return result;
+}
+
+__attribute__((target("avx2"))) void distancesAvx2(const Float3Array& pos,
+                                                   const int* ids, size_t n,
+                                                   float tx, float ty,
+                                                   float tz, float* out) {
+  __m256 x = _mm256_set1_ps(tx);
+  __m256 y = _mm256_set1_ps(ty);
+  __m256 z = _mm256_set1_ps(tz);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i idx =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ids + i));
+    __m256 d = squaredDistance8(_mm256_i32gather_ps(pos.x.data(), idx, 4),
+                                _mm256_i32gather_ps(pos.y.data(), idx, 4),
+                                _mm256_i32gather_ps(pos.z.data(), idx, 4), x,
+                                y, z);
+    _mm256_storeu_ps(out + i, _mm256_sqrt_ps(d));
+  }
+  for (; i < n; i++) {
+    out[i] = std::sqrt(squaredDistance(pos, ids[i], tx, ty, tz));
+  }
+}
+#endif
+
+}  // namespace
+
+namespace kernels {
+
+void setAvx2(bool enabled) {
+#ifdef KERNELS_AVX2
+  avx2Enabled = enabled;
+#endif
+}
+
+bool usesAvx2() {
+#ifdef KERNELS_AVX2
+  return hasAvx2();
+#else
+  return false;
+#endif
+}
+
+int nearest(const Float3Array& pos, const Vector3& target) {
+  float tx = target.x, ty = target.y, tz = target.z;
+#ifdef KERNELS_AVX2
+  if (hasAvx2()) return nearestAvx2(pos, tx, ty, tz);
+#endif
+  float minD = INFINITY;
+  int result = -1;
+  for (size_t i = 0; i < pos.size(); i++) {
+    float d = squaredDistance(pos, i, tx, ty, tz);
+    if (d < minD) {
+      minD = d;
+      result = i;
+    }
+  }
+  return result;
+}
+
+void distances(const Float3Array& pos, const int* ids, size_t n,
+               const Vector3& target, float* out) {
+  float tx = target.x, ty = target.y, tz = target.z;
+#ifdef KERNELS_AVX2
+  if (hasAvx2()) {
+    distancesAvx2(pos, ids, n, tx, ty, tz, out);
+    return;
+  }
+#endif
+  for (size_t i = 0; i < n; i++) {
+    out[i] = std::sqrt(squaredDistance(pos, ids[i], tx, ty, tz));
+  }
+}
+
+}  // namespace kernels
@@ -0,0 +1,79 @@
+#include "Movement.h"
+
+#include "util/AllocationStats.h"
+
+namespace {
+
+// Lets std::visit take one lambda per alternative
+template <class... Fs>
+struct Overloaded : Fs... {
+  using Fs::operator()...;
+};
+
+// Makes alternative index of trips current, with an empty path
+template <size_t... I>
+void emplace(Movement::Trips& trip, size_t index,
+             std::pmr::memory_resource* resource, std::index_sequence<I...>) {
+  auto emplaceAt = [&]<size_t J>(std::integral_constant<size_t, J>) {
+    if constexpr (J == 0) {
+      trip.emplace<0>();
+    } else {
+      trip.emplace<J>(resource);
+    }
+  };
+  ((index == I ? emplaceAt(std::integral_constant<size_t, I>()) : void()),
+   ...);
+}
+
+}  // namespace
+
+Movement::Movement(const Movement& other,
+                   std::pmr::memory_resource* resource) {
+  // a path assigned to keeps its own memory, so the trip is made on the
+  // resource first and the other one assigned to it
+  emplace(trip, other.trip.index(), resource,
+          std::make_index_sequence<std::variant_size_v<Trips>>());
+  std::visit(Overloaded{[](std::monostate) {},
+                        [&](auto& t) {
+                          t = std::get<std::decay_t<decltype(t)>>(other.trip);
+                        }},
+             trip);
+}
+
+void Movement::move(IEntity* entity, double dt) {
+  std::visit(Overloaded{[](std::monostate) {},
+                        [=](auto& t) { t.move(entity, dt); }},
+             trip);
+}
+
+bool Movement::isCompleted() {
+  return std::visit(Overloaded{[](std::monostate) { return true; },
+                               [](auto& t) { return t.isCompleted(); }},
+                    trip);
+}
+
+std::string Movement::getName() const {
+  return std::visit(
+      Overloaded{[](std::monostate) { return std::string(); },
+                 [](const auto& t) { return t.getName(); }},
+      trip);
+}
+
+void Movement::save(SnapshotWriter& writer) const {
+  writer.write(static_cast<uint8_t>(trip.index()));
+  std::visit(Overloaded{[](std::monostate) {},
+                        [&](const auto& t) { t.save(writer); }},
+             trip);
+}
+
+void Movement::load(SnapshotReader& reader,
+                    std::pmr::memory_resource* resource) {
+  // the path is copied in, which allocates
+  AllocationStats::expect();
+  size_t index = reader.read<uint8_t>();
+  emplace(trip, index, resource,
+          std::make_index_sequence<std::variant_size_v<Trips>>());
+  std::visit(Overloaded{[](std::monostate) {},
+                        [&](auto& t) { t.load(reader); }},
+             trip);
+}
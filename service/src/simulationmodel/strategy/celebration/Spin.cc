@@ -0,0 +1,5 @@
+#include "Spin.h"
+
+void Spin::celebrate(IEntity* entity, double dt) {
+  entity->rotate(dt * entity->getSpeed() * spinSpeed);
+}
@@ -1,6 +1,9 @@
 #include "BeelineStrategy.h"
 
-BeelineStrategy::BeelineStrategy(Vector3 pos, Vector3 des)
-    : PathStrategy({pos, des}) {}
+BeelineStrategy::BeelineStrategy(Vector3 pos, Vector3 des,
+                                 std::pmr::memory_resource* resource)
+    : PathStrategy(resource) {
+  path = {pos, des};
+}
 
 std::string BeelineStrategy::getName() const { return "beeline"; }
@@ -2,9 +2,14 @@
 
 #include "BreadthFirstSearch.h"
 
-BfsStrategy::BfsStrategy(Vector3 pos, Vector3 des, const routing::Graph* g) {
+BfsStrategy::BfsStrategy(Vector3 pos, Vector3 des,
+                         const routing::Graph* g,
+                         std::pmr::memory_resource* resource)
+    : PathStrategy(resource) {
   if (g) {
-    path = g->getPath(pos, des, routing::BreadthFirstSearch()).value();
+    auto found = g->getPath(pos, des, routing::BreadthFirstSearch()).value();
+    path.reserve(found.size() + 1);
+    path.assign(found.begin(), found.end());
     auto y = path.back().y;
     path.push_back(Vector3(des.x, y, des.z));
   } else {
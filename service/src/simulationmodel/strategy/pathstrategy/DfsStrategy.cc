@@ -2,9 +2,14 @@
 
 #include "DepthFirstSearch.h"
 
-DfsStrategy::DfsStrategy(Vector3 pos, Vector3 des, const routing::Graph* g) {
+DfsStrategy::DfsStrategy(Vector3 pos, Vector3 des,
+                         const routing::Graph* g,
+                         std::pmr::memory_resource* resource)
+    : PathStrategy(resource) {
   if (g) {
-    path = g->getPath(pos, des, routing::DepthFirstSearch()).value();
+    auto found = g->getPath(pos, des, routing::DepthFirstSearch()).value();
+    path.reserve(found.size() + 1);
+    path.assign(found.begin(), found.end());
     auto y = path.back().y;
     path.push_back(Vector3(des.x, y, des.z));
   } else {
@@ -12,6 +17,6 @@ DfsStrategy::DfsStrategy(Vector3 pos, Vector3 des, const routing::Graph* g) {
   }
 }
 
-std::string DfsStrategy::getName() const { return "bfs"; }
+std::string DfsStrategy::getName() const { return "dfs"; }
 
 
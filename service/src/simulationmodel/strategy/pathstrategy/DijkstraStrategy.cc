@@ -3,9 +3,13 @@
 #include "Dijkstra.h"
 
 DijkstraStrategy::DijkstraStrategy(Vector3 pos, Vector3 des,
-                                   const routing::Graph* g) {
+                                   const routing::Graph* g,
+                                   std::pmr::memory_resource* resource)
+    : PathStrategy(resource) {
   if (g) {
-    path = g->getPath(pos, des, routing::Dijkstra()).value();
+    auto found = g->getPath(pos, des, routing::Dijkstra()).value();
+    path.reserve(found.size() + 1);
+    path.assign(found.begin(), found.end());
     auto y = path.back().y;
     path.push_back(Vector3(des.x, y, des.z));
   } else {
@@ -13,4 +17,4 @@ DijkstraStrategy::DijkstraStrategy(Vector3 pos, Vector3 des,
   }
 }
 
-std::string DijkstraStrategy::getName() const { return "bijkstra"; }
+std::string DijkstraStrategy::getName() const { return "dijkstra"; }
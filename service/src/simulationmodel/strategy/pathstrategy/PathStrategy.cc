@@ -1,17 +1,30 @@
 #include "PathStrategy.h"
 
-PathStrategy::PathStrategy(std::vector<Vector3> p) : path(p), index(0) {}
+PathStrategy::PathStrategy(std::pmr::memory_resource* resource)
+    : path(resource), index(0) {}
 
 void PathStrategy::move(IEntity* entity, double dt) {
   if (isCompleted()) return;
 
-  Vector3 vi = path[index];
-  Vector3 dir = (vi - entity->getPosition()).unit();
+  const Vector3& vi = path[index];
+  Vector3 pos = entity->getPosition();
+  Vector3 dir = (vi - pos).unit();
 
-  entity->setPosition(entity->getPosition() + dir * entity->getSpeed() * dt);
+  pos = pos + dir * entity->getSpeed() * dt;
+  entity->setPosition(pos);
   entity->setDirection(dir);
 
-  if (entity->getPosition().dist(vi) < 4) index++;
+  if ((pos - vi).squaredMagnitude() < 4 * 4) index++;
 }
 
 bool PathStrategy::isCompleted() { return index >= path.size(); }
+
+void PathStrategy::save(SnapshotWriter& writer) const {
+  writer.write(index);
+  writer.writeArray(path.data(), path.size());
+}
+
+void PathStrategy::load(SnapshotReader& reader) {
+  index = reader.read<int>();
+  reader.readArray(path);
+}
@@ -0,0 +1,31 @@
+#include "util/AllocationStats.h"
+
+#include <cstdlib>
+#include <new>
+
+thread_local AllocationStats::Counts AllocationStats::counts;
+thread_local bool AllocationStats::expected = false;
+bool AllocationStats::strict = false;
+
+#ifdef ALLOC_PROFILE
+// Every other form of new and delete forwards to these by default
+
+void* operator new(std::size_t size) {
+  AllocationStats::record(size);
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+  AllocationStats::record(size);
+  std::size_t a = static_cast<std::size_t>(align);
+  // aligned_alloc wants a multiple of the alignment
+  std::size_t rounded = (size + a - 1) / a * a;
+  if (void* p = std::aligned_alloc(a, rounded ? rounded : a)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+#endif
@@ -0,0 +1,178 @@
+#include "util/Checkpoint.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <cerrno>
+#include <filesystem>
+
+namespace {
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t sectionCount;
+  uint64_t bodySize;
+  uint32_t crc;
+  uint32_t unused;
+};
+
+struct TableEntry {
+  uint32_t tag;
+  uint32_t unused;
+  uint64_t offset;
+  uint64_t size;
+};
+
+// crc32 of a buffer of any size, zlib takes at most 4 GB at a time
+uint32_t checksum(const char* data, size_t n) {
+  uLong crc = crc32(0, nullptr, 0);
+  while (n > 0) {
+    uInt chunk = n > (1u << 30) ? (1u << 30) : n;
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(data), chunk);
+    data += chunk;
+    n -= chunk;
+  }
+  return crc;
+}
+
+bool writeAll(int fd, const char* data, size_t n) {
+  while (n > 0) {
+    ssize_t written = ::write(fd, data, n);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += written;
+    n -= written;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool CheckpointWriter::save(const std::string& path,
+                            std::string& error) const {
+  std::vector<TableEntry> table;
+  for (size_t i = 0; i < sections.size(); i++) {
+    uint64_t end =
+        i + 1 < sections.size() ? sections[i + 1].offset : body.size();
+    table.push_back({sections[i].tag, 0, sections[i].offset,
+                     end - sections[i].offset});
+  }
+  Header header{};
+  std::memcpy(header.magic, checkpoint::magic, sizeof(header.magic));
+  header.version = checkpoint::version;
+  header.sectionCount = table.size();
+  header.bodySize = body.size();
+  header.crc = checksum(body.data(), body.size());
+
+  std::string temp = path + ".tmp";
+  int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    error = "can't create " + temp + ": " + std::strerror(errno);
+    return false;
+  }
+  bool written =
+      writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header)) &&
+      writeAll(fd, reinterpret_cast<const char*>(table.data()),
+               table.size() * sizeof(TableEntry)) &&
+      writeAll(fd, body.data(), body.size()) && ::fsync(fd) == 0;
+  if (!written) error = "can't write " + temp + ": " + std::strerror(errno);
+  ::close(fd);
+  if (!written) {
+    ::unlink(temp.c_str());
+    return false;
+  }
+  if (::rename(temp.c_str(), path.c_str()) != 0) {
+    error = "can't replace " + path + ": " + std::strerror(errno);
+    ::unlink(temp.c_str());
+    return false;
+  }
+  // the rename itself is only durable once the directory is synced
+  std::filesystem::path dir = std::filesystem::path(path).parent_path();
+  int dirFd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (dirFd >= 0) {
+    ::fsync(dirFd);
+    ::close(dirFd);
+  }
+  return true;
+}
+
+CheckpointFile::~CheckpointFile() {
+  if (map) ::munmap(const_cast<char*>(map), mapSize);
+}
+
+bool CheckpointFile::open(const std::string& path, std::string& error) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    error = "can't open " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  struct stat info;
+  if (::fstat(fd, &info) != 0 || info.st_size < sizeof(Header)) {
+    ::close(fd);
+    error = path + " is not a checkpoint";
+    return false;
+  }
+  void* mapped = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    error = "can't map " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  map = static_cast<const char*>(mapped);
+  mapSize = info.st_size;
+  // the whole file is read right away, for the checksum
+  ::madvise(mapped, mapSize, MADV_WILLNEED);
+
+  Header header;
+  std::memcpy(&header, map, sizeof(header));
+  if (std::memcmp(header.magic, checkpoint::magic, sizeof(header.magic))) {
+    error = path + " is not a checkpoint";
+    return false;
+  }
+  if (header.version > checkpoint::version) {
+    error = path + " was written by a newer version (" +
+            std::to_string(header.version) + ")";
+    return false;
+  }
+  version = header.version;
+
+  size_t tableSize = header.sectionCount * sizeof(TableEntry);
+  if (header.sectionCount > mapSize / sizeof(TableEntry) ||
+      sizeof(Header) + tableSize + header.bodySize != mapSize) {
+    error = path + " is truncated";
+    return false;
+  }
+  body = map + sizeof(Header) + tableSize;
+  if (checksum(body, header.bodySize) != header.crc) {
+    error = path + " is corrupt";
+    return false;
+  }
+  sections.clear();
+  for (uint32_t i = 0; i < header.sectionCount; i++) {
+    TableEntry entry;
+    std::memcpy(&entry, map + sizeof(Header) + i * sizeof(TableEntry),
+                sizeof(entry));
+    if (entry.offset > header.bodySize ||
+        entry.size > header.bodySize - entry.offset) {
+      error = path + " has a bad section table";
+      return false;
+    }
+    sections.push_back({entry.tag, entry.offset, entry.size});
+  }
+  return true;
+}
+
+bool CheckpointFile::section(uint32_t tag, CheckpointReader& reader) const {
+  for (const Section& s : sections) {
+    if (s.tag != tag) continue;
+    reader = CheckpointReader(body + s.offset, body + s.offset + s.size);
+    return true;
+  }
+  return false;
+}
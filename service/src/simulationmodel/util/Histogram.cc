@@ -0,0 +1,96 @@
+#include "util/Histogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+int Histogram::bucketOf(uint64_t value) {
+  constexpr uint64_t linear = uint64_t(2) << subBits;
+  if (value < linear) return value;
+  // values of 2^k up to 2^(k+1) are split into 2^subBits buckets
+  int magnitude = std::bit_width(value) - 1;
+  if (magnitude >= maxBits) return bucketCount - 1;
+  int shift = magnitude - subBits;
+  return ((shift + 1) << subBits) + (value >> shift) - (uint64_t(1) << subBits);
+}
+
+uint64_t Histogram::highestIn(int bucket) {
+  constexpr int linear = 2 << subBits;
+  if (bucket < linear) return bucket;
+  int shift = (bucket >> subBits) - 1;
+  uint64_t sub = (bucket & ((1 << subBits) - 1)) + (uint64_t(1) << subBits);
+  return ((sub + 1) << shift) - 1;
+}
+
+void Histogram::record(double seconds) {
+  uint64_t value = seconds > 0 ? std::llround(seconds / unit) : 0;
+  buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+  total.fetch_add(value, std::memory_order_relaxed);
+  uint64_t seen = min.load(std::memory_order_relaxed);
+  while (value < seen && !min.compare_exchange_weak(seen, value)) {
+  }
+  seen = max.load(std::memory_order_relaxed);
+  while (value > seen && !max.compare_exchange_weak(seen, value)) {
+  }
+}
+
+Histogram::Summary Histogram::summarize() const {
+  Summary summary;
+  summary.count = count.load(std::memory_order_relaxed);
+  if (summary.count == 0) return summary;
+  double lowest = min.load(std::memory_order_relaxed);
+  double highest = max.load(std::memory_order_relaxed);
+  summary.min = lowest * unit;
+  summary.max = highest * unit;
+  summary.mean = total.load(std::memory_order_relaxed) * unit / summary.count;
+
+  // one pass finds all three percentiles: each is the top of the bucket the
+  // running count first reaches its rank in
+  struct Target {
+    double fraction;
+    double* value;
+  } targets[] = {{0.50, &summary.p50}, {0.95, &summary.p95},
+                 {0.99, &summary.p99}};
+  // buckets may be counted while this runs, so ranks are of what is counted
+  // in the pass rather than of count
+  uint64_t counted = 0;
+  uint64_t seen[bucketCount];
+  for (int i = 0; i < bucketCount; i++) {
+    seen[i] = buckets[i].load(std::memory_order_relaxed);
+    counted += seen[i];
+  }
+  uint64_t running = 0;
+  int next = 0;
+  for (int i = 0; i < bucketCount && next < 3; i++) {
+    running += seen[i];
+    while (next < 3 &&
+           running >= std::ceil(targets[next].fraction * counted) &&
+           running > 0) {
+      double top = std::min<double>(highestIn(i), highest);
+      *targets[next].value = std::max(top, lowest) * unit;
+      next++;
+    }
+  }
+  return summary;
+}
+
+uint64_t Histogram::countAtMost(double seconds) const {
+  if (seconds < 0) return 0;
+  double bound = seconds / unit;
+  int last = bound >= double(UINT64_MAX) ? bucketCount - 1
+                                          : bucketOf(uint64_t(bound));
+  uint64_t counted = 0;
+  for (int i = 0; i <= last; i++) {
+    counted += buckets[i].load(std::memory_order_relaxed);
+  }
+  return counted;
+}
+
+void Histogram::clear() {
+  for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+  count.store(0, std::memory_order_relaxed);
+  total.store(0, std::memory_order_relaxed);
+  min.store(UINT64_MAX, std::memory_order_relaxed);
+  max.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,181 @@
+#include "util/JsonWriter.h"
+
+#include <charconv>
+#include <cmath>
+
+JsonWriter& JsonWriter::key(std::string_view k) {
+  separate();
+  writeString(k);
+  buf.push_back(':');
+  needComma = false;
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(double d) {
+  separate();
+  writeNumber(d);
+  needComma = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(int i) {
+  separate();
+  char tmp[16];
+  auto res = std::to_chars(tmp, tmp + sizeof(tmp), i);
+  buf.append(tmp, res.ptr);
+  needComma = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(bool b) {
+  separate();
+  buf.append(b ? "true" : "false");
+  needComma = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(std::string_view s) {
+  separate();
+  writeString(s);
+  needComma = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const Vector3& v) {
+  separate();
+  buf.push_back('[');
+  writeNumber(v.x);
+  buf.push_back(',');
+  writeNumber(v.y);
+  buf.push_back(',');
+  writeNumber(v.z);
+  buf.push_back(']');
+  needComma = true;
+  return *this;
+}
+
+#ifdef JSON_FLAT
+JsonWriter& JsonWriter::value(const JsonValue& v) {
+  separate();
+  flatjson::serialize(v.getNode(), buf);
+  needComma = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const JsonObject& o) {
+  separate();
+  flatjson::serialize(o.getNode(), buf);
+  needComma = true;
+  return *this;
+}
+#else
+JsonWriter& JsonWriter::value(const JsonValue& v) {
+  separate();
+  writeValue(v.getValue());
+  needComma = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const JsonObject& o) {
+  separate();
+  writeObject(o.getObject());
+  needComma = true;
+  return *this;
+}
+#endif
+
+JsonWriter& JsonWriter::raw(std::string_view json) {
+  separate();
+  buf.append(json);
+  needComma = true;
+  return *this;
+}
+
+#ifndef JSON_FLAT
+void JsonWriter::writeValue(const picojson::value& v) {
+  if (v.is<double>()) {
+    writeNumber(v.get<double>());
+  } else if (v.is<std::string>()) {
+    writeString(v.get<std::string>());
+  } else if (v.is<picojson::object>()) {
+    writeObject(v.get<picojson::object>());
+  } else if (v.is<picojson::array>()) {
+    buf.push_back('[');
+    bool first = true;
+    for (const picojson::value& item : v.get<picojson::array>()) {
+      if (!first) buf.push_back(',');
+      first = false;
+      writeValue(item);
+    }
+    buf.push_back(']');
+  } else if (v.is<bool>()) {
+    buf.append(v.get<bool>() ? "true" : "false");
+  } else {
+    buf.append("null");
+  }
+}
+
+void JsonWriter::writeObject(const picojson::object& o) {
+  buf.push_back('{');
+  bool first = true;
+  for (const auto& [k, item] : o) {
+    if (!first) buf.push_back(',');
+    first = false;
+    writeString(k);
+    buf.push_back(':');
+    writeValue(item);
+  }
+  buf.push_back('}');
+}
+#endif
+
+void JsonWriter::writeNumber(double d) {
+  if (!std::isfinite(d)) {
+    buf.append("null");
+    return;
+  }
+  char tmp[32];
+  auto res = std::to_chars(tmp, tmp + sizeof(tmp), d);
+  buf.append(tmp, res.ptr);
+}
+
+void JsonWriter::writeString(std::string_view s) {
+  static const char hex[] = "0123456789abcdef";
+  buf.push_back('"');
+  size_t run = 0;  // start of the characters that need no escaping
+  for (size_t i = 0; i < s.size(); i++) {
+    unsigned char c = s[i];
+    if (c >= 0x20 && c != '"' && c != '\\' && c != 0x7f) continue;
+    buf.append(s.data() + run, i - run);
+    run = i + 1;
+    switch (c) {
+      case '"':
+        buf.append("\\\"");
+        break;
+      case '\\':
+        buf.append("\\\\");
+        break;
+      case '\b':
+        buf.append("\\b");
+        break;
+      case '\f':
+        buf.append("\\f");
+        break;
+      case '\n':
+        buf.append("\\n");
+        break;
+      case '\r':
+        buf.append("\\r");
+        break;
+      case '\t':
+        buf.append("\\t");
+        break;
+      default:
+        buf.append("\\u00");
+        buf.push_back(hex[c >> 4]);
+        buf.push_back(hex[c & 0xf]);
+    }
+  }
+  buf.append(s.data() + run, s.size() - run);
+  buf.push_back('"');
+}
@@ -0,0 +1,38 @@
+#include "util/MessageDeflater.h"
+
+#include <cstring>
+#include <ctime>
+
+MessageDeflater::MessageDeflater(int level) {
+  memset(&stream, 0, sizeof(stream));
+  ok = deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) ==
+       Z_OK;
+}
+
+MessageDeflater::~MessageDeflater() {
+  if (ok) deflateEnd(&stream);
+}
+
+void MessageDeflater::compress(const std::string& msg,
+                               std::vector<unsigned char>& out) {
+  out.clear();
+  if (!ok || deflateReset(&stream) != Z_OK) return;
+  uLong bound = deflateBound(&stream, msg.length());
+  out.resize(bound);
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(msg.data()));
+  stream.avail_in = msg.length();
+  stream.next_out = out.data();
+  stream.avail_out = bound;
+  if (deflate(&stream, Z_FINISH) != Z_STREAM_END ||
+      bound - stream.avail_out >= msg.length()) {
+    out.clear();
+    return;
+  }
+  out.resize(bound - stream.avail_out);
+}
+
+double MessageDeflater::threadSeconds() {
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
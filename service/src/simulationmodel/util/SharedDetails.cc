@@ -0,0 +1,50 @@
+#include "util/SharedDetails.h"
+
+#include <mutex>
+#include <unordered_map>
+
+#include "util/JsonWriter.h"
+
+namespace {
+
+// Members every entity has its own value for
+const char* const instanceKeys[] = {"position", "direction", "name",
+                                     "colors"};
+
+std::mutex tableMutex;
+// Templates in use, by their text
+std::unordered_map<std::string, std::weak_ptr<const SharedDetails>> table;
+int nextId = 0;
+
+}  // namespace
+
+std::shared_ptr<const SharedDetails> SharedDetails::intern(
+    const JsonObject& details) {
+  JsonObject json = details;
+  for (const char* key : instanceKeys) json.erase(key);
+  // JsonWriter is several times faster than toString, which matters when
+  // thousands of entities are created at once, e.g. on resume
+  JsonWriter writer;
+  writer.value(json);
+  std::string text = writer.str();
+
+  std::lock_guard<std::mutex> lock(tableMutex);
+  std::weak_ptr<const SharedDetails>& slot = table[text];
+  if (std::shared_ptr<const SharedDetails> existing = slot.lock()) {
+    return existing;
+  }
+  // the last owner takes the entry out of the table, unless the text has
+  // been interned again in the meantime
+  std::shared_ptr<const SharedDetails> shared(
+      new SharedDetails(nextId++, std::move(json), text),
+      [](const SharedDetails* d) {
+        {
+          std::lock_guard<std::mutex> lock(tableMutex);
+          auto it = table.find(d->text);
+          if (it != table.end() && it->second.expired()) table.erase(it);
+        }
+        delete d;
+      });
+  slot = shared;
+  return shared;
+}
@@ -0,0 +1,35 @@
+#include "util/Snapshot.h"
+
+#include "IEntity.h"
+
+size_t Snapshot::memoryUsage() const {
+  size_t bytes = sizeof(Snapshot) + data.capacity() +
+                 records.capacity() * sizeof(Record) +
+                 strings.capacity() * sizeof(std::string);
+  for (const std::string& s : strings) {
+    // short strings are stored inside the std::string itself
+    if (s.capacity() > std::string().capacity()) bytes += s.capacity() + 1;
+  }
+  return bytes;
+}
+
+void SnapshotWriter::beginRecord(int id) {
+  snapshot.records.push_back({id, static_cast<uint32_t>(snapshot.data.size())});
+}
+
+void SnapshotWriter::writeString(const std::string& s) {
+  auto [it, added] = stringIds.try_emplace(s, snapshot.strings.size());
+  if (added) snapshot.strings.push_back(s);
+  write(it->second);
+}
+
+void SnapshotWriter::writeReference(const IEntity* entity) {
+  write(entity ? entity->getId() : -1);
+}
+
+void SnapshotLinks::resolve(const std::vector<IEntity*>& byId) {
+  for (auto& [id, link] : pending) {
+    link(id >= 0 && id < byId.size() ? byId[id] : nullptr);
+  }
+  pending.clear();
+}
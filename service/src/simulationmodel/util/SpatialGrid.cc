@@ -0,0 +1,59 @@
+#include "util/SpatialGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+SpatialGrid::SpatialGrid(double cellSize) : cellSize(cellSize) {}
+
+void SpatialGrid::clear() {
+  entries.clear();
+  sorted = true;
+}
+
+void SpatialGrid::insert(int id, const Vector3& pos) {
+  long long cx = static_cast<long long>(std::floor(pos.x / cellSize));
+  long long cz = static_cast<long long>(std::floor(pos.z / cellSize));
+  entries.push_back({cellKey(cx, cz), id, pos.x, pos.z});
+  sorted = false;
+}
+
+void SpatialGrid::query(double minX, double minZ, double maxX, double maxZ,
+                        std::vector<int>& out) const {
+  long long cx0 = static_cast<long long>(std::floor(minX / cellSize));
+  long long cz0 = static_cast<long long>(std::floor(minZ / cellSize));
+  long long cx1 = static_cast<long long>(std::floor(maxX / cellSize));
+  long long cz1 = static_cast<long long>(std::floor(maxZ / cellSize));
+
+  auto visit = [&](const Entry* begin, const Entry* end) {
+    for (const Entry* e = begin; e != end; e++) {
+      if (e->x >= minX && e->x <= maxX && e->z >= minZ && e->z <= maxZ) {
+        out.push_back(e->id);
+      }
+    }
+  };
+
+  // a huge rectangle covers more cells than there are entities, so look
+  // at every entity instead
+  double area = static_cast<double>(cx1 - cx0 + 1) * (cz1 - cz0 + 1);
+  if (area > entries.size()) {
+    visit(entries.data(), entries.data() + entries.size());
+    return;
+  }
+  if (!sorted) {
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.key < b.key; });
+    sorted = true;
+  }
+  auto byKey = [](const Entry& e, long long key) { return e.key < key; };
+  const Entry* begin = entries.data();
+  const Entry* end = begin + entries.size();
+  for (long long cx = cx0; cx <= cx1; cx++) {
+    for (long long cz = cz0; cz <= cz1; cz++) {
+      long long key = cellKey(cx, cz);
+      const Entry* first = std::lower_bound(begin, end, key, byKey);
+      const Entry* last = first;
+      while (last != end && last->key == key) last++;
+      visit(first, last);
+    }
+  }
+}
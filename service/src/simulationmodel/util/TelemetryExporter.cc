@@ -0,0 +1,229 @@
+#include "util/TelemetryExporter.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+constexpr char magic[8] = {'T', 'R', 'A', 'N', 'S', 'T', 'L', 'M'};
+constexpr uint32_t version = 1;
+
+enum Table : uint32_t { eventTable, fleetTable };
+
+struct Column {
+  const char* name;
+  char type;
+  uint8_t width;
+};
+
+constexpr Column eventColumns[] = {
+    {"sequence", 'l', 8}, {"time", 'd', 8}, {"wallTime", 'l', 8},
+    {"drone", 'i', 4},    {"dropoff", 'b', 1}, {"x", 'd', 8},
+    {"y", 'd', 8},        {"z", 'd', 8}};
+
+constexpr Column fleetColumns[] = {{"time", 'd', 8},
+                                   {"drones", 'i', 4},
+                                   {"busy", 'i', 4},
+                                   {"deliveries", 'l', 8},
+                                   {"distance", 'd', 8}};
+
+template <class T>
+void append(std::vector<char>& out, const T& value) {
+  const char* bytes = reinterpret_cast<const char*>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void appendName(std::vector<char>& out, const char* name) {
+  append(out, static_cast<uint32_t>(std::strlen(name)));
+  out.insert(out.end(), name, name + std::strlen(name));
+}
+
+template <size_t N>
+void appendTable(std::vector<char>& out, const char* name,
+                 const Column (&columns)[N]) {
+  appendName(out, name);
+  append(out, static_cast<uint32_t>(N));
+  for (const Column& column : columns) {
+    appendName(out, column.name);
+    append(out, column.type);
+    append(out, column.width);
+  }
+}
+
+// Appends one column: the field of every row, converted to the column's type
+template <class Value, class Rows, class Field>
+void appendColumn(std::vector<char>& out, const Rows& rows, Field field) {
+  for (const auto& row : rows) append(out, static_cast<Value>(field(row)));
+}
+
+std::FILE* openCsv(const std::string& path, const char* header,
+                   std::string& error) {
+  std::FILE* csv = std::fopen(path.c_str(), "w");
+  if (!csv) {
+    error = "can't create " + path + ": " + std::strerror(errno);
+    return nullptr;
+  }
+  std::fputs(header, csv);
+  return csv;
+}
+
+}  // namespace
+
+TelemetryExporter::~TelemetryExporter() { close(); }
+
+bool TelemetryExporter::open(const Options& options, std::string& error) {
+  close();
+  this->options = options;
+  file = std::fopen(options.path.c_str(), "wb");
+  if (!file) {
+    error = "can't create " + options.path + ": " + std::strerror(errno);
+    return false;
+  }
+  if (options.csv) {
+    eventsCsv = openCsv(options.path + ".events.csv",
+                        "sequence,time,wallTime,drone,event,x,y,z\n", error);
+    fleetCsv = openCsv(options.path + ".fleet.csv",
+                       "time,drones,busy,deliveries,distance\n", error);
+    if (!eventsCsv || !fleetCsv) {
+      close();
+      return false;
+    }
+  }
+
+  block.clear();
+  block.insert(block.end(), magic, magic + sizeof(magic));
+  append(block, version);
+  append(block, static_cast<uint32_t>(2));
+  appendTable(block, "events", eventColumns);
+  appendTable(block, "fleet", fleetColumns);
+  std::fwrite(block.data(), 1, block.size(), file);
+  std::fflush(file);
+
+  closing = false;
+  dropped = 0;
+  writer = std::thread(&TelemetryExporter::run, this);
+  return true;
+}
+
+void TelemetryExporter::push(std::vector<EventRow>& events,
+                             const FleetRow* fleet) {
+  if (!writer.joinable() || (events.empty() && !fleet)) {
+    events.clear();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    // the simulation's tick must not wait on the writer, so whatever does
+    // not fit is dropped, row by row
+    size_t waiting = pendingEvents.size() + pendingFleet.size();
+    size_t room = options.maxPending > waiting ? options.maxPending - waiting
+                                               : 0;
+    size_t taken = std::min(events.size(), room);
+    pendingEvents.insert(pendingEvents.end(), events.begin(),
+                         events.begin() + taken);
+    uint64_t lost = events.size() - taken;
+    if (fleet && taken < room) {
+      pendingFleet.push_back(*fleet);
+    } else if (fleet) {
+      lost++;
+    }
+    if (lost) dropped.fetch_add(lost, std::memory_order_relaxed);
+  }
+  events.clear();
+  wake.notify_one();
+}
+
+void TelemetryExporter::close() {
+  if (writer.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closing = true;
+    }
+    wake.notify_one();
+    writer.join();
+    if (uint64_t lost = getDropped()) {
+      std::fprintf(stderr,
+                   "telemetry: %" PRIu64
+                   " rows dropped, the writer fell behind\n",
+                   lost);
+    }
+  }
+  for (std::FILE** f : {&file, &eventsCsv, &fleetCsv}) {
+    if (*f) std::fclose(*f);
+    *f = nullptr;
+  }
+}
+
+void TelemetryExporter::run() {
+  // rows are swapped out under the lock and written without it
+  std::vector<EventRow> events;
+  std::vector<FleetRow> fleet;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] {
+        return closing || !pendingEvents.empty() || !pendingFleet.empty();
+      });
+      if (pendingEvents.empty() && pendingFleet.empty()) return;
+      events.swap(pendingEvents);
+      fleet.swap(pendingFleet);
+    }
+    writeEvents(events);
+    writeFleet(fleet);
+    // whole blocks reach the file even if the process dies later
+    std::fflush(file);
+    if (eventsCsv) std::fflush(eventsCsv);
+    if (fleetCsv) std::fflush(fleetCsv);
+    events.clear();
+    fleet.clear();
+  }
+}
+
+void TelemetryExporter::writeEvents(const std::vector<EventRow>& rows) {
+  if (rows.empty()) return;
+  block.clear();
+  append(block, static_cast<uint32_t>(eventTable));
+  append(block, static_cast<uint32_t>(rows.size()));
+  using Row = EventRow;
+  appendColumn<int64_t>(block, rows, [](const Row& r) { return r.sequence; });
+  appendColumn<double>(block, rows, [](const Row& r) { return r.time; });
+  appendColumn<int64_t>(block, rows, [](const Row& r) { return r.wallTime; });
+  appendColumn<int32_t>(block, rows, [](const Row& r) { return r.drone; });
+  appendColumn<uint8_t>(block, rows, [](const Row& r) { return r.dropoff; });
+  appendColumn<double>(block, rows, [](const Row& r) { return r.location.x; });
+  appendColumn<double>(block, rows, [](const Row& r) { return r.location.y; });
+  appendColumn<double>(block, rows, [](const Row& r) { return r.location.z; });
+  std::fwrite(block.data(), 1, block.size(), file);
+
+  if (!eventsCsv) return;
+  for (const Row& r : rows) {
+    std::fprintf(eventsCsv, "%" PRIu64 ",%.3f,%lld,%d,%s,%g,%g,%g\n",
+                 r.sequence, r.time, static_cast<long long>(r.wallTime),
+                 r.drone, r.dropoff ? "dropoff" : "pickup", r.location.x,
+                 r.location.y, r.location.z);
+  }
+}
+
+void TelemetryExporter::writeFleet(const std::vector<FleetRow>& rows) {
+  if (rows.empty()) return;
+  block.clear();
+  append(block, static_cast<uint32_t>(fleetTable));
+  append(block, static_cast<uint32_t>(rows.size()));
+  using Row = FleetRow;
+  appendColumn<double>(block, rows, [](const Row& r) { return r.time; });
+  appendColumn<int32_t>(block, rows, [](const Row& r) { return r.drones; });
+  appendColumn<int32_t>(block, rows, [](const Row& r) { return r.busy; });
+  appendColumn<int64_t>(block, rows,
+                        [](const Row& r) { return r.deliveries; });
+  appendColumn<double>(block, rows, [](const Row& r) { return r.distance; });
+  std::fwrite(block.data(), 1, block.size(), file);
+
+  if (!fleetCsv) return;
+  for (const Row& r : rows) {
+    std::fprintf(fleetCsv, "%.3f,%d,%d,%" PRId64 ",%.3f\n", r.time, r.drones,
+                 r.busy, r.deliveries, r.distance);
+  }
+}
@@ -0,0 +1,193 @@
+#include "util/Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>  // NOLINT [build/c++11]
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "util/JsonWriter.h"
+
+uint64_t Trace::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+#ifdef TICK_TRACE
+namespace {
+
+// Every field is atomic so a dump can read an entry while its thread
+// overwrites it; the dump then notices and leaves the entry out
+struct Entry {
+  std::atomic<const char*> name;
+  std::atomic<uint64_t> begin;
+  std::atomic<uint64_t> end;
+  std::atomic<uint64_t> detail[Trace::detailSize / 8];
+};
+
+struct Ring {
+  int thread;                  // tid in the trace
+  std::atomic<bool> inUse;     // a running thread records into it
+  std::atomic<uint64_t> head;  // scopes ever recorded
+  Entry entries[Trace::ringSize];
+};
+
+// Rings are never freed: a thread that ends hands its ring on to the next
+// thread that starts recording
+struct Rings {
+  std::mutex mutex;  // only taken to add or hand on a ring
+  std::vector<std::unique_ptr<Ring>> all;
+};
+
+Rings& rings() {
+  static Rings* rings = new Rings();
+  return *rings;
+}
+
+struct RingHolder {
+  Ring* ring = nullptr;
+  ~RingHolder() {
+    if (ring) ring->inUse.store(false, std::memory_order_release);
+  }
+};
+
+thread_local RingHolder holder;
+
+Ring& localRing() {
+  if (holder.ring) return *holder.ring;
+  Rings& r = rings();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (auto& ring : r.all) {
+    bool free = false;
+    if (ring->inUse.compare_exchange_strong(free, true)) {
+      holder.ring = ring.get();
+      return *holder.ring;
+    }
+  }
+  r.all.push_back(std::make_unique<Ring>());
+  Ring& ring = *r.all.back();
+  ring.thread = r.all.size();
+  ring.inUse = true;
+  holder.ring = &ring;
+  return ring;
+}
+
+}  // namespace
+
+void Trace::record(const char* name, std::string_view detail, uint64_t begin,
+                   uint64_t end) {
+  Ring& ring = localRing();
+  uint64_t head = ring.head.load(std::memory_order_relaxed);
+  Entry& entry = ring.entries[head % ringSize];
+  uint64_t words[detailSize / 8] = {};
+  std::memcpy(words, detail.data(), std::min(detail.size(), detailSize));
+  entry.name.store(name, std::memory_order_relaxed);
+  entry.begin.store(begin, std::memory_order_relaxed);
+  entry.end.store(end, std::memory_order_relaxed);
+  for (size_t i = 0; i < detailSize / 8; i++) {
+    entry.detail[i].store(words[i], std::memory_order_relaxed);
+  }
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+bool Trace::dump(const std::string& path, std::string& error) {
+  struct Scope {
+    int thread;
+    const char* name;
+    uint64_t begin;
+    uint64_t end;
+    char detail[detailSize + 1];
+  };
+  std::vector<Scope> scopes;
+  std::vector<int> threads;
+  {
+    Rings& r = rings();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (auto& ring : r.all) {
+      threads.push_back(ring->thread);
+      uint64_t head = ring->head.load(std::memory_order_acquire);
+      uint64_t first = head > ringSize ? head - ringSize : 0;
+      size_t start = scopes.size();
+      for (uint64_t i = first; i < head; i++) {
+        const Entry& entry = ring->entries[i % ringSize];
+        Scope scope{ring->thread, entry.name.load(std::memory_order_relaxed),
+                    entry.begin.load(std::memory_order_relaxed),
+                    entry.end.load(std::memory_order_relaxed)};
+        uint64_t words[detailSize / 8];
+        for (size_t w = 0; w < detailSize / 8; w++) {
+          words[w] = entry.detail[w].load(std::memory_order_relaxed);
+        }
+        std::memcpy(scope.detail, words, detailSize);
+        scope.detail[detailSize] = 0;
+        scopes.push_back(scope);
+      }
+      // whatever the thread recorded meanwhile, and the scope it may be
+      // recording now, overwrote the oldest entries
+      std::atomic_thread_fence(std::memory_order_acquire);
+      uint64_t now = ring->head.load(std::memory_order_relaxed) + 1;
+      uint64_t lost = now > first + ringSize ? now - first - ringSize : 0;
+      scopes.erase(scopes.begin() + start,
+                   scopes.begin() + start + std::min<uint64_t>(
+                                                lost, scopes.size() - start));
+    }
+  }
+
+  uint64_t origin = UINT64_MAX;
+  for (const Scope& s : scopes) origin = std::min(origin, s.begin);
+  JsonWriter writer;
+  writer.beginObject().key("displayTimeUnit").value("ms");
+  writer.key("traceEvents").beginArray();
+  for (int thread : threads) {
+    writer.beginObject().key("name").value("thread_name");
+    writer.key("ph").value("M");
+    writer.key("pid").value(1).key("tid").value(thread);
+    writer.key("args").beginObject().key("name").value(
+        "thread " + std::to_string(thread));
+    writer.endObject().endObject();
+  }
+  for (const Scope& s : scopes) {
+    writer.beginObject().key("name").value(s.name).key("ph").value("X");
+    writer.key("pid").value(1).key("tid").value(s.thread);
+    writer.key("ts").value((s.begin - origin) / 1000.0);
+    writer.key("dur").value((s.end - s.begin) / 1000.0);
+    if (s.detail[0]) {
+      writer.key("args").beginObject().key("detail").value(s.detail);
+      writer.endObject();
+    }
+    writer.endObject();
+  }
+  writer.endArray().endObject();
+
+  std::FILE* file = std::fopen(path.c_str(), "w");
+  if (!file) {
+    error = "can't create " + path + ": " + std::strerror(errno);
+    return false;
+  }
+  // a trace cut short, e.g. by a full disk, is not one
+  const std::string& text = writer.str();
+  bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+  int writeError = errno;
+  if (std::fclose(file) != 0 && written) {
+    written = false;
+    writeError = errno;
+  }
+  if (!written) {
+    error = "can't write " + path + ": " + std::strerror(writeError);
+    std::remove(path.c_str());
+    return false;
+  }
+  return true;
+}
+#else
+void Trace::record(const char*, std::string_view, uint64_t, uint64_t) {}
+
+bool Trace::dump(const std::string&, std::string& error) {
+  error = "tracing is not compiled in (make TRACE=1)";
+  return false;
+}
+#endif
@@ -0,0 +1,735 @@
+#ifdef JSON_FLAT
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "util/json.h"
+
+namespace flatjson {
+
+void* Arena::allocate(size_t size, size_t align) {
+  size_t pad = (align - reinterpret_cast<uintptr_t>(cur) % align) % align;
+  if (pad + size > left) {
+    // big requests get a block of their own, otherwise blocks double
+    size_t blockSize = std::max(nextSize, size + align);
+    blocks.push_back(std::make_unique<char[]>(blockSize));
+    cur = blocks.back().get();
+    left = blockSize;
+    if (nextSize < 64 * 1024) nextSize *= 2;
+    pad = (align - reinterpret_cast<uintptr_t>(cur) % align) % align;
+  }
+  void* p = cur + pad;
+  cur += pad + size;
+  left -= pad + size;
+  return p;
+}
+
+namespace {
+
+struct KeyHash {
+  using is_transparent = void;
+  size_t operator()(std::string_view s) const {
+    return std::hash<std::string_view>()(s);
+  }
+};
+
+struct KeyEqual {
+  using is_transparent = void;
+  bool operator()(std::string_view a, std::string_view b) const {
+    return a == b;
+  }
+};
+
+// the number of members, or items, a container grows to when first used
+const unsigned initialCapacity = 4;
+
+const Node emptyObject = [] {
+  Node n;
+  n.type = Node::Object;
+  return n;
+}();
+
+const Node emptyArray = [] {
+  Node n;
+  n.type = Node::Array;
+  return n;
+}();
+
+[[noreturn]] void typeMismatch(const char* type) {
+  throw std::runtime_error(std::string("JSON value is not ") + type);
+}
+
+}  // namespace
+
+const std::string* intern(std::string_view key) {
+  static std::mutex mutex;
+  static std::unordered_set<std::string, KeyHash, KeyEqual> keys;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = keys.find(key);
+  if (it == keys.end()) it = keys.emplace(key).first;
+  return &*it;
+}
+
+const Node* findMember(const Node& obj, std::string_view key) {
+  if (obj.type != Node::Object) return nullptr;
+  for (unsigned i = 0; i < obj.size; i++) {
+    if (*obj.members[i].key == key) return obj.members[i].value;
+  }
+  return nullptr;
+}
+
+void setString(Node& n, std::string_view s, Arena& arena) {
+  char* str = arena.allocate<char>(s.size() + 1);
+  memcpy(str, s.data(), s.size());
+  str[s.size()] = '\0';
+  n.type = Node::String;
+  n.size = s.size();
+  n.capacity = 0;
+  n.str = str;
+}
+
+void copyNode(Node& dst, const Node& src, Arena& arena) {
+  switch (src.type) {
+    case Node::String:
+      setString(dst, std::string_view(src.str, src.size), arena);
+      return;
+    case Node::Array: {
+      Node* items = src.size ? arena.allocate<Node>(src.size) : nullptr;
+      for (unsigned i = 0; i < src.size; i++) {
+        new (&items[i]) Node();
+        copyNode(items[i], src.items[i], arena);
+      }
+      dst.type = Node::Array;
+      dst.size = dst.capacity = src.size;
+      dst.items = items;
+      return;
+    }
+    case Node::Object: {
+      Member* members = src.size ? arena.allocate<Member>(src.size) : nullptr;
+      for (unsigned i = 0; i < src.size; i++) {
+        members[i].key = src.members[i].key;
+        members[i].value = new (arena.allocate<Node>(1)) Node();
+        copyNode(*members[i].value, *src.members[i].value, arena);
+      }
+      dst.type = Node::Object;
+      dst.size = dst.capacity = src.size;
+      dst.members = members;
+      return;
+    }
+    default:
+      dst = src;
+  }
+}
+
+static void writeString(std::string_view s, std::string& out) {
+  static const char hex[] = "0123456789abcdef";
+  out.push_back('"');
+  size_t run = 0;
+  for (size_t i = 0; i < s.size(); i++) {
+    unsigned char c = s[i];
+    if (c >= 0x20 && c != '"' && c != '\\' && c != 0x7f) continue;
+    out.append(s.data() + run, i - run);
+    run = i + 1;
+    switch (c) {
+      case '"':
+        out.append("\\\"");
+        break;
+      case '\\':
+        out.append("\\\\");
+        break;
+      case '\n':
+        out.append("\\n");
+        break;
+      case '\r':
+        out.append("\\r");
+        break;
+      case '\t':
+        out.append("\\t");
+        break;
+      default:
+        out.append("\\u00");
+        out.push_back(hex[c >> 4]);
+        out.push_back(hex[c & 0xf]);
+    }
+  }
+  out.append(s.data() + run, s.size() - run);
+  out.push_back('"');
+}
+
+void serialize(const Node& n, std::string& out) {
+  switch (n.type) {
+    case Node::Null:
+      out.append("null");
+      break;
+    case Node::Bool:
+      out.append(n.b ? "true" : "false");
+      break;
+    case Node::Number: {
+      if (!std::isfinite(n.number)) {
+        out.append("null");
+        break;
+      }
+      char tmp[32];
+      auto res = std::to_chars(tmp, tmp + sizeof(tmp), n.number);
+      out.append(tmp, res.ptr);
+      break;
+    }
+    case Node::String:
+      writeString(std::string_view(n.str, n.size), out);
+      break;
+    case Node::Array:
+      out.push_back('[');
+      for (unsigned i = 0; i < n.size; i++) {
+        if (i) out.push_back(',');
+        serialize(n.items[i], out);
+      }
+      out.push_back(']');
+      break;
+    case Node::Object:
+      out.push_back('{');
+      for (unsigned i = 0; i < n.size; i++) {
+        if (i) out.push_back(',');
+        writeString(*n.members[i].key, out);
+        out.push_back(':');
+        serialize(*n.members[i].value, out);
+      }
+      out.push_back('}');
+      break;
+  }
+}
+
+namespace {
+
+/// Recursive descent parser writing straight into an arena. Containers are
+/// collected on a scratch stack and copied into the arena at their exact
+/// size once closed.
+class Parser {
+ public:
+  Parser(std::string_view text, Arena& arena)
+      : p(text.data()), end(text.data() + text.size()), arena(arena) {}
+
+  bool parseDocument(Node& root) {
+    if (!parseValue(root)) return false;
+    skipSpace();
+    return p == end;
+  }
+
+ private:
+  void skipSpace() {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+      p++;
+    }
+  }
+
+  bool expect(const char* word) {
+    size_t n = strlen(word);
+    if (static_cast<size_t>(end - p) < n || memcmp(p, word, n) != 0) {
+      return false;
+    }
+    p += n;
+    return true;
+  }
+
+  bool parseValue(Node& n) {
+    skipSpace();
+    if (p == end) return false;
+    switch (*p) {
+      case '{':
+        return parseObject(n);
+      case '[':
+        return parseArray(n);
+      case '"': {
+        if (!parseString(scratch)) return false;
+        setString(n, scratch, arena);
+        return true;
+      }
+      case 't':
+        n.type = Node::Bool;
+        n.b = true;
+        return expect("true");
+      case 'f':
+        n.type = Node::Bool;
+        n.b = false;
+        return expect("false");
+      case 'n':
+        n.type = Node::Null;
+        return expect("null");
+      default: {
+        n.type = Node::Number;
+        auto res = std::from_chars(p, end, n.number);
+        if (res.ec != std::errc()) return false;
+        p = res.ptr;
+        return true;
+      }
+    }
+  }
+
+  bool parseArray(Node& n) {
+    p++;
+    size_t base = items.size();
+    skipSpace();
+    if (p < end && *p == ']') {
+      p++;
+    } else {
+      while (true) {
+        // nested arrays grow the stack, so parse into a local first
+        Node item;
+        if (!parseValue(item)) return false;
+        items.push_back(item);
+        skipSpace();
+        if (p == end) return false;
+        if (*p == ',') {
+          p++;
+        } else if (*p == ']') {
+          p++;
+          break;
+        } else {
+          return false;
+        }
+      }
+    }
+    unsigned count = items.size() - base;
+    n.type = Node::Array;
+    n.size = n.capacity = count;
+    n.items = count ? arena.allocate<Node>(count) : nullptr;
+    std::copy(items.begin() + base, items.end(), n.items);
+    items.resize(base);
+    return true;
+  }
+
+  bool parseObject(Node& n) {
+    p++;
+    size_t base = members.size();
+    skipSpace();
+    if (p < end && *p == '}') {
+      p++;
+    } else {
+      while (true) {
+        skipSpace();
+        if (p == end || *p != '"' || !parseString(scratch)) return false;
+        skipSpace();
+        if (p == end || *p != ':') return false;
+        p++;
+        Member m{intern(scratch), new (arena.allocate<Node>(1)) Node()};
+        members.push_back(m);
+        if (!parseValue(*m.value)) return false;
+        skipSpace();
+        if (p == end) return false;
+        if (*p == ',') {
+          p++;
+        } else if (*p == '}') {
+          p++;
+          break;
+        } else {
+          return false;
+        }
+      }
+    }
+    unsigned count = members.size() - base;
+    n.type = Node::Object;
+    n.size = n.capacity = count;
+    n.members = count ? arena.allocate<Member>(count) : nullptr;
+    std::copy(members.begin() + base, members.end(), n.members);
+    members.resize(base);
+    return true;
+  }
+
+  static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  }
+
+  bool parseHex4(unsigned& u) {
+    if (end - p < 4) return false;
+    u = 0;
+    for (int i = 0; i < 4; i++) {
+      int d = hexDigit(*p++);
+      if (d < 0) return false;
+      u = u << 4 | d;
+    }
+    return true;
+  }
+
+  void appendUtf8(unsigned u, std::string& out) {
+    if (u < 0x80) {
+      out.push_back(u);
+    } else if (u < 0x800) {
+      out.push_back(0xc0 | u >> 6);
+      out.push_back(0x80 | (u & 0x3f));
+    } else if (u < 0x10000) {
+      out.push_back(0xe0 | u >> 12);
+      out.push_back(0x80 | (u >> 6 & 0x3f));
+      out.push_back(0x80 | (u & 0x3f));
+    } else {
+      out.push_back(0xf0 | u >> 18);
+      out.push_back(0x80 | (u >> 12 & 0x3f));
+      out.push_back(0x80 | (u >> 6 & 0x3f));
+      out.push_back(0x80 | (u & 0x3f));
+    }
+  }
+
+  bool parseString(std::string& out) {
+    out.clear();
+    p++;
+    while (true) {
+      const char* run = p;
+      while (p < end && *p != '"' && *p != '\\') p++;
+      out.append(run, p);
+      if (p == end) return false;
+      if (*p++ == '"') return true;
+      if (p == end) return false;
+      switch (*p++) {
+        case '"':
+          out.push_back('"');
+          break;
+        case '\\':
+          out.push_back('\\');
+          break;
+        case '/':
+          out.push_back('/');
+          break;
+        case 'b':
+          out.push_back('\b');
+          break;
+        case 'f':
+          out.push_back('\f');
+          break;
+        case 'n':
+          out.push_back('\n');
+          break;
+        case 'r':
+          out.push_back('\r');
+          break;
+        case 't':
+          out.push_back('\t');
+          break;
+        case 'u': {
+          unsigned u;
+          if (!parseHex4(u)) return false;
+          if (u >= 0xd800 && u < 0xdc00) {
+            // high surrogate, must be followed by the low one
+            unsigned low;
+            if (end - p < 2 || p[0] != '\\' || p[1] != 'u') return false;
+            p += 2;
+            if (!parseHex4(low) || low < 0xdc00 || low >= 0xe000) return false;
+            u = 0x10000 + ((u - 0xd800) << 10) + (low - 0xdc00);
+          }
+          appendUtf8(u, out);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+  }
+
+  const char* p;
+  const char* end;
+  Arena& arena;
+  std::string scratch;
+  std::vector<Node> items;
+  std::vector<Member> members;
+};
+
+}  // namespace
+
+bool parse(std::string_view text, Document& doc) {
+  Parser parser(text, doc.arena);
+  return parser.parseDocument(doc.root);
+}
+
+}  // namespace flatjson
+
+using flatjson::Document;
+using flatjson::Node;
+
+// JsonValue
+
+JsonValue::JsonValue(const JsonObject& o) { operator=(o); }
+
+JsonValue::JsonValue(const JsonArray& a) { operator=(a); }
+
+JsonValue JsonValue::reference(const std::shared_ptr<Document>& doc,
+                               Node* node) {
+  JsonValue val;
+  val.parent = doc;
+  val.node = node;
+  val.isRef = true;
+  return val;
+}
+
+JsonValue JsonValue::view(const std::shared_ptr<Document>& doc,
+                          const Node* node) {
+  JsonValue val;
+  if (node->type == Node::String || node->type == Node::Array ||
+      node->type == Node::Object) {
+    val.doc = doc;
+    val.node = const_cast<Node*>(node);
+  } else {
+    val.local = *node;
+  }
+  return val;
+}
+
+std::shared_ptr<Document> JsonValue::document() const {
+  return isRef ? parent.lock() : doc;
+}
+
+void JsonValue::setOwned(std::string_view s) {
+  doc = std::make_shared<Document>();
+  flatjson::setString(doc->root, s, doc->arena);
+  node = &doc->root;
+}
+
+void JsonValue::assign(const Node& n) {
+  if (isRef) {
+    std::shared_ptr<Document> target = parent.lock();
+    if (!target) throw std::runtime_error("JSON container no longer exists");
+    flatjson::copyNode(*node, n, target->arena);
+  } else {
+    // only used for scalars, strings and containers are shared instead
+    doc.reset();
+    node = nullptr;
+    local = n;
+  }
+}
+
+JsonValue::operator double() const {
+  const Node& n = getNode();
+  if (n.type != Node::Number) flatjson::typeMismatch("a number");
+  return n.number;
+}
+
+JsonValue::operator std::string() const {
+  const Node& n = getNode();
+  if (n.type != Node::String) flatjson::typeMismatch("a string");
+  return std::string(n.str, n.size);
+}
+
+JsonValue::operator bool() const {
+  const Node& n = getNode();
+  if (n.type != Node::Bool) flatjson::typeMismatch("a bool");
+  return n.b;
+}
+
+JsonValue::operator JsonObject() const {
+  const Node& n = getNode();
+  if (n.type != Node::Object) flatjson::typeMismatch("an object");
+  if (n.size == 0) return JsonObject();
+  return JsonObject(document(), const_cast<Node*>(&n));
+}
+
+JsonValue::operator JsonArray() const {
+  const Node& n = getNode();
+  if (n.type != Node::Array) flatjson::typeMismatch("an array");
+  if (n.size == 0) return JsonArray();
+  return JsonArray(document(), const_cast<Node*>(&n));
+}
+
+JsonValue& JsonValue::operator=(double d) {
+  Node n;
+  n.type = Node::Number;
+  n.number = d;
+  assign(n);
+  return *this;
+}
+
+JsonValue& JsonValue::operator=(bool b) {
+  Node n;
+  n.type = Node::Bool;
+  n.b = b;
+  assign(n);
+  return *this;
+}
+
+JsonValue& JsonValue::operator=(const std::string& s) {
+  if (isRef) {
+    std::shared_ptr<Document> target = parent.lock();
+    if (!target) throw std::runtime_error("JSON container no longer exists");
+    flatjson::setString(*node, s, target->arena);
+  } else {
+    setOwned(s);
+  }
+  return *this;
+}
+
+JsonValue& JsonValue::operator=(const JsonObject& o) {
+  if (isRef || !o.doc) {
+    assign(o.getNode());
+  } else {
+    doc = o.doc;
+    node = o.node;
+  }
+  return *this;
+}
+
+JsonValue& JsonValue::operator=(const JsonArray& a) {
+  if (isRef || !a.doc) {
+    assign(a.getNode());
+  } else {
+    doc = a.doc;
+    node = a.node;
+  }
+  return *this;
+}
+
+std::string JsonValue::toString() const {
+  std::string out;
+  flatjson::serialize(getNode(), out);
+  return out;
+}
+
+// JsonObject
+
+const Node& JsonObject::getNode() const {
+  return node ? *node : flatjson::emptyObject;
+}
+
+Node& JsonObject::mutableNode() {
+  if (!doc || doc.use_count() > 1) {
+    auto fresh = std::make_shared<Document>();
+    flatjson::copyNode(fresh->root, getNode(), fresh->arena);
+    doc = std::move(fresh);
+    node = &doc->root;
+  }
+  return *node;
+}
+
+JsonValue JsonObject::operator[](const std::string& key) {
+  Node& obj = mutableNode();
+  if (const Node* value = flatjson::findMember(obj, key)) {
+    return JsonValue::reference(doc, const_cast<Node*>(value));
+  }
+  if (obj.size == obj.capacity) {
+    unsigned capacity =
+        obj.capacity ? obj.capacity * 2 : flatjson::initialCapacity;
+    flatjson::Member* members =
+        doc->arena.allocate<flatjson::Member>(capacity);
+    std::copy(obj.members, obj.members + obj.size, members);
+    obj.members = members;
+    obj.capacity = capacity;
+  }
+  Node* value = new (doc->arena.allocate<Node>(1)) Node();
+  obj.members[obj.size++] = {flatjson::intern(key), value};
+  return JsonValue::reference(doc, value);
+}
+
+JsonValue JsonObject::operator[](const std::string& key) const {
+  const Node* value = flatjson::findMember(getNode(), key);
+  if (!value) throw std::out_of_range("JSON object has no key " + key);
+  return JsonValue::view(doc, value);
+}
+
+std::string JsonObject::toString() const {
+  std::string out;
+  flatjson::serialize(getNode(), out);
+  return out;
+}
+
+void JsonObject::erase(const std::string& key) {
+  if (!contains(key)) return;
+  Node& obj = mutableNode();
+  for (unsigned i = 0; i < obj.size; i++) {
+    if (*obj.members[i].key == key) {
+      std::copy(obj.members + i + 1, obj.members + obj.size, obj.members + i);
+      obj.size--;
+      return;
+    }
+  }
+}
+
+std::vector<std::string> JsonObject::getKeys() const {
+  const Node& obj = getNode();
+  std::vector<std::string> keys;
+  for (unsigned i = 0; i < obj.size; i++) keys.push_back(*obj.members[i].key);
+  return keys;
+}
+
+bool JsonObject::parse(std::string_view text, JsonObject& out) {
+  auto doc = std::make_shared<Document>();
+  if (!flatjson::parse(text, *doc) || doc->root.type != Node::Object) {
+    return false;
+  }
+  out.doc = std::move(doc);
+  out.node = &out.doc->root;
+  return true;
+}
+
+// JsonArray
+
+JsonArray::JsonArray(const std::initializer_list<JsonValue> ls) {
+  Node& arr = mutableNode();
+  reserve(arr, ls.size());
+  for (const JsonValue& val : ls) {
+    new (&arr.items[arr.size]) Node();
+    flatjson::copyNode(arr.items[arr.size++], val.getNode(), doc->arena);
+  }
+}
+
+const Node& JsonArray::getNode() const {
+  return node ? *node : flatjson::emptyArray;
+}
+
+Node& JsonArray::mutableNode() {
+  if (!doc || doc.use_count() > 1) {
+    auto fresh = std::make_shared<Document>();
+    flatjson::copyNode(fresh->root, getNode(), fresh->arena);
+    doc = std::move(fresh);
+    node = &doc->root;
+  }
+  return *node;
+}
+
+void JsonArray::reserve(Node& arr, unsigned size) {
+  if (size <= arr.capacity) return;
+  unsigned capacity =
+      std::max({size, arr.capacity * 2, flatjson::initialCapacity});
+  Node* items = doc->arena.allocate<Node>(capacity);
+  std::copy(arr.items, arr.items + arr.size, items);
+  arr.items = items;
+  arr.capacity = capacity;
+}
+
+std::string JsonArray::toString() const {
+  std::string out;
+  flatjson::serialize(getNode(), out);
+  return out;
+}
+
+JsonValue JsonArray::operator[](int idx) {
+  Node& arr = mutableNode();
+  return JsonValue::reference(doc, &arr.items[idx]);
+}
+
+JsonValue JsonArray::at(int idx) const {
+  const Node& arr = getNode();
+  if (idx < 0 || static_cast<unsigned>(idx) >= arr.size) {
+    throw std::out_of_range("JSON array index out of range");
+  }
+  return JsonValue::view(doc, &arr.items[idx]);
+}
+
+void JsonArray::push(const JsonValue& val) {
+  Node& arr = mutableNode();
+  reserve(arr, arr.size + 1);
+  new (&arr.items[arr.size]) Node();
+  flatjson::copyNode(arr.items[arr.size++], val.getNode(), doc->arena);
+}
+
+void JsonArray::resize(int size) {
+  Node& arr = mutableNode();
+  reserve(arr, size);
+  for (unsigned i = arr.size; i < static_cast<unsigned>(size); i++) {
+    new (&arr.items[i]) Node();
+  }
+  arr.size = size;
+}
+
+#endif  // JSON_FLAT
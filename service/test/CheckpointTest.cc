@@ -0,0 +1,290 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "IController.h"
+#include "OBJParser.h"
+#include "SimulationModel.h"
+#include "util/Snapshot.h"
+
+namespace {
+
+// Controls the simulations and ignores whatever they send
+class QuietController : public IController {
+ public:
+  void addEntity(const IEntity& entity) {}
+  void updateEntity(const IEntity& entity) {}
+  void removeEntity(const IEntity& entity) {}
+  void sendEventToView(const std::string& event, const JsonObject& details) {}
+};
+
+JsonObject entity(const std::string& type, const std::string& name,
+                  JsonArray position, double speed) {
+  JsonObject params;
+  params["type"] = type;
+  params["name"] = name;
+  params["mesh"] = type;
+  params["position"] = position;
+  params["scale"] = JsonArray{1.0, 1.0, 1.0};
+  params["rotation"] = JsonArray{0.0, 0.0, 0.0, 0.0};
+  params["direction"] = JsonArray{1.0, 0.0, 0.0};
+  params["speed"] = speed;
+  params["radius"] = 1.0;
+  return params;
+}
+
+std::vector<char> readFile(const std::string& path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(file), {});
+}
+
+void writeFile(const std::string& path, const std::vector<char>& bytes) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(bytes.data(), bytes.size());
+}
+
+template <class T>
+T get(const std::vector<char>& bytes, size_t at) {
+  T value;
+  std::memcpy(&value, bytes.data() + at, sizeof(T));
+  return value;
+}
+
+template <class T>
+void put(std::vector<char>& bytes, size_t at, T value) {
+  std::memcpy(bytes.data() + at, &value, sizeof(T));
+}
+
+// Where the parts of a checkpoint's snapshot section are in the file, so
+// tests can change them and still have a file whose checksum holds
+struct SnapshotLayout {
+  static constexpr size_t headerSize = 32;
+  size_t body = 0;      // start of the body
+  size_t records = 0;   // first record
+  size_t count = 0;     // records
+  size_t dataSize = 0;  // where the size of the record data is
+  size_t data = 0;      // start of the record data
+
+  explicit SnapshotLayout(const std::vector<char>& file) {
+    uint32_t sections = get<uint32_t>(file, 12);
+    body = headerSize + sections * 24;
+    size_t at = 0;
+    for (uint32_t i = 0; i < sections; i++) {
+      size_t entry = headerSize + i * 24;
+      if (get<uint32_t>(file, entry) == checkpoint::tag("SNAP")) {
+        at = body + get<uint64_t>(file, entry + 8);
+      }
+    }
+    // the string table, then the records and their data
+    uint64_t strings = get<uint64_t>(file, at);
+    at += 8;
+    for (uint64_t i = 0; i < strings; i++) at += 8 + get<uint64_t>(file, at);
+    count = get<uint64_t>(file, at);
+    records = at + 8;
+    dataSize = records + count * sizeof(Snapshot::Record);
+    data = dataSize + 8;
+  }
+
+  Snapshot::Record record(const std::vector<char>& file, size_t i) const {
+    return get<Snapshot::Record>(file, records + i * sizeof(Snapshot::Record));
+  }
+
+  // Makes the checksum match the body again
+  void seal(std::vector<char>& file) const {
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(file.data() + body),
+                      file.size() - body);
+    put<uint32_t>(file, 24, crc);
+  }
+};
+
+// A drone on its way to the first of two deliveries on the routes of the
+// scenes, saved to a checkpoint. Run from the repository root, where the
+// models are.
+class CheckpointTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    path = testing::TempDir() + "checkpoint_test_" +
+           std::to_string(getpid()) + ".ckp";
+    copy = path + ".copy";
+    std::string graph = "web/public/assets/model/routes.obj";
+    model.setGraph(routing::OBJGraphParser(graph), graph);
+    other.setGraph(routing::OBJGraphParser(graph), graph);
+    model.createEntity(
+        entity("drone", "drone", JsonArray{498.292, 270.0, -228.623}, 30.0));
+    for (int i = 0; i < 2; i++) {
+      std::string robot = "robot" + std::to_string(i);
+      JsonArray start{-300.0 + 50 * i, 254.665, 100.0};
+      JsonArray end{200.0, 254.665, -100.0 + 40 * i};
+      model.createEntity(entity("package", robot + "_package", start, 0));
+      model.createEntity(entity("robot", robot, end, 0));
+      JsonObject trip;
+      trip["name"] = robot;
+      trip["start"] = start;
+      trip["end"] = end;
+      trip["search"] = "astar";
+      model.scheduleTrip(trip);
+    }
+    for (int i = 0; i < 60 * 20; i++) model.update(1.0 / 60);
+    std::string error;
+    ASSERT_TRUE(model.saveCheckpoint(path, error)) << error;
+    file = readFile(path);
+  }
+
+  void TearDown() override {
+    std::remove(path.c_str());
+    std::remove(copy.c_str());
+  }
+
+  // Loads a changed copy of the checkpoint into the other simulation
+  bool loadChanged(const std::vector<char>& bytes, std::string& error) {
+    writeFile(copy, bytes);
+    return other.loadCheckpoint(copy, error);
+  }
+
+  QuietController controller;
+  SimulationModel model{controller};
+  SimulationModel other{controller};
+  std::string path, copy;
+  std::vector<char> file;
+};
+
+// The positions of every entity, by ID
+std::map<int, Vector3> positions(const SimulationModel& model) {
+  std::map<int, Vector3> out;
+  for (auto& [id, entity] : model.getEntities()) {
+    out[id] = entity->getPosition();
+  }
+  return out;
+}
+
+bool operator==(const Vector3& a, const Vector3& b) {
+  return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+}  // namespace
+
+TEST(SnapshotReader, ReadsBackWhatWasWritten) {
+  Snapshot snapshot;
+  SnapshotWriter writer(snapshot);
+  writer.beginRecord(3);
+  writer.write(1.5);
+  std::vector<int> path = {4, 5, 6};
+  writer.writeArray(path.data(), path.size());
+  writer.writeString("red");
+  writer.writeReference(nullptr);
+
+  SnapshotLinks links;
+  SnapshotReader reader(snapshot, snapshot.records.front(), links);
+  EXPECT_EQ(reader.read<double>(), 1.5);
+  std::vector<int> read;
+  reader.readArray(read);
+  EXPECT_EQ(read, path);
+  EXPECT_EQ(reader.readString(), "red");
+  reader.readReference([](IEntity*) { FAIL() << "no reference was written"; });
+  EXPECT_TRUE(reader.ok());
+  links.resolve({});
+
+  EXPECT_EQ(reader.read<int>(), 0);
+  EXPECT_FALSE(reader.ok());
+}
+
+TEST(SnapshotReader, StopsAtTheEndOfTheData) {
+  Snapshot snapshot;
+  SnapshotWriter writer(snapshot);
+  writer.beginRecord(0);
+  writer.write(static_cast<uint32_t>(1000));  // an array count, no values
+  writer.write(static_cast<uint32_t>(7));     // a string index, no table
+  SnapshotLinks links;
+
+  SnapshotReader array(snapshot, snapshot.records.front(), links);
+  std::vector<double> values = {1, 2};
+  array.readArray(values);
+  EXPECT_TRUE(values.empty());
+  EXPECT_FALSE(array.ok());
+  // once failed, nothing more is read
+  EXPECT_EQ(array.read<uint32_t>(), 0u);
+
+  SnapshotReader string(snapshot, snapshot.records.front(), links);
+  string.read<uint32_t>();
+  EXPECT_EQ(string.readString(), "");
+  EXPECT_FALSE(string.ok());
+
+  // a record said to start past the data has nothing in it
+  SnapshotReader past(snapshot, {0, 100}, links);
+  EXPECT_EQ(past.read<char>(), 0);
+  EXPECT_FALSE(past.ok());
+}
+
+TEST_F(CheckpointTest, RoundTrip) {
+  std::string error;
+  ASSERT_TRUE(other.loadCheckpoint(path, error)) << error;
+  EXPECT_EQ(other.getTime(), model.getTime());
+  EXPECT_EQ(positions(other), positions(model));
+  ASSERT_EQ(other.scheduledDeliveries.size(), model.scheduledDeliveries.size());
+  for (size_t i = 0; i < model.scheduledDeliveries.size(); i++) {
+    EXPECT_EQ(other.scheduledDeliveries[i]->getId(),
+              model.scheduledDeliveries[i]->getId());
+  }
+
+  // the trips under way carry on the same
+  for (int i = 0; i < 60 * 30; i++) {
+    model.update(1.0 / 60);
+    other.update(1.0 / 60);
+  }
+  EXPECT_EQ(positions(other), positions(model));
+}
+
+TEST_F(CheckpointTest, TruncatedFileIsRejected) {
+  std::string error;
+  ASSERT_TRUE(other.loadCheckpoint(path, error)) << error;
+  std::map<int, Vector3> loaded = positions(other);
+  for (size_t size : {size_t(0), size_t(16), SnapshotLayout::headerSize,
+                      file.size() / 2, file.size() - 1}) {
+    std::vector<char> cut(file.begin(), file.begin() + size);
+    EXPECT_FALSE(loadChanged(cut, error)) << size;
+    // the simulation is left as it was
+    EXPECT_EQ(positions(other), loaded) << size;
+  }
+}
+
+TEST_F(CheckpointTest, RecordRunningPastTheDataIsRejected) {
+  SnapshotLayout layout(file);
+  ASSERT_GT(layout.count, 0u);
+  uint32_t last = 0;
+  for (size_t i = 0; i < layout.count; i++) {
+    last = std::max(last, layout.record(file, i).offset);
+  }
+  // the data ends a few bytes into the last record
+  std::vector<char> cut = file;
+  put<uint64_t>(cut, layout.dataSize, last + 2);
+  layout.seal(cut);
+  std::string error;
+  EXPECT_FALSE(loadChanged(cut, error));
+  EXPECT_NE(error.find("bad entity record"), std::string::npos) << error;
+  EXPECT_TRUE(other.getEntities().empty());
+}
+
+TEST_F(CheckpointTest, CorruptRecordsAreReadWithinTheData) {
+  SnapshotLayout layout(file);
+  size_t dataSize = get<uint64_t>(file, layout.dataSize);
+  ASSERT_GT(dataSize, 0u);
+  // every byte of the record data in turn, set so counts and string
+  // indices come out huge
+  for (size_t i = 0; i < dataSize; i++) {
+    std::vector<char> corrupt = file;
+    corrupt[layout.data + i] = '\xff';
+    layout.seal(corrupt);
+    std::string error;
+    if (!loadChanged(corrupt, error)) {
+      EXPECT_TRUE(other.getEntities().empty()) << i;
+    }
+  }
+}
@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "AStar.h"
+#include "Graph.h"
+#include "OBJParser.h"
+
+using routing::Graph;
+
+namespace {
+
+// Length of a path through the double node positions
+double pathLength(const Graph& g, const std::vector<int>& path) {
+  double length = 0;
+  for (size_t i = 1; i < path.size(); i++) {
+    length += g.nodes[path[i - 1]].getPosition().dist(
+        g.nodes[path[i]].getPosition());
+  }
+  return length;
+}
+
+// The routes of the scenes, once scanning doubles and once single precision
+// coordinates. Run from the repository root, where the models are.
+class GraphPrecisionTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    const Graph* parsed =
+        routing::OBJGraphParser("web/public/assets/model/routes.obj");
+    ASSERT_NE(parsed, nullptr);
+    exact.reset(parsed);
+    ASSERT_GT(exact->nodes.size(), 100);
+    ASSERT_FALSE(exact->isSinglePrecision());
+    single = std::make_unique<Graph>(*exact);
+    single->setSinglePrecision(true);
+  }
+
+  std::unique_ptr<const Graph> exact;
+  std::unique_ptr<Graph> single;
+};
+
+}  // namespace
+
+TEST_F(GraphPrecisionTest, CoordinatesFollowTheSetting) {
+  EXPECT_EQ(exact->coordinates.size(), 0);
+  EXPECT_EQ(single->coordinates.size(), single->nodes.size());
+  EXPECT_GT(single->coordinateError, 0);
+  single->addNode({1, 2, 3});
+  EXPECT_EQ(single->coordinates.size(), single->nodes.size());
+  single->setSinglePrecision(false);
+  EXPECT_EQ(single->coordinates.size(), 0);
+}
+
+TEST_F(GraphPrecisionTest, NearestNodeMatchesDoubles) {
+  std::mt19937 random(3);
+  std::uniform_real_distribution<double> x(-1500, 1500), y(200, 300),
+      z(-900, 900);
+  for (int n = 0; n < 500; n++) {
+    Vector3 pos(x(random), y(random), z(random));
+    // now and then right on a node, which both have to find
+    if (n % 10 == 0) pos = exact->nodes[n % exact->nodes.size()].getPosition();
+    int expected = exact->nearestNode(pos);
+    int found = single->nearestNode(pos);
+    if (found == expected) continue;
+    // another node that is as close but for rounding will do
+    double best = exact->nodes[expected].getPosition().dist(pos);
+    double chosen = exact->nodes[found].getPosition().dist(pos);
+    EXPECT_LE(chosen - best, 2 * single->coordinateError)
+        << "query " << n << " found node " << found << " for " << expected;
+  }
+}
+
+TEST_F(GraphPrecisionTest, AstarPathsMatchDoubles) {
+  std::mt19937 random(5);
+  // node 0 is the parser's placeholder, away from every route
+  std::uniform_int_distribution<int> node(1, exact->nodes.size() - 1);
+  routing::AStar astar;
+  int routes = 0;
+  for (int n = 0; n < 40; n++) {
+    int from = node(random), to = node(random);
+    auto expected = astar.getPath(*exact, from, to);
+    auto found = astar.getPath(*single, from, to);
+    ASSERT_EQ(found.has_value(), expected.has_value()) << from << " " << to;
+    if (!expected) continue;
+    routes++;
+    // the estimates never overshoot, so the path is as short as with
+    // doubles, and with no ties it is the same one
+    EXPECT_DOUBLE_EQ(pathLength(*single, *found),
+                     pathLength(*exact, *expected))
+        << from << " to " << to;
+    EXPECT_EQ(*found, *expected) << from << " to " << to;
+  }
+  EXPECT_GT(routes, 20);
+}
@@ -0,0 +1,104 @@
+#include "util/JsonWriter.h"
+
+#include <gtest/gtest.h>
+
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <string>
+
+#include "util/json.h"
+
+TEST(JsonWriter, EscapesStrings) {
+  JsonWriter writer;
+  std::string text = "quote \" backslash \\ slash / tab \t newline \n";
+  text += std::string("\r\b\f") + '\x01' + '\x1f' + '\x7f' + "é";
+  writer.beginObject().key("k\"ey").value(text).endObject();
+  EXPECT_EQ(writer.str(),
+            "{\"k\\\"ey\":\"quote \\\" backslash \\\\ slash / tab \\t "
+            "newline \\n\\r\\b\\f\\u0001\\u001f\\u007fé\"}");
+
+  // and reads back as it was
+  JsonObject parsed;
+  ASSERT_TRUE(JsonObject::parse(writer.str(), parsed));
+  EXPECT_EQ(static_cast<std::string>(parsed["k\"ey"]), text);
+}
+
+TEST(JsonWriter, WritesNonFiniteNumbersAsNull) {
+  JsonWriter writer;
+  double inf = std::numeric_limits<double>::infinity();
+  writer.beginArray()
+      .value(std::nan(""))
+      .value(inf)
+      .value(-inf)
+      .value(Vector3(1, inf, std::nan("")))
+      .endArray();
+  EXPECT_EQ(writer.str(), "[null,null,null,[1,null,null]]");
+}
+
+TEST(JsonWriter, NumbersReadBackExactly) {
+  std::mt19937_64 random(11);
+  std::uniform_real_distribution<double> small(-1, 1);
+  JsonWriter writer;
+  for (int n = 0; n < 10000; n++) {
+    // all magnitudes, subnormals and extremes included
+    double d = std::ldexp(small(random), static_cast<int>(random() % 2090) -
+                                             1070);
+    if (n == 0) d = std::numeric_limits<double>::max();
+    if (n == 1) d = std::numeric_limits<double>::denorm_min();
+    if (n == 2) d = -0.0;
+    writer.clear();
+    writer.value(d);
+    double back;
+    const std::string& text = writer.str();
+    auto result = std::from_chars(text.data(), text.data() + text.size(), back);
+    ASSERT_EQ(result.ptr, text.data() + text.size()) << text;
+    ASSERT_EQ(back, d) << text;
+
+    JsonObject parsed;
+    ASSERT_TRUE(JsonObject::parse("{\"d\":" + text + "}", parsed)) << text;
+    ASSERT_EQ(static_cast<double>(parsed["d"]), d) << text;
+  }
+}
+
+TEST(JsonWriter, SeparatesNestedValues) {
+  JsonObject details;
+  details["name"] = "drone";
+  details["position"] = JsonArray{1.5, 2, -3};
+  details["nested"] = JsonObject();
+
+  JsonWriter writer;
+  writer.beginObject()
+      .key("a")
+      .raw("{\"x\":[1,2]}")
+      .key("b")
+      .value(details)
+      .key("c")
+      .beginArray()
+      .raw("1")
+      .value(details)
+      .raw("[]")
+      .beginObject()
+      .endObject()
+      .value(3)
+      .endArray()
+      .key("d")
+      .value(true)
+      .endObject();
+  std::string object = details.toString();
+  EXPECT_EQ(writer.str(), "{\"a\":{\"x\":[1,2]},\"b\":" + object +
+                              ",\"c\":[1," + object + ",[],{},3],\"d\":true}");
+
+  JsonObject parsed;
+  ASSERT_TRUE(JsonObject::parse(writer.str(), parsed));
+  EXPECT_EQ(JsonObject(parsed["b"]).toString(), object);
+}
+
+TEST(JsonWriter, ClearStartsOver) {
+  JsonWriter writer;
+  writer.beginArray().value(1);
+  writer.clear();
+  writer.value(2);
+  EXPECT_EQ(writer.str(), "2");
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "DataCollector.h"
+#include "IController.h"
+#include "OBJParser.h"
+#include "SimulationFork.h"
+#include "SimulationModel.h"
+
+namespace {
+
+// Controls the forked simulation and ignores whatever it sends
+class QuietController : public IController {
+ public:
+  void addEntity(const IEntity& entity) {}
+  void updateEntity(const IEntity& entity) {}
+  void removeEntity(const IEntity& entity) {}
+  void sendEventToView(const std::string& event, const JsonObject& details) {}
+};
+
+JsonObject entity(const std::string& type, const std::string& name,
+                  JsonArray position, double speed) {
+  JsonObject params;
+  params["type"] = type;
+  params["name"] = name;
+  params["mesh"] = type;
+  params["position"] = position;
+  params["scale"] = JsonArray{1.0, 1.0, 1.0};
+  params["rotation"] = JsonArray{0.0, 0.0, 0.0, 0.0};
+  params["direction"] = JsonArray{1.0, 0.0, 0.0};
+  params["speed"] = speed;
+  params["radius"] = 1.0;
+  return params;
+}
+
+// A drone and a few deliveries scheduled for it on the routes of the scenes.
+// Run from the repository root, where the models are.
+class SimulationForkTest : public testing::Test {
+ protected:
+  static constexpr int trips = 3;
+
+  void SetUp() override {
+    std::string graph = "web/public/assets/model/routes.obj";
+    model.setGraph(routing::OBJGraphParser(graph), graph);
+    model.createEntity(
+        entity("drone", "drone", JsonArray{498.292, 270.0, -228.623}, 60.0));
+    for (int i = 0; i < trips; i++) {
+      std::string robot = "robot" + std::to_string(i);
+      JsonArray start{-300.0 + 50 * i, 254.665, 100.0};
+      JsonArray end{200.0, 254.665, -100.0 + 40 * i};
+      model.createEntity(entity("package", robot + "_package", start, 0));
+      model.createEntity(entity("robot", robot, end, 0));
+      JsonObject trip;
+      trip["name"] = robot;
+      trip["start"] = start;
+      trip["end"] = end;
+      trip["search"] = "beeline";
+      model.scheduleTrip(trip);
+    }
+    ASSERT_EQ(model.scheduledDeliveries.size(), trips);
+  }
+
+  QuietController controller;
+  SimulationModel model{controller};
+};
+
+}  // namespace
+
+TEST_F(SimulationForkTest, MetricsComeFromTheForksCollector) {
+  DataCollector::Stats before = DataCollector::getInstance().getStats();
+  SimulationFork fork(model);
+  fork.start(300);
+  const SimulationFork::Metrics& metrics = fork.join();
+
+  EXPECT_EQ(metrics.ticks, 300 * 60);
+  EXPECT_EQ(metrics.dispatched, trips);
+  EXPECT_EQ(metrics.pickups, trips);
+  EXPECT_EQ(metrics.deliveries, trips);
+  EXPECT_EQ(metrics.pending, 0);
+  // every delivery was scheduled before the fork, which learned when
+  EXPECT_EQ(metrics.latency.count, trips);
+  EXPECT_GT(metrics.latency.min, 0);
+  EXPECT_LE(metrics.latency.max, metrics.simulatedTime);
+  // later deliveries waited for the earlier ones
+  EXPECT_GT(metrics.latency.max, 2 * metrics.latency.min);
+
+  // none of it was recorded into the simulation's collector
+  DataCollector::Stats after = DataCollector::getInstance().getStats();
+  EXPECT_EQ(after.dispatched, before.dispatched);
+  EXPECT_EQ(after.deliveries, before.deliveries);
+  EXPECT_EQ(model.scheduledDeliveries.size(), trips);
+}
+
+TEST_F(SimulationForkTest, CancelledForkCountsWhatItGotTo) {
+  SimulationFork fork(model);
+  fork.cancel();
+  fork.start(300);
+  const SimulationFork::Metrics& metrics = fork.join();
+  EXPECT_EQ(metrics.ticks, 0);
+  EXPECT_EQ(metrics.dispatched, 0);
+  EXPECT_EQ(metrics.deliveries, 0);
+  EXPECT_EQ(metrics.latency.count, 0);
+  EXPECT_EQ(metrics.pending, trips);
+}
@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "SimulationTimeline.h"
+
+namespace {
+
+// Writes the state of a made-up simulation at a tick. Entity 1 changes
+// every tick, 2 picks up a new string every 9 ticks, 3 is only there for
+// some ticks, 4 changes length and 5 never changes. A different branch
+// writes other values, as after seeking back and carrying on.
+void writeTick(SnapshotWriter& writer, uint64_t tick, int branch = 0) {
+  for (int id = 1; id <= 5; id++) {
+    if (id == 3 && (tick < 10 || tick >= 25)) continue;
+    writer.beginRecord(id);
+    writer.write(static_cast<uint64_t>(id == 5 ? 0 : tick / id));
+    writer.write(id * static_cast<double>(tick) * 0.5 + branch);
+    writer.writeString(id == 2 ? "phase" + std::to_string(tick / 9 + branch)
+                               : "entity" + std::to_string(id));
+    std::vector<int> path(id == 4 ? tick % 3 : 1, id + branch);
+    writer.writeArray(path.data(), path.size());
+  }
+}
+
+// What a snapshot written by writeTick() says, whatever its string table
+std::string describe(const Snapshot& snapshot) {
+  std::ostringstream out;
+  SnapshotLinks links;
+  for (const Snapshot::Record& record : snapshot.records) {
+    SnapshotReader reader(snapshot, record, links);
+    out << record.id << ": " << reader.read<uint64_t>() << " "
+        << reader.read<double>() << " " << reader.readString() << " [";
+    std::vector<int> path;
+    reader.readArray(path);
+    for (int step : path) out << step << " ";
+    out << "]" << (reader.ok() ? "" : " bad") << "\n";
+  }
+  return out.str();
+}
+
+std::string expected(uint64_t tick, int branch = 0) {
+  Snapshot snapshot;
+  SnapshotWriter writer(snapshot);
+  writeTick(writer, tick, branch);
+  return describe(snapshot);
+}
+
+// Timelines of short chunks, with every sealed chunk spilled or none
+class SimulationTimelineTest : public testing::TestWithParam<bool> {
+ protected:
+  static constexpr int interval = 7;
+
+  void SetUp() override {
+    SimulationTimeline::Options options;
+    options.keyframeInterval = interval;
+    options.memoryLimit = GetParam() ? 0 : 64 << 20;
+    options.chunkReserve = 1 << 16;
+    SimulationTimeline::setDefaultOptions(options);
+  }
+
+  void TearDown() override {
+    SimulationTimeline::setDefaultOptions(SimulationTimeline::Options());
+  }
+
+  static void record(SimulationTimeline& timeline, uint64_t from, uint64_t to,
+                     int branch = 0) {
+    for (uint64_t tick = from; tick < to; tick++) {
+      writeTick(timeline.beginTick(), tick, branch);
+      timeline.recordTick(tick * 0.1);
+    }
+  }
+
+  // Checks every tick in a range reads back as written
+  static void check(SimulationTimeline& timeline, uint64_t from, uint64_t to,
+                    int branch = 0) {
+    for (uint64_t tick = from; tick < to; tick++) {
+      Snapshot out;
+      double time;
+      std::string error;
+      ASSERT_TRUE(timeline.reconstruct(tick, out, time, error))
+          << "tick " << tick << ": " << error;
+      EXPECT_EQ(describe(out), expected(tick, branch)) << "tick " << tick;
+      EXPECT_EQ(time, tick * 0.1) << "tick " << tick;
+    }
+  }
+};
+
+}  // namespace
+
+TEST_P(SimulationTimelineTest, EveryTickReadsBack) {
+  SimulationTimeline timeline;
+  // a few whole chunks and one still open
+  record(timeline, 0, 5 * interval + 3);
+  EXPECT_EQ(timeline.getEndTick(), 5 * interval + 3);
+  check(timeline, 0, 5 * interval + 3);
+
+  Snapshot out;
+  double time;
+  std::string error;
+  EXPECT_FALSE(timeline.reconstruct(5 * interval + 3, out, time, error));
+}
+
+TEST_P(SimulationTimelineTest, SeekingBackCarriesOnFromTheTick) {
+  // the last tick of a chunk, the first one, one in the middle of a sealed
+  // chunk and one in the open chunk
+  for (uint64_t sought : {2 * interval - 1, 2 * interval, 2 * interval + 3,
+                          4 * interval + 1}) {
+    SimulationTimeline timeline;
+    record(timeline, 0, 4 * interval + 3);
+    timeline.seek(sought);
+    // the ticks after it are there until the next is recorded
+    check(timeline, sought + 1, 4 * interval + 3);
+    record(timeline, sought + 1, 6 * interval, 1);
+    EXPECT_EQ(timeline.getEndTick(), 6 * interval) << sought;
+    check(timeline, 0, sought + 1);
+    check(timeline, sought + 1, 6 * interval, 1);
+  }
+}
+
+TEST_P(SimulationTimelineTest, ClearStartsOver) {
+  SimulationTimeline timeline;
+  record(timeline, 0, 3 * interval);
+  timeline.clear();
+  EXPECT_EQ(timeline.getEndTick(), 0u);
+  record(timeline, 0, 2 * interval + 1, 1);
+  check(timeline, 0, 2 * interval + 1, 1);
+}
+
+TEST_P(SimulationTimelineTest, SeekingToDroppedTicks) {
+  SimulationTimeline::Options options;
+  options.keyframeInterval = interval;
+  options.memoryLimit = GetParam() ? 0 : 64 << 20;
+  options.maxTicks = 2 * interval;
+  SimulationTimeline::setDefaultOptions(options);
+  SimulationTimeline timeline;
+  record(timeline, 0, 6 * interval);
+
+  Snapshot out;
+  double time;
+  std::string error;
+  EXPECT_FALSE(timeline.reconstruct(1, out, time, error));
+  check(timeline, 4 * interval, 6 * interval);
+
+  // no chunk with the tick is left; recording carries on after it
+  timeline.seek(1);
+  record(timeline, 2, 2 * interval, 1);
+  EXPECT_EQ(timeline.getEndTick(), 2 * interval);
+  EXPECT_FALSE(timeline.reconstruct(1, out, time, error));
+  check(timeline, 2, 2 * interval, 1);
+}
+
+INSTANTIATE_TEST_SUITE_P(Memory, SimulationTimelineTest, testing::Bool(),
+                         [](const testing::TestParamInfo<bool>& info) {
+                           return info.param ? "Spilled" : "InMemory";
+                         });
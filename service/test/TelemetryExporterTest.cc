@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "util/TelemetryExporter.h"
+
+namespace {
+
+// Reads a telemetry file back as far as the row counts of its blocks
+class TelemetryFile {
+ public:
+  explicit TelemetryFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(file), {});
+  }
+
+  // Rows in the blocks of each table, or false if the file is malformed
+  bool countRows(std::vector<uint64_t>& rows) {
+    if (bytes.size() < 16 || std::memcmp(bytes.data(), "TRANSTLM", 8)) {
+      return false;
+    }
+    at = 12;
+    uint32_t tables = read<uint32_t>();
+    std::vector<uint32_t> widths(tables);
+    for (uint32_t t = 0; t < tables && ok; t++) {
+      at += read<uint32_t>();
+      for (uint32_t c = read<uint32_t>(); c > 0 && ok; c--) {
+        at += read<uint32_t>() + 1;
+        widths[t] += read<uint8_t>();
+      }
+    }
+    rows.assign(tables, 0);
+    while (ok && at < bytes.size()) {
+      uint32_t table = read<uint32_t>();
+      uint32_t count = read<uint32_t>();
+      if (table >= tables) return false;
+      rows[table] += count;
+      at += static_cast<size_t>(count) * widths[table];
+    }
+    return ok && at == bytes.size();
+  }
+
+ private:
+  template <class T>
+  T read() {
+    T value{};
+    if (at + sizeof(T) > bytes.size()) {
+      ok = false;
+      return value;
+    }
+    std::memcpy(&value, bytes.data() + at, sizeof(T));
+    at += sizeof(T);
+    return value;
+  }
+
+  std::vector<char> bytes;
+  size_t at = 0;
+  bool ok = true;
+};
+
+class TelemetryExporterTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    path = testing::TempDir() + "telemetry_test_" +
+           std::to_string(getpid()) + ".tlm";
+  }
+  void TearDown() override { std::remove(path.c_str()); }
+
+  static std::vector<TelemetryExporter::EventRow> events(int n) {
+    std::vector<TelemetryExporter::EventRow> rows;
+    for (int i = 0; i < n; i++) {
+      rows.push_back({static_cast<uint64_t>(i), i * 0.5, 0, i % 4,
+                      static_cast<uint8_t>(i % 2), Vector3(i, 0, 0)});
+    }
+    return rows;
+  }
+
+  std::string path;
+};
+
+}  // namespace
+
+TEST_F(TelemetryExporterTest, WritesEverythingThatFits) {
+  TelemetryExporter exporter;
+  std::string error;
+  ASSERT_TRUE(exporter.open({path}, error)) << error;
+  std::vector<TelemetryExporter::EventRow> rows = events(100);
+  TelemetryExporter::FleetRow fleet{1, 2, 1, 3, 4.5};
+  exporter.push(rows, &fleet);
+  EXPECT_TRUE(rows.empty());
+  exporter.close();
+  EXPECT_EQ(exporter.getDropped(), 0u);
+
+  std::vector<uint64_t> counts;
+  ASSERT_TRUE(TelemetryFile(path).countRows(counts));
+  EXPECT_EQ(counts, (std::vector<uint64_t>{100, 1}));
+}
+
+TEST_F(TelemetryExporterTest, DropsRowsPastTheCap) {
+  TelemetryExporter::Options options{path};
+  options.maxPending = 10;
+  TelemetryExporter exporter;
+  std::string error;
+  ASSERT_TRUE(exporter.open(options, error)) << error;
+  // nothing is waiting yet, so the first ten rows fit whatever the writer
+  // does meanwhile, and the rest of the batch and the fleet row do not
+  std::vector<TelemetryExporter::EventRow> rows = events(25);
+  TelemetryExporter::FleetRow fleet{1, 2, 1, 3, 4.5};
+  exporter.push(rows, &fleet);
+  EXPECT_TRUE(rows.empty());
+  EXPECT_EQ(exporter.getDropped(), 16u);
+  exporter.close();
+
+  std::vector<uint64_t> counts;
+  ASSERT_TRUE(TelemetryFile(path).countRows(counts));
+  EXPECT_EQ(counts, (std::vector<uint64_t>{10, 0}));
+}
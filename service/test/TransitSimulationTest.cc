@@ -0,0 +1,207 @@
+#include <arpa/inet.h>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>  // NOLINT [build/c++11]
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>  // NOLINT [build/c++11]
+
+#include "OBJParser.h"
+#include "TransitSimulation.h"
+#include "WebServer.h"
+
+namespace {
+
+const int port = 18093;
+
+// Watches a simulation, like a viewer of a shared one
+class ViewerSession : public WebServerBase::Session {
+ public:
+  explicit ViewerSession(TransitSimulation* simulation)
+      : simulation(simulation) {}
+  ~ViewerSession() { simulation->unsubscribe(this); }
+  void onConnect() { simulation->subscribe(this, false); }
+
+ private:
+  TransitSimulation* simulation;
+};
+
+// A websocket client that reads whatever the server sends and ignores it
+class Client {
+ public:
+  bool connect(const std::string& path) {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))) {
+      return false;
+    }
+    std::string request = "GET " + path +
+                          " HTTP/1.1\r\n"
+                          "Host: localhost\r\n"
+                          "Upgrade: websocket\r\n"
+                          "Connection: Upgrade\r\n"
+                          "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                          "Sec-WebSocket-Version: 13\r\n"
+                          "Sec-WebSocket-Protocol: web_server\r\n\r\n";
+    return send(fd, request.data(), request.size(), 0) == request.size();
+  }
+
+  // Reads what has arrived, returns how many bytes
+  size_t drain() {
+    size_t total = 0;
+    char buf[65536];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) total += n;
+    return total;
+  }
+
+  ~Client() {
+    if (fd >= 0) close(fd);
+  }
+
+ private:
+  int fd = -1;
+};
+
+// Runs the server until the client has been sent everything queued for it
+void pump(WebServerBase& server, Client& client) {
+  int idle = 0;
+  while (idle < 3) {
+    server.wake();
+    server.service();
+    idle = client.drain() ? 0 : idle + 1;
+  }
+}
+
+// Sets up the graph and entities of a scene file, as the web client does,
+// with extra copies of its human
+void loadScene(SimulationModel& model, const std::string& path, int humans) {
+  std::ifstream file(path);
+  std::stringstream text;
+  text << "{\"scene\": " << file.rdbuf() << "}";
+  JsonObject document;
+  ASSERT_TRUE(JsonObject::parse(text.str(), document)) << "can't read " << path;
+  JsonArray scene = document["scene"];
+  for (int i = 0; i < scene.size(); i++) {
+    JsonObject command = scene[i];
+    std::string name = command["command"];
+    JsonObject params = command["params"];
+    if (name == "SetGraph") {
+      std::string graph = params["filePath"];
+      model.setGraph(routing::OBJGraphParser(graph), graph);
+    } else if (name == "CreateEntity") {
+      model.createEntity(params);
+      std::string type = params["type"];
+      for (int n = 0; type == "human" && n < humans; n++) {
+        JsonObject human = params;
+        human["name"] = "human" + std::to_string(n);
+        human["position"] = JsonArray{-300.0 + 10 * n, 254.665, 100.0};
+        model.createEntity(human);
+      }
+    }
+  }
+}
+
+// Watches a scene for a few seconds and checks that its steady ticks made no
+// allocations. With a viewport the view is limited to a square around the
+// origin.
+void runSteadyScene(const std::string& path, int humans, double viewport = 0) {
+  TransitSimulation simulation;
+  WebServerWithState<ViewerSession, TransitSimulation*> server(&simulation,
+                                                               port);
+  Client client;
+  ASSERT_TRUE(client.connect(path));
+  while (simulation.getSubscriberCount() == 0) server.service();
+  if (viewport > 0) {
+    JsonObject region;
+    region["min"] = JsonArray{-viewport, -viewport};
+    region["max"] = JsonArray{viewport, viewport};
+    simulation.setViewport(server.sessions.front(), region);
+  }
+
+  loadScene(simulation.getModel(), "web/public/scenes/umn.json", humans);
+
+  for (int tick = 0; tick < 300; tick++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    simulation.update(1.0);
+    pump(server, client);
+  }
+
+  ASSERT_GT(simulation.getSteadyTicks(), 50);
+  EXPECT_EQ(simulation.getSteadyAllocations().allocations, 0)
+      << simulation.getSteadyAllocations().bytes << " bytes";
+  // the client has read everything, so nothing is still held for it and
+  // buffers were reused rather than piled up
+  EXPECT_EQ(server.getDeflatedFrameCount(), 0);
+  EXPECT_LE(simulation.getBufferCount(),
+            2 * simulation.getModel().getEntities().size());
+}
+
+}  // namespace
+
+// Run from the repository root, where the scene files are
+class SteadyTickTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    if (!AllocationStats::enabled) {
+      GTEST_SKIP() << "allocations are only counted in builds made by make test";
+    }
+  }
+};
+
+TEST_F(SteadyTickTest, SceneWithoutCompression) { runSteadyScene("/", 0); }
+
+TEST_F(SteadyTickTest, SceneWithDeflateSession) {
+  runSteadyScene("/?compress=deflate", 0);
+}
+
+TEST_F(SteadyTickTest, WanderingHumansWithDeflateSession) {
+  runSteadyScene("/?compress=deflate", 50);
+}
+
+TEST_F(SteadyTickTest, WanderingHumansInViewport) {
+  runSteadyScene("/", 50, 200);
+}
+
+// Helicopters fly beelines back and forth without planning a route or
+// sending events, so besides the odd mileage notification the only work of
+// a tick is serializing and queuing their positions. Every other tick the
+// client is not read from, so the queue holds two ticks of messages.
+TEST_F(SteadyTickTest, QueueAndBufferTrafficOnly) {
+  TransitSimulation simulation;
+  WebServerWithState<ViewerSession, TransitSimulation*> server(&simulation,
+                                                               port);
+  Client client;
+  ASSERT_TRUE(client.connect("/"));
+  while (simulation.getSubscriberCount() == 0) server.service();
+
+  for (int n = 0; n < 4; n++) {
+    JsonObject helicopter;
+    helicopter["type"] = "helicopter";
+    helicopter["name"] = "helicopter" + std::to_string(n);
+    helicopter["position"] = JsonArray{100.0 * n, 550.0, 0.0};
+    helicopter["direction"] = JsonArray{1.0, 0.0, 0.0};
+    helicopter["speed"] = 10.0;
+    simulation.getModel().createEntity(helicopter);
+  }
+
+  const int ticks = 300;
+  for (int tick = 0; tick < ticks; tick++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    simulation.update(1.0);
+    if (tick % 2) pump(server, client);
+  }
+
+  // the ticks a notification makes eventful, and the ones after them, are
+  // all that is left out
+  EXPECT_GT(simulation.getSteadyTicks(), ticks - 60);
+  EXPECT_EQ(simulation.getSteadyAllocations().allocations, 0)
+      << simulation.getSteadyAllocations().bytes << " bytes";
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "math/vector_kernels.h"
+
+namespace {
+
+// Positions spread over a map the size of the scenes', with a few repeated
+// so ties between lanes and the tail are exercised
+Float3Array randomPositions(size_t n, unsigned seed) {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<double> coordinate(-1500, 1500);
+  Float3Array pos;
+  for (size_t i = 0; i < n; i++) {
+    if (i >= 4 && i % 5 == 0) {
+      pos.push_back(pos[i / 2]);
+    } else {
+      pos.push_back(Vector3(coordinate(random), coordinate(random),
+                            coordinate(random)));
+    }
+  }
+  return pos;
+}
+
+// Runs the kernels once with AVX2 and once without
+class VectorKernelsTest : public testing::TestWithParam<size_t> {
+ protected:
+  void SetUp() override {
+    if (!kernels::usesAvx2()) {
+      GTEST_SKIP() << "the CPU has no AVX2 to compare the scalar code with";
+    }
+  }
+  void TearDown() override { kernels::setAvx2(true); }
+};
+
+}  // namespace
+
+TEST_P(VectorKernelsTest, NearestMatchesScalar) {
+  Float3Array pos = randomPositions(GetParam(), GetParam());
+  std::mt19937 random(7);
+  std::uniform_real_distribution<double> coordinate(-1600, 1600);
+  for (int n = 0; n < 200; n++) {
+    Vector3 target(coordinate(random), coordinate(random), coordinate(random));
+    // now and then exactly on a repeated position, where the first wins
+    if (n % 10 == 0 && pos.size() > 10) target = pos[pos.size() / 2];
+    kernels::setAvx2(true);
+    int vectorized = kernels::nearest(pos, target);
+    kernels::setAvx2(false);
+    int scalar = kernels::nearest(pos, target);
+    ASSERT_EQ(vectorized, scalar) << "size " << pos.size() << ", query " << n;
+  }
+}
+
+TEST_P(VectorKernelsTest, DistancesMatchScalar) {
+  Float3Array pos = randomPositions(GetParam() + 16, GetParam());
+  // ids out of order and repeated, as neighbour lists can be
+  std::vector<int> ids;
+  for (size_t i = 0; i < GetParam(); i++) {
+    ids.push_back((i * 7 + 3) % pos.size());
+  }
+  Vector3 target(12.5, -300.25, 977);
+  std::vector<float> vectorized(ids.size()), scalar(ids.size());
+  kernels::setAvx2(true);
+  kernels::distances(pos, ids.data(), ids.size(), target, vectorized.data());
+  kernels::setAvx2(false);
+  kernels::distances(pos, ids.data(), ids.size(), target, scalar.data());
+  for (size_t i = 0; i < ids.size(); i++) {
+    // bit for bit, not just close
+    ASSERT_EQ(vectorized[i], scalar[i]) << "id " << i << " of " << ids.size();
+    float dx = pos.x[ids[i]] - static_cast<float>(target.x);
+    float dy = pos.y[ids[i]] - static_cast<float>(target.y);
+    float dz = pos.z[ids[i]] - static_cast<float>(target.z);
+    ASSERT_EQ(scalar[i], std::sqrt(dx * dx + dy * dy + dz * dz));
+  }
+}
+
+// sizes below, at and around multiples of the eight lanes, so the tails
+// after the last full vector are covered
+INSTANTIATE_TEST_SUITE_P(Tails, VectorKernelsTest,
+                         testing::Values(0, 1, 3, 7, 8, 9, 15, 16, 17, 23,
+                                         64, 1001));
+
+TEST(VectorKernels, NearestOfNothing) {
+  Float3Array pos;
+  EXPECT_EQ(kernels::nearest(pos, Vector3()), -1);
+  kernels::setAvx2(false);
+  EXPECT_EQ(kernels::nearest(pos, Vector3()), -1);
+  kernels::setAvx2(true);
+}
@@ -34,4 +34,24 @@ function resetCurrentView() {
   currentView = -1;
 }
 
-export { camera, updateControls, currentView, resetCurrentView };
+// the ground the entities move on, and how scene units map to the simulation
+const ground = new THREE.Plane(new THREE.Vector3(0, 1, 0), 0);
+const sceneToSim = 14.2;
+const raycaster = new THREE.Raycaster();
+
+// part of the map in view as simulation [x, z] bounds, or undefined if the
+// camera can see the horizon
+function viewBounds() {
+  let min = [Infinity, Infinity];
+  let max = [-Infinity, -Infinity];
+  for (let [x, y] of [[-1, -1], [1, -1], [1, 1], [-1, 1]]) {
+    raycaster.setFromCamera(new THREE.Vector2(x, y), camera);
+    let hit = raycaster.ray.intersectPlane(ground, new THREE.Vector3());
+    if (!hit) return undefined;
+    min = [Math.min(min[0], hit.x * sceneToSim), Math.min(min[1], hit.z * sceneToSim)];
+    max = [Math.max(max[0], hit.x * sceneToSim), Math.max(max[1], hit.z * sceneToSim)];
+  }
+  return { min: min.map(Math.round), max: max.map(Math.round) };
+}
+
+export { camera, updateControls, currentView, resetCurrentView, viewBounds };
@@ -1,10 +1,11 @@
 import * as THREE from "three";
 import $ from "jquery";
 import { scene } from "./scene";
-import { camera, updateControls } from "./camera";
-import { connect, disconnect, sendCommand } from "./websocket_api";
+import { camera, updateControls, viewBounds } from "./camera";
+import { connect, disconnect, onMessage, sendCommand } from "./websocket_api";
 import {
   addEntity,
+  entityDetails,
   updateEntity,
   removeEntity,
   updateAnimations,
@@ -96,6 +97,20 @@ resetSimulationButton.onclick = () => {
   loadScene(sceneFile);
 };
 
+// only hear about entities the camera can see
+let lastViewport = "";
+let lastViewportTime = 0;
+function sendViewport() {
+  if (time - lastViewportTime < 0.25) return;
+  lastViewportTime = time;
+  let viewport = viewBounds() ?? {};
+  let key = JSON.stringify(viewport);
+  if (key != lastViewport) {
+    lastViewport = key;
+    sendCommand("SetViewport", viewport);
+  }
+}
+
 window.onresize = () => {
   camera.aspect = container.clientWidth / container.clientHeight;
   camera.updateProjectionMatrix();
@@ -105,11 +120,11 @@ window.onresize = () => {
 initScheduler();
 
 connect().then((socket) => {
-  socket.onmessage = (msg) => {
-    let data = JSON.parse(msg.data);
+  onMessage((data) => {
     switch (data.event) {
       case "AddEntity":
-        addEntity(data.details.id, data.details.details);
+        addEntity(data.details.id, entityDetails(data.details));
+        updateEntity(data.details.id, data.details);
         break;
       case "UpdateEntity":
         updateEntity(data.details.id, data.details);
@@ -131,8 +146,7 @@ connect().then((socket) => {
         notify("Simulation state restored successfully.");
         break;
     }
-
-  };
+  });
 
   loadScene(sceneFile);
   renderer.setSize(window.innerWidth, window.innerHeight);
@@ -144,6 +158,7 @@ connect().then((socket) => {
     updateAnimations(delta);
     sendCommand("Update", { simSpeed: simSpeed });
     updateControls();
+    sendViewport();
     renderer.render(scene, camera);
   });
 });
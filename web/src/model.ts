@@ -16,6 +16,23 @@ let mixers: {
   duration?: number;
 }[] = [];
 let ground: THREE.Group | undefined = undefined;
+// updates for entities whose model is still loading
+let pending: Record<number, any> = {};
+
+// the server only sends corrections, entities are moved along their last
+// known velocity in between. the clock offset is the smallest (client -
+// server) time seen, i.e. from the update with the least delay.
+let clockOffset = Infinity;
+const maxExtrapolation = 2;
+
+// details are shared by entities created from the same template and only sent
+// with the first of them, later ones refer to them by id
+let templates: Record<number, any> = {};
+
+function entityDetails(data: any) {
+  if (data.details) templates[data.detailsId] = data.details;
+  return { ...templates[data.detailsId], name: data.name };
+}
 
 function addEntity(id: number, details: any) {
   return new Promise<THREE.Group>((resolve, reject) => {
@@ -59,6 +76,10 @@ function addEntity(id: number, details: any) {
 
       scene.add(group);
       entities[id] = group;
+      if (pending[id]) {
+        updateEntity(id, pending[id]);
+        delete pending[id];
+      }
       resolve(group);
     });
   });
@@ -66,7 +87,10 @@ function addEntity(id: number, details: any) {
 
 function updateEntity(id: number, details: any) {
   let model = entities[id];
-  if (!model) return;
+  if (!model) {
+    pending[id] = details;
+    return;
+  }
 
   model.position.copy(new THREE.Vector3(...details.pos));
   model.position.x /= 14.2;
@@ -75,6 +99,13 @@ function updateEntity(id: number, details: any) {
   model.position.z /= 14.2;
   model.position.add(model.userData.offset);
 
+  let vel = new THREE.Vector3(...(details.vel ?? [0, 0, 0]));
+  vel.divide(new THREE.Vector3(14.2, 20, 14.2));
+  model.userData.base = model.position.clone();
+  model.userData.vel = vel;
+  model.userData.time = details.time;
+  clockOffset = Math.min(clockOffset, performance.now() / 1000 - details.time);
+
   let dir = new THREE.Vector3(...details.dir);
   dir = model.localToWorld(new THREE.Vector3()).add(dir);
   model.lookAt(dir);
@@ -93,6 +124,7 @@ function updateEntity(id: number, details: any) {
 }
 
 function removeEntity(id: number) {
+  delete pending[id];
   scene.remove(entities[id]);
   $(`#entity-select option[value="${id}"]`).remove();
   delete entities[id];
@@ -166,7 +198,19 @@ function loadModel(details: any) {
   });
 }
 
+function extrapolate() {
+  let now = performance.now() / 1000 - clockOffset;
+  Object.values(entities).forEach((model) => {
+    let vel = model.userData.vel;
+    if (!vel) return;
+    let dt = Math.min(now - model.userData.time, maxExtrapolation);
+    if (dt < 0) dt = 0;
+    model.position.copy(model.userData.base).addScaledVector(vel, dt);
+  });
+}
+
 function updateAnimations(delta: number) {
+  extrapolate();
   mixers.forEach((mixer) => {
     if (mixer.start && mixer.duration) {
       if (
@@ -183,6 +227,7 @@ function updateAnimations(delta: number) {
 export {
   entities,
   addEntity,
+  entityDetails,
   removeEntity,
   updateAnimations,
   updateEntity,
@@ -1,5 +1,9 @@
 let socket: WebSocket | undefined = undefined;
 
+// large frames arrive deflated (binary), everything else as plain text.
+// inflating is async, so messages are chained to keep them in order.
+let pending: Promise<void> = Promise.resolve();
+
 function sendCommand(command: string, data: any) {
   if (socket!.readyState == WebSocket.OPEN) {
     data.command = command;
@@ -7,12 +11,38 @@ function sendCommand(command: string, data: any) {
   }
 }
 
+async function inflate(data: ArrayBuffer) {
+  let stream = new Blob([data])
+    .stream()
+    .pipeThrough(new DecompressionStream("deflate-raw"));
+  return await new Response(stream).text();
+}
+
+function onMessage(handler: (data: any) => void) {
+  socket!.onmessage = (msg) => {
+    if (typeof msg.data == "string") {
+      let text = msg.data;
+      pending = pending
+        .then(() => handler(JSON.parse(text)))
+        .catch(console.error);
+    } else {
+      let inflated = inflate(msg.data);
+      pending = pending
+        .then(async () => handler(JSON.parse(await inflated)))
+        .catch(console.error);
+    }
+  };
+}
+
 function connect(host?: string) {
+  // ask for compressed frames unless the browser can't inflate them
+  let query = "DecompressionStream" in window ? "/?compress=deflate" : "";
   if (host) {
-    socket = new WebSocket(`ws://${host}`, "web_server");
+    socket = new WebSocket(`ws://${host}${query}`, "web_server");
   } else {
-    socket = new WebSocket(`ws://${location.host}`, "web_server");
+    socket = new WebSocket(`ws://${location.host}${query}`, "web_server");
   }
+  socket.binaryType = "arraybuffer";
   return new Promise<WebSocket>((resolve, reject) => {
     socket!.onopen = () => {
       resolve(socket!);
@@ -24,4 +54,4 @@ function disconnect() {
   socket!.close();
 }
 
-export { connect, disconnect, sendCommand };
+export { connect, disconnect, onMessage, sendCommand };